@@ -51,6 +51,9 @@
 
 #include "SerialDaemon.h"
 #include "TMSerialPort.h"
+#include "TMTabletProbe.h"
+#include "TMPacketLayout.h"
+#include "TMScan.h"
 
 extern "C" {
 #include "Digitizers.h"
@@ -61,6 +64,7 @@ extern "C" {
 #include <IOKit/hidsystem/IOHIDShared.h>
 
 #include <syslog.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <paths.h>
 #include <signal.h>
@@ -83,6 +87,7 @@ extern "C" {
 #define PRESSURE_SCALE  65535.0
 #define TILT_SCALE      32767.0
 #define LOG_FILE        "/Users/Shared/tabletmagic.log"
+#define CACHE_FILE      "/Library/Caches/com.thinkyhead.TabletMagic.connection"
 #define POST_EVENT      PostCGEvent
 
 enum {
@@ -118,12 +123,12 @@ enum {
 };
 
 char*   LogString(char *str);
-void    ShortSleep();
 bool    GetIntArgument(char *arg, int flag, int *dest);
 bool    GetFloatArgument(char *arg, int flag, float *dest);
 bool    process_arguments(int argc, char *argv[]);
 void    usage();
 void    signal_handler(int sig);
+void    request_quit();
 char*   ReadablePacket(char *packet, int pack_size);
 char*   HexString(char *s, int size);
 bool    UpdateDisplaysBounds();
@@ -132,6 +137,7 @@ void postNullEvent();
 void postTabletEvent(SInt16 x, SInt16 y);
 
 bool    quitProcessor;              // Flag to quit the processor.
+int     quitPipe[2] = { -1, -1 };   // Written to wake the run loop on quit
 FILE    *output = stderr;
 
 // To calculate the byte rate:
@@ -201,6 +207,7 @@ enum {
     PREF_GET_MEMORY_BANK,
     PREF_GET_GEOMETRY,
     PREF_GET_SERIALPORT,
+    PREF_GET_READER_STATS,
 
     // Event streaming
     PREF_STREAM,
@@ -254,6 +261,7 @@ static TMCommandNode TMParseData[] = {
     { "?scale", PREF_GET_SCALE },       // Respond with tablet scale info
     { "?bank", PREF_GET_MEMORY_BANK },  // Respond (soon) with bank setup string
     { "?port", PREF_GET_SERIALPORT },   // Respond with the original port setting
+    { "?reader", PREF_GET_READER_STATS },   // Respond with a group of stream counters (see kReaderStats)
 
     // Pass a command directly to the tablet
     { "command", PREF_SEND_COMMAND },
@@ -271,6 +279,9 @@ static TMCommandNode TMParseData[] = {
     { "tabletpc", PREF_TABLETPC }
 };
 
+//! The groups of stream counters "?reader <group>" can ask for
+static const char *kReaderStats[] = { "reader", "requests", "rate", "reads", "line", "commands", "samples", NULL };
+
 //
 // These bits indicate which fields of a point event have valid data.
 //
@@ -389,12 +400,14 @@ int main(int argc, char *argv[]) {
         //
         // Set signal handlers to exit cleanly if killed
         //
-        // TODO: The UNIX Domain Sockets code includes a method to have
-        // the signal handler pass its structure through a socket and
-        // remain within the context of the run loop.
-        //
-        // Consider using this method instead of the current one.
+        // The run loop only wakes up for input, so the handler
+        // writes to a pipe that the run loop is watching.
         //
+        if (pipe(quitPipe) == 0) {
+            fcntl(quitPipe[0], F_SETFL, O_NONBLOCK);
+            fcntl(quitPipe[1], F_SETFL, O_NONBLOCK);
+        }
+
         struct sigaction sa, oldquit, oldterm, oldstop, oldhup, oldabrt, oldint;
 
         sa.sa_handler = signal_handler;
@@ -503,6 +516,11 @@ int main(int argc, char *argv[]) {
         sigaction(SIGSTOP,  &oldstop,   NULL);
         sigaction(SIGABRT,  &oldabrt,   NULL);
         sigaction(SIGINT,   &oldint,    NULL);
+
+        if (quitPipe[0] != -1) {
+            close(quitPipe[0]);
+            close(quitPipe[1]);
+        }
     }
 
     /*
@@ -578,6 +596,12 @@ bool process_arguments(int argc, char *argv[]) {
     args.startoff       = false;        // DON'T start up in disabled mode
     args.quit           = false;        // DON'T always quit
     args.logging        = false;        // DON'T redirect output to a log file
+    args.threaded       = false;        // DON'T read the serial port on its own thread
+    args.rescan         = false;        // DON'T skip the last known connection
+    args.keepspeed      = false;        // DON'T keep the detected line speed
+    args.adaptive       = false;        // DON'T adapt the report rate
+    args.packetreads    = false;        // DON'T wait for whole packets
+    args.lowlatency     = false;        // DON'T ask for low latency
     args.mouse          = false;        // DON'T operate in mouse mode
     args.port           = NULL;         // NO first named port to try
     args.init           = NULL;         // NO initial setup string to send to the tablet
@@ -598,7 +622,7 @@ bool process_arguments(int argc, char *argv[]) {
     args.scr_bottom     = -1;
 
     do {
-        c = getopt(argc, argv, "3cdFhmoqwXi:p:n:l:r:t:b:L:R:T:B:M:s:");
+        c = getopt(argc, argv, "3AacdFhkmoPqSuwXi:p:n:l:r:t:b:L:R:T:B:M:s:");
         switch(c) {
             case EOF: break;
             case 'c': args.command      = true; break;
@@ -607,6 +631,12 @@ bool process_arguments(int argc, char *argv[]) {
 #endif
             case 'F': args.forcepc      = true; break;
             case '3': args.baud38400    = true; break;
+            case 'a': args.threaded     = true; break;
+            case 'S': args.rescan       = true; break;
+            case 'k': args.keepspeed    = true; break;
+            case 'A': args.adaptive     = true; break;
+            case 'P': args.packetreads  = true; break;
+            case 'u': args.lowlatency   = true; break;
             case 'q': args.quiet        = true; break;
             case 'w': args.logging      = true; break;
             case 'X': args.quit         = true; break;
@@ -675,6 +705,8 @@ void usage() {
     const char *fmt = "  %-17s%s.\n";
     printf("\nUsage: TabletMagicDaemon [options]\n");
     printf(fmt, "-3",               "Initially try 38400 baud");
+    printf(fmt, "-A",               "Lower the report rate while not drawing");
+    printf(fmt, "-a",               "Read the serial port on its own thread");
     printf(fmt, "-c",               "Run in command mode");
 #if __MAC_OS_X_VERSION_MIN_REQUIRED < MAC_OS_X_VERSION_10_5
     printf(fmt, "-d",               "Daemonize when starting");
@@ -682,6 +714,7 @@ void usage() {
     printf(fmt, "-F",               "Force TabletPC Mode");
     printf(fmt, "-h",               "Print this helpful message");
     printf(fmt, "-i setup",         "Initialize with a setup string");
+    printf(fmt, "-k",               "Keep the line speed the tablet was found at");
     printf(fmt, "-l# -r# -t# -b#",  "Set screen boundaries");
     printf(fmt, "-L# -R# -T# -B#",  "Set tablet boundaries");
     printf(fmt, "-m",               "Enable mouse mode");
@@ -689,8 +722,11 @@ void usage() {
     printf(fmt, "-n#",              "Renice the daemon (-20...20)");
     printf(fmt, "-o",               "Enabled state: off (command mode only)");
     printf(fmt, "-p portname",      "Connect to a particular serial port");
+    printf(fmt, "-P",               "Wake up once per packet, not per byte");
     printf(fmt, "-q",               "Quiet - no diagnostic output");
     printf(fmt, "-s#",              "Set mouse scaling (0.1 ... 10.0)");
+    printf(fmt, "-S",               "Scan all ports, ignoring the last connection");
+    printf(fmt, "-u",               "Low latency mode for USB-serial adapters");
     printf(fmt, "-X",               "Exit after initializing the tablet");
 }
 
@@ -703,9 +739,24 @@ void usage() {
 // When the daemon has a config file it'll make more sense.
 //
 void signal_handler(int sig) {
-    quitProcessor = true;
+    request_quit();
 };
 
+//
+// request_quit
+//
+// Set the quit flag and poke the run loop so it notices.
+// This is safe to call from a signal handler.
+//
+void request_quit() {
+    quitProcessor = true;
+
+    if (quitPipe[1] != -1) {
+        char c = 'q';
+        (void)write(quitPipe[1], &c, 1);
+    }
+}
+
 
 #pragma mark - WacomTablet
 
@@ -746,7 +797,33 @@ WacomTablet::WacomTablet(init_arguments inArgs) {
     test_mode       = false;                    // Test mode pings the tablet then quits
     gEventDriver    = MACH_PORT_NULL;           // No HID connection yet
     send_stream     = false;                    // Keep the stream to myself for now
+    decoder         = &WacomTablet::DecodeUnsupported; // No protocol until a tablet is found
+    bin_mode        = -1;                       // No packets seen yet
+    iv_short_pressure = false;
+    use_reader      = inArgs.threaded;          // Read the port on its own thread
+    resuming        = false;                    // Not initializing from the cache
+    listened        = false;                    // Not found by listening
+    govern_rate     = false;                    // Report at a fixed rate
+    tailTimer       = NULL;                     // No partial packets to look for yet
+    watchdogTimer   = NULL;                     // Nothing to watch yet
+    governTimer     = NULL;                     // No rate to govern yet
+    watchdog_armed  = false;
+    resync_reason   = kStreamOK;
+    resync_settling = kStreamOK;                // No resync under way
+    streamReads     = streamPackets = 0;
+    initialized_model = kModelUnknown;
+
+    clearstr(unplugged_port);                   // Nothing to wait for
+    returnTimer     = NULL;
+    return_tries    = 0;
+
+    framer.SetCallback(WacomTablet::FramerCallback, this);
+    portMonitor.SetCallback(WacomTablet::PortEventCallback, this);
+    requests.SetSender(WacomTablet::RequestSender, this);
+    commands.SetPort(&serialPort);
+    commands.SetWriter(WacomTablet::CommandWriter, this);
     stream_size     = 0;
+    staged_count    = 0;
 
     //
     // Pass command-line arguments to the tablet object
@@ -762,8 +839,14 @@ WacomTablet::WacomTablet(init_arguments inArgs) {
     if (KERN_SUCCESS != OpenHIDService())
         throw "Can't connect to IO Master Port";
 
-    if (!quiet_mode)
+    if (!quiet_mode) {
         serialPort.SetOutput(output);
+        serialReader.SetOutput(output);
+        portMonitor.SetOutput(output);
+    }
+
+    // Applied by every Open from here on
+    (void)serialPort.SetLowLatency(args.lowlatency);
 
     if (args.command) {
         CreateLocalMessagePort();
@@ -792,8 +875,13 @@ WacomTablet::~WacomTablet() {
 #endif
 
     CloseHIDService();
+    DetachSerialSource();
     serialPort.Close();
 
+    if (use_reader && !quiet_mode)
+        for (int i=0; kReaderStats[i] != NULL; i++)
+            fprintf(output, "[READ] %s\n", GetMessageReaderStats(kReaderStats[i]));
+
 #if LOG_STREAM_TO_FILE
     if (logfile) fclose(logfile);
 #endif
@@ -837,34 +925,23 @@ kern_return_t WacomTablet::CloseHIDService() {
 
 //
 // RunEventLoop
-// Add a CFTimer to the Run Loop to get the stream processor going.
+// Watch the serial port and the quit pipe from the Run Loop.
 //
 void WacomTablet::RunEventLoop() {
     //
-    // This timer polls the serial port 250 times per second
-    //
-    // At 19200 a tablet can theoretically send 213 or 274 packets
-    // At 38400 (Intuos 2) there can theoretically be ~427 packets
+    // Serial data is processed as soon as it arrives, so there is no
+    // polling latency and an idle tablet costs no wakeups at all.
     //
-    CFRunLoopTimerContext ctx;
-    bzero(&ctx, sizeof(ctx));
-    ctx.info = this;
-    CFRunLoopTimerRef serialTimer = CFRunLoopTimerCreate(
-                                                         NULL,
-                                                         CFAbsoluteTimeGetCurrent()+0.25,
-                                                         1.0 / 250,
-                                                         0,
-                                                         0,
-                                                         WacomTablet::TabletTimerCallback,
-                                                         &ctx
-                                                         );
-
-    CFRunLoopAddTimer( CFRunLoopGetCurrent(), serialTimer, kCFRunLoopDefaultMode );
+    UpdateSerialSource();
+    quitSource.Attach(quitPipe[0], WacomTablet::QuitInputCallback, this);
 
     //
     // Run separate event timer if flagged (experimental)
     //
 #if EVENT_TIMER_IS_SEPARATE
+    CFRunLoopTimerContext ctx;
+    bzero(&ctx, sizeof(ctx));
+    ctx.info = this;
     CFRunLoopTimerRef eventTimer = CFRunLoopTimerCreate(
                                                         NULL,
                                                         CFAbsoluteTimeGetCurrent()+0.125,
@@ -872,7 +949,7 @@ void WacomTablet::RunEventLoop() {
                                                         0,
                                                         0,
                                                         WacomTablet::EventTimerCallback,
-                                                        ctx
+                                                        &ctx
                                                         );
     CFRunLoopAddTimer( CFRunLoopGetCurrent(), eventTimer, kCFRunLoopDefaultMode );
 #endif
@@ -887,15 +964,110 @@ void WacomTablet::RunEventLoop() {
 
 
     //
-    // The run loop exited. Destroy the timers and return
+    // The run loop exited. Destroy the sources and return
     //
 #if EVENT_TIMER_IS_SEPARATE
     CFRunLoopTimerInvalidate( eventTimer );
     CFRelease( eventTimer );
 #endif
 
-    CFRunLoopTimerInvalidate( serialTimer );
-    CFRelease( serialTimer );
+    quitSource.Detach();
+    DetachSerialSource();
+}
+
+
+//
+// UpdateSerialSource
+//
+// Attach the input source to the serial port that is
+// currently open. This must be called whenever the port
+// is opened, and the source detached before it closes.
+//
+void WacomTablet::UpdateSerialSource() {
+    if (!IsActive())
+        DetachSerialSource();
+    else {
+        // The reader thread looks at the read mode when it starts
+        if (args.packetreads)
+            serialPort.SetPacketReads(settings[0].packet_size);
+
+        if (use_reader) {
+            if (!serialReader.IsRunning() && serialReader.Start(&serialPort))
+                serialSource.Attach(serialReader.NotifyDevice(), WacomTablet::ReaderInputCallback, this);
+        }
+        else if (serialSource.FileDevice() != serialPort.FileDevice())
+            serialSource.Attach(serialPort.FileDevice(), WacomTablet::SerialInputCallback, this);
+
+        UpdateReadMode();
+    }
+}
+
+//
+// UpdateReadMode
+//
+// Packet reads (-P) and error marks are only for the stream.
+// Modal requests read replies of any length, so they get plain
+// byte reads.
+//
+void WacomTablet::UpdateReadMode() {
+    bool streaming = serialSource.IsAttached() || serialReader.IsRunning();
+    int size = (args.packetreads && streaming) ? settings[0].packet_size : 0;
+
+    if (serialPort.PacketReads() != size)
+        serialPort.SetPacketReads(size);
+
+    // Line errors are marked in the stream, where the framer
+    // can drop just the packet they spoiled
+    if (serialPort.ErrorMarks() != streaming) {
+        (void)serialPort.SetErrorMarks(streaming);
+        framer.SetErrorMarks(streaming);
+    }
+}
+
+//
+// ArmTailTimer
+//
+// With packet reads the last few bytes of a burst, or a short
+// reply, don't make the port readable. Look again a couple of
+// packet times after each read and after each command.
+//
+void WacomTablet::ArmTailTimer() {
+    if (!serialPort.PacketReads() || use_reader)
+        return;
+
+    CFAbsoluteTime when = CFAbsoluteTimeGetCurrent() + serialPort.PacketTimeout() / 1000000.0;
+
+    if (tailTimer == NULL) {
+        CFRunLoopTimerContext ctx = { 0, this, NULL, NULL, NULL };
+        tailTimer = CFRunLoopTimerCreate(NULL, when, 1.0e10, 0, 0, WacomTablet::TailTimerCallback, &ctx);
+        CFRunLoopAddTimer(CFRunLoopGetCurrent(), tailTimer, kCFRunLoopDefaultMode);
+    }
+    else
+        CFRunLoopTimerSetNextFireDate(tailTimer, when);
+}
+
+void WacomTablet::TailTimerCallback( CFRunLoopTimerRef timer, void *info ) {
+    WacomTablet *t = (WacomTablet*)info;
+    if (t->IsActive() && t->serialSource.IsAttached() && !t->AwaitingModalReply() && t->serialPort.BytesOnPort() > 0)
+        t->ProcessSerialStream();
+}
+
+//
+// DetachSerialSource
+//
+// Stop watching the serial port so it can be read directly
+// or closed. In reader mode the thread is stopped and any
+// bytes it already queued are processed.
+//
+void WacomTablet::DetachSerialSource() {
+    serialSource.Detach();
+
+    if (serialReader.IsRunning()) {
+        serialReader.Stop();
+        ProcessReaderChunks();
+    }
+
+    UpdateReadMode();
 }
 
 
@@ -908,11 +1080,14 @@ void WacomTablet::RunEventLoop() {
 // a different port
 //
 void WacomTablet::InitializeForPort(char *port_name) {
+    portMonitor.Stop();                         // A new port, so stop waiting for the old one
+    clearstr(unplugged_port);
+    DetachSerialSource();
+    requests.Clear();                           // Nothing to ask the old port
+    commands.Clear();                           // ...or to tell it
     serialPort.Close();
 
-    in_packet       = false;                    // No packet marker received yet
-    phrase_count    = 0;                        // No packet bytes received yet
-    comma_count     = 0;
+    framer.Reset();                             // No packet bytes received yet
 
     clearstr(model_number);                     // No tablet identified yet
     clearstr(rom_version);                      // No ROM identified yet
@@ -920,13 +1095,20 @@ void WacomTablet::InitializeForPort(char *port_name) {
     base_version = 1.3f;                        // Assume at least this much
     series_index = kModelUnknown;               // Not sure which tablet yet
     can_parse_ud_setup = true;
+    UpdateFramer();
 
     if (FindTabletOnPort(port_name)) {
+        // Watch the new stream from here on
+        watchdog.Reset(CFAbsoluteTimeGetCurrent());
+        resync_reason = resync_settling = kStreamOK;
+
         // Tell the Preference Pane we're all set!
         if (args.command)
             SendMessage("[ready]");
 
         InitStylus();
+        UpdateSerialSource();
+        StartPortMonitor();
     }
     else {
         if (args.command)                   // Is the Preference Pane listening?
@@ -937,21 +1119,166 @@ void WacomTablet::InitializeForPort(char *port_name) {
 }
 
 
+//
+// StartPortMonitor
+//
+// Watch for the port being unplugged. Elsewhere than OS X the
+// directory holding the port is watched, since that's where it
+// will reappear.
+//
+void WacomTablet::StartPortMonitor() {
+    char dir[MAXPATHLEN];
+    strcpy(dir, serialPort.DeviceFilePath());
+
+    char *slash = strrchr(dir, '/');
+    if (slash == NULL)
+        clearstr(dir);
+    else if (slash == dir)
+        dir[1] = '\0';
+    else
+        *slash = '\0';
+
+    if (!portMonitor.Start(dir) && !quiet_mode)
+        fprintf(output, "[PORT] Can't watch for %s being unplugged\n", serialPort.Name());
+}
+
+void WacomTablet::PortEventCallback(PortEvent event, const char *path, void *info) {
+    WacomTablet *t = (WacomTablet*)info;
+
+    if (event == kPortRemoved) {
+        // IOKit may not know the path of a device that's gone
+        if (t->IsActive() && (strcmp(path, t->serialPort.DeviceFilePath()) == 0 || access(t->serialPort.DeviceFilePath(), F_OK) != 0))
+            t->PortRemoved();
+    }
+    else if (t->unplugged_port[0] != '\0' && strcmp(path, t->unplugged_port) == 0)
+        t->ArmReturn(kReturnSettle);
+}
+
+//
+// PortRemoved
+//
+// The adapter was unplugged. Let go of the port and stop
+// all the timers that would poke at it, and remember it so
+// it can be picked up again.
+//
+void WacomTablet::PortRemoved() {
+    if (!quiet_mode)
+        fprintf(output, "[PORT] %s was unplugged\n", serialPort.Name());
+
+    strcpy(unplugged_port, serialPort.DeviceFilePath());
+    return_tries = 0;
+
+    DetachSerialSource();
+    requests.Clear();
+    commands.Clear();
+
+    if (tailTimer != NULL)
+        CFRunLoopTimerSetNextFireDate(tailTimer, 1.0e10);
+
+    if (watchdogTimer != NULL)
+        CFRunLoopTimerSetNextFireDate(watchdogTimer, 1.0e10);
+
+    if (governTimer != NULL)
+        CFRunLoopTimerSetNextFireDate(governTimer, 1.0e10);
+
+    if (returnTimer != NULL)
+        CFRunLoopTimerSetNextFireDate(returnTimer, 1.0e10);
+
+    watchdog_armed = false;
+    resync_reason = resync_settling = kStreamOK;
+
+    serialPort.Close();
+    framer.Reset();
+    ResetStylus();
+}
+
+//
+// PortReturned
+//
+// The adapter is back, and its events have settled. Only the last
+// connection is tried at first, so the tablet is usually going again
+// without being queried at all. The node may show up before the
+// device is ready, so that's tried a few times before a full scan.
+//
+void WacomTablet::PortReturned() {
+    char path[MAXPATHLEN];
+    strcpy(path, unplugged_port);
+
+    bool resumable = !args.forcepc && !args.rescan;
+    bool scan = !resumable || ++return_tries > kReturnTries;
+
+    if (!quiet_mode)
+        fprintf(output, "[PORT] %s is back, %s\n", path, scan ? "scanning it" : "resuming the last connection");
+
+    if (scan ? !FindTabletOnPort(path) : !ResumeLastConnection(path)) {
+        // After a full scan, wait for the port to change again
+        if (scan)
+            return_tries = 0;
+        else
+            ArmReturn(kReturnRetry);
+        return;
+    }
+
+    clearstr(unplugged_port);
+    return_tries = 0;
+
+    watchdog.Reset(CFAbsoluteTimeGetCurrent());
+    resync_reason = resync_settling = kStreamOK;
+
+    if (args.command)
+        SendMessage("[ready]");
+
+    InitStylus();
+    UpdateSerialSource();
+}
+
+//
+// ArmReturn(delay)
+//
+// Every event for the returned port puts the next try off, so a
+// burst of them (creation, then each change of owner or mode)
+// ends in a single try instead of one per event.
+//
+void WacomTablet::ArmReturn(CFTimeInterval delay) {
+    CFAbsoluteTime when = CFAbsoluteTimeGetCurrent() + delay;
+
+    if (returnTimer == NULL) {
+        CFRunLoopTimerContext ctx = { 0, this, NULL, NULL, NULL };
+        returnTimer = CFRunLoopTimerCreate(NULL, when, 1.0e10, 0, 0, WacomTablet::ReturnTimerCallback, &ctx);
+        CFRunLoopAddTimer(CFRunLoopGetCurrent(), returnTimer, kCFRunLoopDefaultMode);
+    }
+    else
+        CFRunLoopTimerSetNextFireDate(returnTimer, when);
+}
+
+void WacomTablet::ReturnTimerCallback( CFRunLoopTimerRef timer, void *info ) {
+    WacomTablet *t = (WacomTablet*)info;
+
+    // Another port may have been chosen in the meantime
+    if (t->unplugged_port[0] == '\0' || t->IsActive())
+        return;
+
+    t->PortReturned();
+}
+
 //
 // FindTabletOnPort
 //
 //  This pokes through all available RS232 serial ports looking for
-//  tablets. It tries each port at 9600 and 19200 baud.
+//  tablets. It tries each port at 9600, 19200 and 38400 baud.
 //
 bool WacomTablet::FindTabletOnPort(char *port_name) {
 
-    // Use 9600 and 19200 alternately, starting with the current speed
-    // TODO: Include 38400 for Intuos 2 tablets
+    // Use 9600 and 19200 alternately, starting with the current speed.
+    // A tablet whose speed was raised stays there until it's switched
+    // off, so try 38400 too.
     int first_speed = (int)serialPort.Speed();
     int second_speed = (first_speed == B9600) ? B19200 : B9600;
+    int third_speed = (first_speed == B38400) ? B19200 : B38400;
 
     int typical_models[] = {    kModelUnknown, first_speed,
         kModelUnknown, second_speed,
+        kModelUnknown, third_speed,
 #if FALLBACK_TO_SD
         kModelSDSeries, B9600,
 #endif
@@ -980,8 +1307,187 @@ bool WacomTablet::FindTabletOnPort(char *port_name) {
 
     int *models_to_try = hackintosh ? tablet_pc_models : typical_models;
 
+    double start = TMTabletProbe::Milliseconds();
+
+    listened = false;
+
+    // Try the last connection that worked before scanning anything
+    bool resumed = !args.forcepc && !args.rescan && ResumeLastConnection(port_name);
+
+    // With -F nothing is asked. Listen for the speed, and failing
+    // that the first port that opens wins. Otherwise ask all the
+    // ports at once and use the one that answers, and if none do
+    // listen for a TabletPC that never answers.
+    if (!resumed) {
+        if (args.forcepc) {
+            if (!ListenPortsInTurn(port_name))
+                (void)ScanPortsInTurn(port_name, models_to_try);
+        }
+        else if (!ProbePortsAtOnce(port_name, models_to_try)) {
+            bool heard = hackintosh && ListenPortsInTurn(port_name);
+            if (!heard && FALLBACK_TO_SD)
+                (void)ScanPortsInTurn(port_name, models_to_try);
+        }
+    }
+
+    // If the whole scan failed reset the baud rate
+    if (!IsActive()) {
+        serialPort.Close();
+        serialPort.SetSpeed(first_speed);
+    }
+    else if (!args.forcepc && !listened)
+        SaveLastConnection();
+
+    if (!quiet_mode && IsActive()) {
+        fprintf(output, "[PORT] Initialization took %lu select, %lu read and %lu ioctl calls\n", serialPort.selectCalls, serialPort.readCalls, serialPort.ioctlCalls);
+        if (serialPort.flushedBytes > 0)
+            fprintf(output, "[PORT] Flushed %lu stray bytes%s\n", serialPort.flushedBytes, serialPort.flushTimeouts ? " (still arriving at the deadline)" : "");
+        if (args.lowlatency)
+            fprintf(output, "[PORT] Low latency: %s\n", serialPort.LowLatencyState());
+    }
+
+    if (!quiet_mode)
+        fprintf(output, "\n%s (%s, %.0f ms).\n\n", IsActive() ? "Tablet initialized" : "Could not initialize tablet", resumed ? "last connection" : "full scan", TMTabletProbe::Milliseconds() - start);
+
+    return IsActive();
+}
+
+//
+// ResumeLastConnection(port_name)
+//
+// Open the port that worked last time at the same speed and
+// ask for the tablet ID. If the same tablet answers, the cached
+// settings and scale are used instead of asking for them again.
+//
+bool WacomTablet::ResumeLastConnection(char *port_name) {
+    if (!lastConnection.Load(CACHE_FILE))
+        return false;
+
+    // A port named on the command line overrides the cache
+    if (port_name != NULL && port_name[0] != '\0' && NULL == strstr(lastConnection.port, port_name))
+        return false;
+
+    double start = TMTabletProbe::Milliseconds();
+
+    serialPort.SetSpeed((speed_t)lastConnection.speed);
+
+    if (serialPort.Open(lastConnection.port) == kSerialError) {
+        if (!quiet_mode)
+            fprintf(output, "[CACHE] %s is gone. Scanning all ports.\n", lastConnection.port);
+        return false;
+    }
+
+    resuming = true;
+    bool ok = InitializeTablet(lastConnection.model);
+    resuming = false;
+
+    if (!ok)
+        serialPort.Close();
+
+    if (!quiet_mode) {
+        if (ok)
+            fprintf(output, "[CACHE] Resumed %s at %ld in %.0f ms\n", serialPort.Name(), TMSerialPort::BaudValue(lastConnection.speed), TMTabletProbe::Milliseconds() - start);
+        else
+            fprintf(output, "[CACHE] No match on %s after %.0f ms. Scanning all ports.\n", lastConnection.port, TMTabletProbe::Milliseconds() - start);
+    }
+
+    return ok;
+}
+
+//
+// SaveLastConnection
+//
+// Remember the connection for next time. InitializeTablet has
+// already filled in the replies it received. Connections made
+// without any reply (the SD fallback) aren't worth remembering.
+//
+void WacomTablet::SaveLastConnection() {
+    if (initialized_model == kModelSDSeries)
+        return;
+
+    TMConnectionCache::CopyField(lastConnection.port, serialPort.DeviceFilePath(), sizeof(lastConnection.port));
+    lastConnection.speed = (long)serialPort.Speed();
+    lastConnection.model = initialized_model;
+    lastConnection.series = series_index;
+
+    // The line speed may have been raised since the settings arrived
+    if (lastConnection.setup[0] != '\0')
+        sprintf(lastConnection.setup, "~R%s", settings[0].SettingsString());
+
+    if (!lastConnection.Save(CACHE_FILE) && !quiet_mode)
+        fprintf(output, "[CACHE] Can't write %s - %s(%d).\n", CACHE_FILE, strerror(errno), errno);
+}
+
+//
+// ProbePortsAtOnce(port_name, models)
+//
+// Ask every matching port for a tablet ID at the same time, then
+// open and initialize the port that answered first.
+//
+bool WacomTablet::ProbePortsAtOnce(char *port_name, int *models_to_try) {
+    TMTabletProbe probe;
+    probe.SetOutput(quiet_mode ? NULL : output);
+
+    if (!probe.Run(port_name, models_to_try))
+        return false;
+
+    serialPort.SetSpeed(probe.FoundSpeed());
+
+    bool opened = (serialPort.Open(probe.FoundPath()) != kSerialError);
+
+    if (!quiet_mode)
+        fprintf(output, "\n[PORT] %s: %s\n", serialPort.Name(), opened ? "OPENED" : "OPEN ERROR");
+
+    if (opened && !InitializeTablet(probe.FoundModel()))
+        serialPort.Close();
+
+    return IsActive();
+}
+
+//
+// ListenPortsInTurn(port_name)
+//
+// Listen to each port in turn for a TabletPC that is already
+// sending, and initialize it at the speed it was heard at.
+// Since it may never answer, it isn't asked anything.
+//
+bool WacomTablet::ListenPortsInTurn(char *port_name) {
+    speed_t speeds[] = { args.baud38400 ? B38400 : B19200, args.baud38400 ? B19200 : B38400, B9600 };
+
+    TMBaudDetector detector;
+    detector.SetOutput(quiet_mode ? NULL : output);
+
+    if (serialPort.BeginPortScan(port_name)) {
+        while (serialPort.OpenNextMatchingPort(port_name)) {
+            if (detector.Detect(&serialPort, speeds, sizeof(speeds) / sizeof(speeds[0]), kFramerTabletPC, 9, true)) {
+                if (!quiet_mode)
+                    fprintf(output, "[PORT] %s: Heard a TabletPC at %ld after %.0f ms (score %.2f)\n", serialPort.Name(), TMSerialPort::BaudValue(detector.BestSpeed()), detector.elapsed, detector.BestScore());
+
+                listened = true;
+                if (InitializeTablet(kModelTabletPC))
+                    break;
+
+                listened = false;
+            }
+
+            serialPort.Close();
+        }
+    }
+
+    serialPort.EndPortScan();
+
+    return IsActive();
+}
+
+//
+// ScanPortsInTurn(port_name, models)
+//
+// Try each port in turn, at each model and speed in turn,
+// until a tablet can be initialized.
+//
+bool WacomTablet::ScanPortsInTurn(char *port_name, int *models_to_try) {
     // Scan through all serial ports
-    if (KERN_SUCCESS == serialPort.BeginPortScan()) {
+    if (serialPort.BeginPortScan(port_name)) {
         // Get the next device that matches the Port parameter
         while (serialPort.OpenNextMatchingPort(port_name)) {
             // Loop through the baud rates 9600/19200 (or vice-versa)
@@ -1005,15 +1511,6 @@ bool WacomTablet::FindTabletOnPort(char *port_name) {
 SCAN_DONE:
     serialPort.EndPortScan();
 
-    // If the whole scan failed reset the baud rate
-    if (!IsActive()) {
-        serialPort.Close();
-        serialPort.SetSpeed(first_speed);
-    }
-
-    if (!quiet_mode)
-        fprintf(output, "\n%s.\n\n", IsActive() ? "Tablet initialized" : "Could not initialize tablet");
-
     return IsActive();
 }
 
@@ -1027,6 +1524,11 @@ SCAN_DONE:
 bool WacomTablet::InitializeTablet(int try_tablet_model) {
     bool    result = false;
     char    *tablet_id = NULL;
+    char    id_reply[sizeof(lastConnection.id)];
+
+    // Collect the replies afresh unless they're being reused
+    if (!resuming)
+        lastConnection.Clear();
 
     do {    // Within this block "break" signifies failure
 
@@ -1034,16 +1536,16 @@ bool WacomTablet::InitializeTablet(int try_tablet_model) {
             asprintf(&tablet_id, "~#SD-Fallback V1.2");
         }
         else if (try_tablet_model == kModelTabletPC) {
-            if (!args.forcepc) {
+            if (!args.forcepc && !listened) {
                 // Tell the tablet to stop sending
                 if (!SendCommandToTablet(TPC_StopTablet))
                     break;
 
-                (void)usleep(100000);   // 0.1 seconds
+                commands.Wait();        // Let it stop before flushing
                 (void)Flush();
 
                 // Send a "*" command to the tablet
-                int reply_len = SendRequestToTablet(TPC_TabletID);
+                int reply_len = SendRequestToTablet(TPC_TabletID, TPC_QUERY_REPLY_SIZE);
                 if (!quiet_mode) fprintf(output, "[RCVD] %s\n", HexString(modalbuffer, reply_len));
                 ProcessTabletPCCommandReply(modalbuffer);
 
@@ -1083,6 +1585,8 @@ bool WacomTablet::InitializeTablet(int try_tablet_model) {
                 break;
         }
 
+        TMConnectionCache::CopyField(id_reply, tablet_id, sizeof(id_reply));
+
         ProcessCommandReply(tablet_id);
 
         if (tablet_id != NULL) {
@@ -1090,6 +1594,14 @@ bool WacomTablet::InitializeTablet(int try_tablet_model) {
             tablet_id = NULL;
         }
 
+        // When resuming, only the same tablet will do
+        if (resuming) {
+            if (strcmp(id_reply, lastConnection.id) != 0 || series_index != lastConnection.series)
+                break;
+        }
+        else
+            strcpy(lastConnection.id, id_reply);
+
         //
         // SD, Penpartner, and Intuos tablets don't respond to settings requests
         //
@@ -1123,14 +1635,16 @@ bool WacomTablet::InitializeTablet(int try_tablet_model) {
                 settings[0].InitForIntuos();
                 break;
 
-            default:
+            default: {
+                // A setup string changes the settings, so they must be asked for
+                bool use_cached = resuming && args.init == NULL && lastConnection.setup[0] == '~';
+
                 // If an initialization string was passed send it to the tablet
                 // and clear it so next time no init will occur
                 if (args.init != NULL) {
                     char setstr[32];
                     sprintf(setstr, "%s%s\r", (args.init[0]=='~' ? "" : "~*"), args.init);
                     SendCommandToTablet(setstr);
-                    ShortSleep();
                     free(args.init);
                     args.init = NULL;
                 }
@@ -1138,8 +1652,15 @@ bool WacomTablet::InitializeTablet(int try_tablet_model) {
                 // Request the initial tablet settings
                 // If the tablet fails to respond, consider the tablet inactive
                 answers_settings = true;
-                if (!GetUDSettingsOrFail() && args.command)
+                if (use_cached) {
+                    bank_last_requested = 0;
+                    ProcessCommandReply(lastConnection.setup);
+                }
+                else if (GetUDSettingsOrFail())
+                    sprintf(lastConnection.setup, "~R%s", settings[0].SettingsString());
+                else if (args.command)
                     SetProcessing(false);
+            }
         }
 
         // Print settings for tablets that don't announce them
@@ -1157,28 +1678,40 @@ bool WacomTablet::InitializeTablet(int try_tablet_model) {
             SendScaleToTablet(15240, 15240);            // For SD impose this resolution so that we "know"
             UpdateTabletScale(15240, 15240);
         }
+        else if (resuming && lastConnection.scale[0] == '~') {
+            char maxc[sizeof(lastConnection.scale)];
+            strcpy(maxc, lastConnection.scale);
+            ProcessCommandReply(maxc);
+        }
         else {
             char* maxc = RequestMaxCoordinatesModal();
             if (strlen(maxc) == 0) break;
+            TMConnectionCache::CopyField(lastConnection.scale, maxc, sizeof(lastConnection.scale));
             ProcessCommandReply(maxc);
         }
 
+        // Go as fast as the tablet allows
+        if (!args.keepspeed && !args.forcepc && !listened && !RaiseLinkSpeed(answers_settings))
+            break;
+
+        // Frame the stream according to the settings
+        UpdateFramer();
+
+        // Let the governor vary the rate of TabletPC and UD tablets.
+        // A TabletPC found with -F or by listening is left alone, as
+        // in StartTablet, so it gets no rate commands either.
+        bool tpc_commands = (series_index == kModelTabletPC && !args.forcepc && !listened);
+        govern_rate = args.adaptive && (tpc_commands || (answers_settings && settings[0].command_set == kCommandSetWacomIV));
+        full_interval = rate_interval = settings[0].interval;
+        governor.Reset(CFAbsoluteTimeGetCurrent());
+
         // Tell the tablet to start sending
-        if (args.forcepc) {
-            if (series_index != kModelTabletPC)
-                SendCommandToTablet(WAC_StartTablet);
-        }
-        else {
-            switch (series_index) {
-                case kModelTabletPC:
-                    SendCommandToTablet(TPC_Sample133pps);
-                    break;
-                default:
-                    SendCommandToTablet(WAC_StartTablet);
-                    break;
-            }
-        }
+        StartTablet();
 
+        if (govern_rate)
+            ArmGovernor();
+
+        initialized_model = try_tablet_model;
         result = true;
 
     } while (false);
@@ -1186,6 +1719,91 @@ bool WacomTablet::InitializeTablet(int try_tablet_model) {
     return result;
 }
 
+//
+// RaiseLinkSpeed(ud_setup)
+//
+// Switch the tablet and the port to the fastest speed they both
+// support. Intuos tablets have BA commands for this, while UD
+// tablets take the speed as part of a setup string. If the tablet
+// stops answering at the new speed, go back to the old one.
+//
+// Returns false only if the tablet can't be reached at all.
+//
+bool WacomTablet::RaiseLinkSpeed(bool ud_setup) {
+    speed_t old_speed = serialPort.Speed(), new_speed;
+    UInt8   old_rate = settings[0].baud_rate, new_rate;
+    char    raise[64], lower[64];
+
+    switch (series_index) {
+        case kModelIntuos2:
+            new_speed = B38400;
+            new_rate = kBaudRate38400;
+            strcpy(raise, WACV_SetBaud38400);
+            strcpy(lower, (old_speed == B19200) ? WACV_SetBaud19200 : WACV_SetBaud9600);
+            break;
+
+        case kModelIntuos:
+            new_speed = B19200;
+            new_rate = kBaudRate19200;
+            strcpy(raise, WACV_SetBaud19200);
+            strcpy(lower, WACV_SetBaud9600);
+            break;
+
+        default:
+            if (!ud_setup || settings[0].command_set != kCommandSetWacomIV)
+                return true;
+
+            new_speed = B19200;
+            new_rate = kBaudRate19200;
+            sprintf(lower, "~*%s\r", settings[0].SettingsString());
+            settings[0].baud_rate = new_rate;
+            sprintf(raise, "~*%s\r", settings[0].SettingsString());
+            settings[0].baud_rate = old_rate;
+            break;
+    }
+
+    // Already there, perhaps from an earlier run
+    if (old_speed == new_speed) {
+        settings[0].baud_rate = new_rate;
+        return true;
+    }
+
+    if (ChangeLinkSpeed(raise, new_speed)) {
+        settings[0].baud_rate = new_rate;
+        if (!quiet_mode) fprintf(output, "[PORT] Line speed raised to %ld\n", TMSerialPort::BaudValue(new_speed));
+        return true;
+    }
+
+    if (!quiet_mode) fprintf(output, "[PORT] No answer at %ld. Going back to %ld.\n", TMSerialPort::BaudValue(new_speed), TMSerialPort::BaudValue(old_speed));
+
+    return ChangeLinkSpeed(lower, old_speed);
+}
+
+//
+// ChangeLinkSpeed(command, speed)
+//
+// Send the command that changes the tablet's speed, let it go
+// out at the old speed, then follow at the new speed and check
+// that the tablet still answers.
+//
+bool WacomTablet::ChangeLinkSpeed(const char *command, speed_t speed) {
+    if (!SendCommandToTablet(command, kSpeedChangeHold))
+        return false;
+
+    (void)serialPort.Drain();
+    commands.Wait();
+    serialPort.SetSpeed(speed);
+    (void)Flush();
+
+    for (int x=3; x--;) {
+        char *reply = RequestTabletIDModal();
+        if (reply[0] == '~' && reply[1] == '#')
+            return true;
+    }
+
+    return false;
+}
+
 
 //
 // InitStylus
@@ -1276,6 +1894,8 @@ void WacomTablet::InitStylus() {
 //  Simulate as if the pen were taken off the tablet
 //
 void WacomTablet::ResetStylus() {
+    PostSamples();                              // What came before the reset
+
     stylus.off_tablet   = true;
     stylus.pen_near     = false;
     stylus.eraser_flag  = false;
@@ -1312,22 +1932,23 @@ void WacomTablet::SendUDSetupString(char *setup, int bank, bool insist) {
     if (NULL != command) {
         // Import the settings to update to the intended state
         settings[bank].Import(command);
+        UpdateFramer();
+
+        // The governor's top rate is whatever was asked for
+        if (bank == 0)
+            full_interval = rate_interval = settings[0].interval;
 
         if (can_parse_ud_setup) {
             SendCommandToTablet(WAC_StopTablet);
             SendCommandToTablet(command);
-            (void)usleep(100000);   // 0.1 seconds
 
             // By default get the new settings from the tablet
-            if (insist) {
-                GetUDSettingsOrFail(bank);
-            }
-            //          else {
-            //              RequestUDSettings(bank);
-            //          }
-
+            // once it has taken them in. The setup's hold keeps
+            // both the request and the restart back until then.
+            if (insist)
+                QueueUDSettingsRequest(bank);
 
-            SendCommandToTablet(WAC_StartTablet);
+            requests.Add(WAC_StartTablet);
         }
 
         free(command);
@@ -1373,33 +1994,94 @@ void WacomTablet::RequestUDSettings(int bank) {
         SendCommandToTablet(getcoms[bank]);
 }
 
+//
+// QueueUDSettingsRequest(bank, delay)
+//
+// Ask for the settings without waiting around for them. The
+// framer passes the reply to ProcessCommandReply as usual, so
+// the stream keeps flowing while the tablet thinks it over.
+//
+void WacomTablet::QueueUDSettingsRequest(int bank, int delay_ms) {
+    if (can_parse_ud_setup)
+        (void)requests.Add(getcoms[bank], "~R", WacomTablet::UDSettingsCallback, this, 100, 15, delay_ms);
+}
+
+void WacomTablet::UDSettingsCallback(RequestStatus status, char *reply, void *info) {
+    WacomTablet *t = (WacomTablet*)info;
+    if (status == kRequestTimedOut && !t->quiet_mode)
+        fprintf(output, "[ERR ] The tablet didn't send its settings.\n");
+}
+
 #pragma mark -
 
 //
-// SendCommandToTablet
+// SendCommandToTablet(command, hold, callback, info)
 //
-// Send a command to the tablet and set the commandSent flag
-// if successful. The serial queue processor can use commandFlag
-// as an extra measure to distinguish command replies from
-// spurious data, though it shouldn't really be necessary.
+// Send a command to the tablet. While the stream is flowing the
+// command queue joins it with any others sent in the same pass
+// through the run loop. During initialization and modal requests
+// it's written before returning, since a reply is read next.
 //
-bool WacomTablet::SendCommandToTablet(const char *command) {
-    char com[100];
-    strcpy(com, command);
-
+// The hold is how long the tablet needs before the next command
+// can follow. By default it comes from CommandHold. The callback
+// is called when the command is out and the hold is over.
+//
+bool WacomTablet::SendCommandToTablet(const char *command, int hold_ms, TMCommandCallback cb, void *info) {
     if (strncmp("~R", command, 2) == 0)
-        bank_last_requested = (com[2] == '\r') ? 0 : (com[2] - '0');
+        bank_last_requested = (command[2] == '\r') ? 0 : (command[2] - '0');
 
-    int numBytes = serialPort.Write(com, (int)strlen(com));
+    if (hold_ms < 0)
+        hold_ms = CommandHold(command);
 
-    if (numBytes == kSerialError)
-        syslog(LOG_ERR, "SendCommandToTablet Error %d: %s.\n", errno, strerror(errno));
-    else {
-        if (!quiet_mode)
-            fprintf(output, "[SENT] \"%s\"\n", LogString(com));
-    }
+    bool streaming = serialSource.IsAttached() || serialReader.IsRunning();
+    bool result = (streaming && !doing_modal)
+                    ? commands.Send(command, hold_ms, cb, info)
+                    : commands.SendNow(command, hold_ms, cb, info);
 
-    return (numBytes >= (int)strlen(com));
+    if (!result)
+        syslog(LOG_ERR, "SendCommandToTablet couldn't send \"%s\".\n", LogString((char*)command));
+    else if (!quiet_mode)
+        fprintf(output, "[SENT] \"%s\"\n", LogString((char*)command));
+
+    return result;
+}
+
+//
+// CommandHold(command)
+//
+// How long the tablet needs to act on a command before it will
+// listen to the next one. A TabletPC keeps sending for a while
+// after it's told to stop, and UD tablets need a moment to take
+// in a new setup or a new speed.
+//
+int WacomTablet::CommandHold(const char *command) {
+    // TabletPC commands are one character, and may be sent
+    // before the model is known
+    if (command[0] != '\0' && command[1] == '\0')
+        return (strcmp(command, TPC_StopTablet) == 0) ? kTPCStopHold : 0;
+
+    if (strncmp(command, "~*", 2) == 0 || strncmp(command, "~W", 2) == 0)
+        return kSetupHold;
+
+    if (strncmp(command, "BA", 2) == 0)
+        return kSpeedChangeHold;
+
+    return 0;
+}
+
+//
+// CommandWriter
+// Called by the command queue after each write
+//
+void WacomTablet::CommandWriter(const char *bytes, int length, bool written, void *info) {
+    WacomTablet *t = (WacomTablet*)info;
+
+    if (written) {
+        t->ArmTailTimer();                      // In case the reply is short
+        t->watchdog.Sent(CFAbsoluteTimeGetCurrent());
+    }
+    else
+        syslog(LOG_ERR, "SendCommandToTablet Error %d: %s.\n", errno, strerror(errno));
 }
 
 //
@@ -1407,24 +2089,56 @@ bool WacomTablet::SendCommandToTablet(const char *command) {
 //
 // Sends a command and waits around for a reply
 // This is used on initialization as part of the startup test
+// A reply_size is given for binary replies, which aren't lines
+//
+// Once the tablet is running use the requests queue instead,
+// so the stream isn't held up.
 //
-int WacomTablet::SendRequestToTablet(const char *command) {
+int WacomTablet::SendRequestToTablet(const char *command, int reply_size) {
+    // The reply has to be read here, not by the reader thread
+    bool resume = serialReader.IsRunning();
+    if (resume) DetachSerialSource();
+
     doing_modal = true;
     int len = 0;
 
     clearstr(modalbuffer);
     if (SendCommandToTablet(command)) {
         // Get up to 1024 bytes allowing 0.1 seconds for a reply
-        len = serialPort.ReadLine(modalbuffer, 1024, 100000);
+        if (reply_size > 0) {
+            len = serialPort.ReadPacket(modalbuffer, reply_size, 100000);
+            modalbuffer[len] = '\0';
+        }
+        else
+            len = serialPort.ReadLine(modalbuffer, 1024, 100000);
 
         //      if (len > 0 && !quiet_mode)
         //          fprintf(output, "[RCVD] \"%s\"\n", LogString(modalbuffer));
     }
 
     doing_modal = false;
+
+    if (resume) UpdateSerialSource();
+
     return len;
 }
 
+//
+// RequestSender
+// Lets the requests queue send through SendCommandToTablet
+//
+bool WacomTablet::RequestSender(const char *command, void *info) {
+    return ((WacomTablet*)info)->SendCommandToTablet(command, -1, WacomTablet::RequestWritten, info);
+}
+
+//
+// RequestWritten
+// Starts the request's reply timer once the command is out
+//
+void WacomTablet::RequestWritten(bool written, void *info) {
+    ((WacomTablet*)info)->requests.Written(written);
+}
+
 bool WacomTablet::SendScaleToTablet(int h, int v) {
     bool result = true;
     char *command = NULL;
@@ -1438,17 +2152,46 @@ bool WacomTablet::SendScaleToTablet(int h, int v) {
 #pragma mark -
 
 //
-// TabletTimerCallback
+// SerialInputCallback
+//
+// Called from the Run Loop when serial data is waiting
 //
-void WacomTablet::TabletTimerCallback( CFRunLoopTimerRef timer, void *info ) {
-    //  static Boolean didInit = false;
+void WacomTablet::SerialInputCallback( int fd, void *info ) {
+    WacomTablet *t = (WacomTablet*)info;
+    if ( t->IsActive() && !t->AwaitingModalReply() )
+        t->ProcessSerialStream();
+}
+
+
+//
+// ReaderInputCallback
+//
+// Called from the Run Loop when the reader thread has queued data
+//
+void WacomTablet::ReaderInputCallback( int fd, void *info ) {
+    WacomTablet *t = (WacomTablet*)info;
+    t->serialReader.AcknowledgeNotify();
+    t->ProcessReaderChunks();
+
+    if (t->serialReader.HungUp()) {
+        if (!t->quiet_mode)
+            fprintf(output, "[PORT] Lost connection to %s\n", t->serialPort.Name());
+        t->DetachSerialSource();
+    }
+}
+
+
+//
+// QuitInputCallback
+//
+// Called from the Run Loop when a quit has been requested
+//
+void WacomTablet::QuitInputCallback( int fd, void *info ) {
+    char c[16];
+    while (read(fd, c, sizeof(c)) > 0) { }
+
     if (quitProcessor)
         CFRunLoopStop( CFRunLoopGetCurrent() );
-    else {
-        WacomTablet *t = (WacomTablet*)info;
-        if ( t->IsActive() && !t->AwaitingModalReply() )
-            t->ProcessSerialStream();
-    }
 }
 
 
@@ -1456,7 +2199,7 @@ void WacomTablet::TabletTimerCallback( CFRunLoopTimerRef timer, void *info ) {
 // EventTimerCallback
 //
 void WacomTablet::EventTimerCallback( CFRunLoopTimerRef timer, void *info ) {
-    ((WacomTablet*)info)->PostChangeEvents();
+    ((WacomTablet*)info)->PostSamples();
 }
 
 #pragma mark -
@@ -1511,187 +2254,205 @@ void WacomTablet::StreamTimerCallback( CFRunLoopTimerRef timer, void *info ) {
 // ProcessSerialStream
 //
 // Process whatever data is waiting on the serial port.
-// This method is periodically called from TabletTimerCallback.
+// This method is called from SerialInputCallback when the
+// port becomes readable, so the first read doesn't block.
 //
 // TODO: When switching settings that affect packet_size
 //  sometimes extra bytes come through and are interpreted
 //  as command replies. Fix this!
 //
 void WacomTablet::ProcessSerialStream() {
-    char p[64], r[128], buff[1000];
+    char buff[1001];                            // One spare byte for the framer
 
-    // Wait for input and time out after 3900 microseconds
-    int n = serialPort.Select(3900);
+    // With packet reads a blocking read waits for a whole packet,
+    // so only ask for what's there
+    int waiting = serialPort.PacketReads() ? serialPort.BytesOnPort() : 0;
 
-    if (n > 0) do {
-        clearstr(buff);
+    do {
+        int numBytes = serialPort.Read(buff, (waiting > 0 && waiting < 1000) ? waiting : 1000);
 
-        int numBytes = serialPort.Read(buff, 1000);
+        // Readable with nothing to read means the device went away.
+        // Stop watching it rather than spinning on the hangup.
+        if (numBytes == 0 || (numBytes < 0 && errno != EAGAIN && errno != EINTR)) {
+            if (!quiet_mode)
+                fprintf(output, "[PORT] Lost connection to %s\n", serialPort.Name());
+            serialSource.Detach();
+            break;
+        }
 
         if (numBytes > 0) {
-            if (send_stream)
-                byteCounter += numBytes;
-
-            int plen = 0,
-            rlen = 0;
-
-            for (int i=0; i<numBytes; i++) {
-                unsigned char s = (unsigned char)buff[i];
-
-                if (series_index == kModelFujitsuP) {
-                    if (s > 130) {
-                        plen = 0;
-                        p[plen++] = (s == 136) ? 1 : (s == 138) ? 2 : 0;
-                    } else {
-                        p[plen++] = s;
-                        if (plen == 5)
-                            ProcessPacket(p, plen);
-                    }
-                }
-                else {
+            streamReads++;
+            ProcessSerialBytes(buff, numBytes);
+        }
+
+    } while ((waiting = serialPort.BytesOnPort()) > 0);
+
+    ArmTailTimer();
+
+}
+
+
+//
+// ProcessReaderChunks
+//
+// Process everything the reader thread has queued so far
+//
+void WacomTablet::ProcessReaderChunks() {
+    TMSerialChunk *chunk;
+
+    while ((chunk = serialReader.NextChunk()) != NULL) {
+        ProcessSerialBytes(chunk->data, chunk->length);
+        serialReader.ReleaseChunk();
+    }
+}
+
+
+//
+// ProcessSerialBytes
+//
+// Split a run of bytes from the tablet into packets and
+// command replies and process them. The buffer must have
+// room for one more byte.
+//
+void WacomTablet::ProcessSerialBytes(char *buff, int numBytes) {
+    if (send_stream)
+        byteCounter += numBytes;
 
 #if LOG_STREAM_TO_FILE
-                    short b = ((short)s) & 0x00FF;
-                    if (logfile) fprintf(logfile, " %02X", b);
-                    //fprintf(logfile, " %02X [%c]", b, b >= 0x20 && b < 0x80 ? b : '.');
+    if (logfile) {
+        for (int i=0; i<numBytes; i++)
+            fprintf(logfile, " %02X", ((short)buff[i]) & 0x00FF);
+    }
 #endif
 
-                    // In binary mode the high bit indicates a new phrase
-                    // All Wacom IV modes are binary. II-S has an ASCII mode
-                    if (s & 0x80) {
-                        if (in_packet) {
-                            if (series_index == kModelTabletPC) {
-                                if (phrase_count == TPC_QUERY_REPLY_SIZE) {
-                                    ProcessTabletPCCommandReply(phrase);
-#if LOG_STREAM_TO_FILE
-                                    if (logfile) fprintf(logfile, " >R\n(%s)\n", HexString(phrase, phrase_count));
+    unsigned long dropped = framer.Dropped(), errors = framer.lineErrors;
+    framer.Feed(buff, numBytes);
+    WatchStream((int)(framer.Dropped() - dropped), (int)(framer.lineErrors - errors));
+
+    DecodeStagedPackets();
+
+#if !EVENT_TIMER_IS_SEPARATE
+    PostSamples();                              // Everything from this read at once
 #endif
-                                }
-                                else if (phrase_count == settings[0].packet_size) {
-                                    memcpy(p, phrase, phrase_count);
-                                    plen = phrase_count;
-                                }
+}
 
-                            } else {
 
-                                // Sanity check packets before processing. This is redundant, as
-                                // each processing function does its own sanity-checking.
-                                if (phrase_count == settings[0].packet_size) {
-                                    memcpy(p, phrase, phrase_count);
-                                    plen = phrase_count;
-                                }
-                            }
+//
+// UpdateFramer
+//
+// Select the framing machine for the current settings.
+// This is called when the tablet is initialized and after
+// anything that may change the settings (mainly replies),
+// so the stream itself never has to check.
+//
+void WacomTablet::UpdateFramer() {
+    FramerProtocol proto =
+        (series_index == kModelFujitsuP) ? kFramerFujitsu :
+        (series_index == kModelTabletPC) ? kFramerTabletPC : kFramerWacom;
 
-                        } else {
-                            // This is a hack for replies that don't end in CR
-                            // (Which should be rare or non-existent)
-                            memcpy(r, phrase, phrase_count);
-                            rlen = phrase_count;
-                        }
+    framer.Configure(proto, settings[0].packet_size,
+                     settings[0].command_set == kCommandSetWacomIIS /* && settings[0].output_format == kOutputFormatASCII */,
+                     !can_parse_ud_setup);
 
-                        // Prepare to start capturing the binary packet
-                        phrase_count = 0;
-                        in_packet = true;
-                    }
+    UpdateDecoder();
+    UpdateReadMode();
+}
 
-                    // Normalize line endings for ASCII packets
-                    if (!in_packet) {
-                        if (s == '\n') s = '\r';
-                        if (i < numBytes-1 && s=='\r' && (buff[i+1]=='\n' || buff[i+1]=='\r')) i++;
-                    }
+//
+// UpdateDecoder
+//
+// Select the packet decoder for the current tablet and settings,
+// along with the framer, so ProcessPacket makes a single call
+// instead of looking at the model, command set and ROM version
+// for every packet.
+//
+void WacomTablet::UpdateDecoder() {
+    iv_short_pressure = (base_version < 1.199);
 
-                    // Extend the phrase, ignore any leading newlines
-                    if (phrase_count || s != '\r')
-                        phrase[phrase_count++] = s;
-
-                    // Are we inside a binary packet?
-                    if (in_packet) {
-                        /* This block catches completed packets without having to wait for the next one.
-                         * Most tablets send an extra trailing packet when there has been no change, so
-                         * this was originally only intended to handle unusual UD tablet modes. It may
-                         * ultimately be redundant.
-                         */
-
-                        // TabletPC may return a normal 9 byte packet or an 11 byte Info reply.
-                        // Thus we can't assume the packet is complete after 9 bytes.
-                        if (series_index == kModelTabletPC) {
-                            if (phrase_count == TPC_QUERY_REPLY_SIZE) {
-                                ProcessTabletPCCommandReply(phrase);
-#if LOG_STREAM_TO_FILE
-                                if (logfile) fprintf(logfile, " >R\n(%s)\n", HexString(phrase, phrase_count));
-#endif
-                                in_packet = false;
-                                phrase_count = 0;
-                            }
-                        }
-                        else {
-                            // This sends a packet when it reaches the proper packet size
-                            // The assumption here is that a trailing packet could get lost
-                            if (phrase_count == settings[0].packet_size) {
-                                memcpy(p, phrase, phrase_count);
-                                plen = phrase_count;
-                                in_packet = false;
-                                phrase_count = 0;
-                            }
-                        }
-                    }
-                    else {
-                        // The 3rd comma marks the end of an SD tablet info string
-                        if (!can_parse_ud_setup && phrase_count > 4 && phrase[0] == '~' && s == ',' && ++comma_count == 3)
-                            s = '\r';
-
-                        // Then check for a newline, indicating the end of a line
-                        // in a potential packet
-                        if (s == '\r' && phrase_count > 0) {
-                            // If We're in II-S ASCII mode, process valid data packets
-                            if (settings[0].command_set == kCommandSetWacomIIS /* && settings[0].output_format == kOutputFormatASCII */) {
-                                if (phrase[1] == ',' && (phrase[0] == '#' || phrase[0] == '!' || phrase[0] == '*')) {
-                                    in_packet = false;
-                                    plen = phrase_count-1;
-                                    memcpy(p, phrase, plen);
-                                }
-                                else {
-                                    memcpy(r, phrase, phrase_count);
-                                    rlen = phrase_count;
-                                }
-                            }
-                            else {
-                                memcpy(r, phrase, phrase_count);
-                                rlen = phrase_count;
-                            }
+    switch (series_index) {
+        case kModelGraphire:
+        case kModelGraphire2:
+        case kModelGraphire3:
+            decoder = &WacomTablet::ProcessGraphire;
+            break;
 
-                            phrase_count = 0;
-                        }
-                    }
+        case kModelIntuos:
+        case kModelIntuos2:
+            decoder = &WacomTablet::ProcessWacomV;
+            break;
+
+        case kModelFujitsuP:
+            decoder = &WacomTablet::ProcessFujitsuPSeries;
+            break;
 
-                    if (plen) {
-                        comma_count = 0;
-                        p[plen] = '\0';
-                        ProcessPacket(p, plen);
-                        plen = 0;
+        default:
+            switch (settings[0].command_set) {
+                case kCommandSetWacomIIS:
+                    decoder = &WacomTablet::DecodeWacomIIS;
+                    break;
+
+                case kCommandSetWacomIV:
+                    if (base_version < 1.399)               // < "1.4" won't work due to fp precision (a hazard of fp!)
+                        decoder = &WacomTablet::DecodeWacomIV_13;
+                    else
+                        decoder = &WacomTablet::DecodeWacomIV_14;
+                    break;
+
+                case kCommandSetTabletPC:
+                    decoder = &WacomTablet::DecodeTabletPC;
+                    break;
+
+                case kCommandSetBitpadII:                   // (pending)
+                case kCommandSetMM1201:                     // (pending)
+                default:
+                    decoder = &WacomTablet::DecodeUnsupported;
+                    break;
+            }
+            break;
+    }
+}
+
+
+//
+// FramerCallback
+//
+// Receives each packet or reply found by the framer
+//
+void WacomTablet::FramerCallback(FrameKind kind, char *data, int length, void *info) {
+    WacomTablet *t = (WacomTablet*)info;
+
+    switch (kind) {
+        case kFramePacket:
+            t->streamPackets++;
+            if (t->watchdog.Recovering() && t->watchdog.Packet(CFAbsoluteTimeGetCurrent()) && !t->quiet_mode)
+                fprintf(output, "[SYNC] Stream recovered after %.0f ms\n", t->watchdog.lastRecovery);
+            if (t->series_index == kModelTabletPC && !t->send_stream)
+                t->StagePacket(data, length);
+            else
+                t->ProcessPacket(data, length);
+#if LOG_STREAM_TO_FILE
+            if (logfile) fprintf(logfile, "\n");
+#endif
+            break;
 
+        case kFrameReply:
+            t->ProcessCommandReply(data);
+            if (!t->requests.Match(data))
+                t->WatchReply();
 #if LOG_STREAM_TO_FILE
-                        if (logfile) fprintf(logfile, "\n");
+            if (logfile) fprintf(logfile, " >R\n(%s)\n", LogString(data));
 #endif
-                    }
-
-                    if (rlen) {
-                        comma_count = 0;
-                        r[rlen] = '\0';
-                        ProcessCommandReply(r);
-                        rlen = 0;
+            break;
 
+        case kFrameTabletPCReply:
+            t->ProcessTabletPCCommandReply(data);
+            if (!t->requests.Match(data))
+                t->WatchReply();
 #if LOG_STREAM_TO_FILE
-                        if (logfile) fprintf(logfile, " >R\n(%s)\n", LogString(r));
+            if (logfile) fprintf(logfile, " >R\n(%s)\n", HexString(data, length));
 #endif
-                    }
-
-                }
-            }
-        }
-
-    } while (serialPort.BytesOnPort());
-
+            break;
+    }
 }
 
 
@@ -1736,7 +2497,7 @@ void WacomTablet::ProcessCommandReply(char *response) {
             if (args.command)
                 SendMessageInfo(bank);
 
-            quitProcessor = test_mode;
+            if (test_mode) request_quit();
             break;
         }
 
@@ -1835,6 +2596,8 @@ void WacomTablet::ProcessCommandReply(char *response) {
             break;
         }
     }
+
+    UpdateFramer();
 }
 
 //
@@ -1868,6 +2631,8 @@ void WacomTablet::ProcessTabletPCCommandReply(char *packet) {
         settings[0].yscale = (SInt32)v;
         InitTabletBounds(0, 0, (SInt32)h-1, (SInt32)v-1);
     }
+
+    UpdateFramer();
 }
 
 //
@@ -1916,77 +2681,21 @@ void WacomTablet::ProcessCalCompCommandReply(char *response) {
         fprintf(output, "[INFO] got size from CalComp\n");
     }
 
+    UpdateFramer();
 }
 
 //
 // ProcessPacket(packet)
 //
-// Handle the data packet with the appropriate command protocol
-// If streaming is enabled then handle that too.
-// Also track Binary / ASCII mode and report it to the pane.
+// Handle the data packet with the decoder UpdateDecoder chose
+// for the command protocol. If streaming is enabled then handle
+// that too.
 //
 void WacomTablet::ProcessPacket(char *packet, int pack_size) {
     static bool bc = false, ot = false, pn = false, ef = false;
     static UInt16 bm1 = 0;
-    static SInt16 prev_bin = -1;
-    SInt16 bin_mode;
-
-    switch (series_index) {
-        case kModelGraphire:
-        case kModelGraphire2:
-        case kModelGraphire3:
-            ProcessGraphire(packet, pack_size);
-            break;
-
-        case kModelIntuos:
-        case kModelIntuos2:
-            ProcessWacomV(packet, pack_size);
-            break;
-
-        case kModelFujitsuP:
-            ProcessFujitsuPSeries(packet);
-            break;
-
-        default:
-            bin_mode = (packet[0] & 0x80) != 0;
-            if (bin_mode != prev_bin) {
-                settings[0].output_format = bin_mode ? kOutputFormatBinary : kOutputFormatASCII;
-                prev_bin = bin_mode;
-            }
-
-            switch (settings[0].command_set) {
-                case kCommandSetBitpadII:
-                    // (pending)
-                    break;
-
-                case kCommandSetMM1201:
-                    // (pending)
-                    break;
-
-                case kCommandSetWacomIIS:
-
-                    if (bin_mode)
-                        ProcessWacomIIS_Binary(packet, pack_size);
-                    else
-                        ProcessWacomIIS_ASCII(packet, pack_size);
-                    break;
-
-                case kCommandSetWacomIV:
-
-                    if (base_version < 1.399)                   // < "1.4" won't work due to fp precision (a hazard of fp!)
-                        ProcessWacomIV_13(packet, pack_size);
-                    else
-                        ProcessWacomIV_14(packet, pack_size);
-
-                    break;
 
-                case kCommandSetTabletPC:
-                    if (bin_mode)
-                        ProcessTabletPC(packet, pack_size);
-                    break;
-            }
-            break;
-    }
+    (this->*decoder)(packet, pack_size);
 
 
     //
@@ -2004,6 +2713,9 @@ void WacomTablet::ProcessPacket(char *packet, int pack_size) {
     if (!(stylus.button_mask & (kBitStylusTip|kBitStylusEraser)))
         stylus.pressure = 0;
 
+    if (govern_rate)
+        GovernReportRate();
+
     if (send_stream && stream_pause < 1) {
         packetCounter++;
 
@@ -2036,12 +2748,455 @@ void WacomTablet::ProcessPacket(char *packet, int pack_size) {
         }
     }
 
+    RecordSample();
+}
+
+//
+// TrackOutputFormat(packet)
+//
+// Note whether the packet is binary or ASCII, and report any
+// change through the active settings. Returns true for binary.
+//
+inline bool WacomTablet::TrackOutputFormat(char *packet) {
+    SInt16 bin = (packet[0] & 0x80) != 0;
+    if (bin != bin_mode) {
+        settings[0].output_format = bin ? kOutputFormatBinary : kOutputFormatASCII;
+        bin_mode = bin;
+    }
+    return bin;
+}
+
+//
+// Decoders for the protocols that share the Wacom framing.
+// UpdateDecoder picks one of these for each packet to go to.
+//
+void WacomTablet::DecodeWacomIIS(char *packet, int pack_size) {
+    if (TrackOutputFormat(packet))
+        ProcessWacomIIS_Binary(packet, pack_size);
+    else
+        ProcessWacomIIS_ASCII(packet, pack_size);
+}
+
+void WacomTablet::DecodeWacomIV_13(char *packet, int pack_size) {
+    (void)TrackOutputFormat(packet);
+    ProcessWacomIV_13(packet, pack_size);
+}
+
+void WacomTablet::DecodeWacomIV_14(char *packet, int pack_size) {
+    (void)TrackOutputFormat(packet);
+    ProcessWacomIV_14(packet, pack_size);
+}
+
+void WacomTablet::DecodeTabletPC(char *packet, int pack_size) {
+    if (TrackOutputFormat(packet))
+        ProcessTabletPC(packet, pack_size);
+}
+
+void WacomTablet::DecodeUnsupported(char *packet, int pack_size) {
+    (void)TrackOutputFormat(packet);
+}
+
+//
+// StagePacket(packet, size)
+//
+// TabletPC packets are set aside as the framer finds them and
+// decoded together once the read is done. They're always whole
+// and all alike, which is what the batch decoder wants. The
+// preference pane's packet stream still goes through
+// ProcessPacket, since it looks at each one.
+//
+void WacomTablet::StagePacket(char *packet, int pack_size) {
+    if (pack_size != 9) return;
+
+    memcpy(staged + staged_count * 9, packet, 9);
+    if (++staged_count == kMaxSamples)
+        DecodeStagedPackets();
+}
+
+//
+// DecodeStagedPackets
+//
+// Decode the staged packets straight into the samples, then
+// fill in what depends on the packet before: motion, and the
+// pressure only counting while the tip is down. The stylus is
+// left as the last packet has it, as ProcessTabletPC would.
+//
+void WacomTablet::DecodeStagedPackets() {
+    int n = staged_count;
+    if (n == 0) return;
+
+    staged_count = 0;
+
+    int at = samples.Reserve(n);
+    if (at < 0) {
+        PostSamples();
+        at = samples.Reserve(n);
+    }
+
+    TMBatchDecoder::TabletPC(staged, n, &samples, at);
+
+    CFAbsoluteTime  now = CFAbsoluteTimeGetCurrent();
+    SInt32          lastx = stylus.point.x, lasty = stylus.point.y, oldx = lastx, oldy = lasty;
+    bool            last_ot = stylus.off_tablet;
+
+    for (int i=at; i<at+n; i++) {
+        bool ot = (samples.flags[i] & kSampleOffTablet) != 0;
+
+        if (!(samples.buttons[i] & (kBitStylusTip|kBitStylusEraser)))
+            samples.pressure[i] = 0;
+
+        if (ot != last_ot)
+            samples.dx[i] = samples.dy[i] = 0;
+        else {
+            samples.dx[i] = samples.x[i] - lastx;
+            samples.dy[i] = samples.y[i] - lasty;
+        }
+
+        samples.tool[i] = kToolTypePen;
+        samples.time[i] = now;
+
+        oldx = lastx;   oldy = lasty;
+        lastx = samples.x[i];   lasty = samples.y[i];
+        last_ot = ot;
+    }
+
+    ApplySample(at + n - 1);
+    stylus.old.x = oldx;
+    stylus.old.y = oldy;
+
+    if (govern_rate)
+        GovernReportRate();
+
+    // Keep room for the next packet, as RecordSample does
+    if (samples.IsFull())
+        PostSamples();
+}
+
+//
+// RecordSample
+//
+// Write the stylus state left by the decoder straight into the
+// samples for this batch. A full buffer is posted at once, while
+// the stylus still matches its last sample, so there's always
+// room for the next one.
+//
+void WacomTablet::RecordSample() {
+    int i = samples.Reserve(1);
+
+    samples.x[i]        = stylus.point.x;
+    samples.y[i]        = stylus.point.y;
+    samples.dx[i]       = stylus.motion.x;
+    samples.dy[i]       = stylus.motion.y;
+    samples.pressure[i] = stylus.pressure;
+    samples.tiltX[i]    = stylus.tilt.x;
+    samples.tiltY[i]    = stylus.tilt.y;
+    samples.buttons[i]  = stylus.button_mask;
+    samples.tool[i]     = stylus.tool;
+    samples.flags[i]    = (stylus.off_tablet ? kSampleOffTablet : 0)
+                        | (stylus.pen_near ? kSamplePenNear : 0)
+                        | (stylus.eraser_flag ? kSampleEraser : 0);
+    samples.time[i]     = CFAbsoluteTimeGetCurrent();
+
+    if (samples.IsFull())
+        PostSamples();
+}
+
+//
+// ApplySample(index)
+// Set the stylus state from a waiting sample, ready for PostChangeEvents
+//
+void WacomTablet::ApplySample(int i) {
+    stylus.point.x      = samples.x[i];
+    stylus.point.y      = samples.y[i];
+    stylus.motion.x     = samples.dx[i];
+    stylus.motion.y     = samples.dy[i];
+    stylus.pressure     = samples.pressure[i];
+    stylus.tilt.x       = samples.tiltX[i];
+    stylus.tilt.y       = samples.tiltY[i];
+    stylus.tool         = samples.tool[i];
+    stylus.off_tablet   = (samples.flags[i] & kSampleOffTablet) != 0;
+    stylus.pen_near     = (samples.flags[i] & kSamplePenNear) != 0;
+    stylus.eraser_flag  = (samples.flags[i] & kSampleEraser) != 0;
+    SetButtons(samples.buttons[i]);
+}
+
+//
+// PostSamples
+//
+// Post the events for each sample waiting in the buffer, in
+// order. The last sample is the latest decoded state, so the
+// stylus ends up just as the decoders left it.
+//
+void WacomTablet::PostSamples() {
+    int count = samples.Count();
+
+    for (int i=0; i<count; i++) {
+        ApplySample(i);
+        PostChangeEvents();
+    }
+
+    samples.Taken();
+}
+
+//
+// GovernReportRate
+//
+// Let the governor see the latest packet and change the report
+// rate when it asks. Nothing is changed while a query is out,
+// since stopping the tablet could swallow the reply.
+//
+void WacomTablet::GovernReportRate() {
+    if (requests.IsBusy())
+        return;
+
+    bool drawing = (stylus.button_mask != 0);
+    bool near = stylus.pen_near || !stylus.off_tablet;
+
+    if (governor.Update(drawing, near, stylus.point.x, stylus.point.y, CFAbsoluteTimeGetCurrent()))
+        SendReportRate(governor.Level());
+
+    ArmGovernor();
+}
+
+//
+// ArmGovernor
+//
+// A TabletPC goes quiet when the pen leaves, so the governor
+// can't wait for a packet to drop the rate. Look again when the
+// level is next due to drop.
+//
+void WacomTablet::ArmGovernor() {
+    CFAbsoluteTime when = governor.Deadline();
+    if (when == 0)
+        when = 1.0e10;
+
+    if (governTimer == NULL) {
+        CFRunLoopTimerContext ctx = { 0, this, NULL, NULL, NULL };
+        governTimer = CFRunLoopTimerCreate(NULL, when, 1.0e10, 0, 0, WacomTablet::GovernorTimerCallback, &ctx);
+        CFRunLoopAddTimer(CFRunLoopGetCurrent(), governTimer, kCFRunLoopDefaultMode);
+    }
+    else
+        CFRunLoopTimerSetNextFireDate(governTimer, when);
+}
+
+void WacomTablet::GovernorTimerCallback( CFRunLoopTimerRef timer, void *info ) {
+    WacomTablet *t = (WacomTablet*)info;
+
+    if (!t->govern_rate || !t->IsActive())
+        return;
+
+    // Not while a query is out, as in GovernReportRate
+    if (t->requests.IsBusy() || t->AwaitingModalReply()) {
+        CFRunLoopTimerSetNextFireDate(timer, CFAbsoluteTimeGetCurrent() + kRateHoverDelay);
+        return;
+    }
+
+    if (t->governor.Tick(CFAbsoluteTimeGetCurrent()))
+        t->SendReportRate(t->governor.Level());
+
+    t->ArmGovernor();
+}
+
+//
+// SendReportRate(level)
+//
+// TabletPC digitizers take a one-character rate command.
+// UD tablets take IT, the report interval that is also a field
+// of the setup string, so the rate changes with one command and
+// without stopping the tablet. The interval is never shorter
+// than the one the tablet was set up with.
+//
+void WacomTablet::SendReportRate(RateLevel level) {
+    static const char *tpc_rates[kRateLevels] = { TPC_Sample133pps, TPC_Sample80pps, TPC_Sample40pps };
+    static const int ud_intervals[kRateLevels] = { 0, 2, 5 };
+
+    if (series_index == kModelTabletPC) {
+        SendCommandToTablet(tpc_rates[level]);
+        return;
+    }
+
+    int interval = (ud_intervals[level] > full_interval) ? ud_intervals[level] : full_interval;
+    if (interval == rate_interval)
+        return;
+
+    char command[16];
+    snprintf(command, sizeof(command), "IT%d\r", interval);
+    SendCommandToTablet(command);
+    rate_interval = interval;
+}
+
+
+#pragma mark -
+
+//
+// StartTablet / StopTablet
+//
+// With -F, or when it was found by listening, a TabletPC
+// is sending already, so it's left alone.
+//
+void WacomTablet::StartTablet() {
+    if (series_index != kModelTabletPC)
+        SendCommandToTablet(WAC_StartTablet);
+    else if (!args.forcepc && !listened)
+        SendCommandToTablet(TPC_Sample133pps);
+}
+
+void WacomTablet::StopTablet() {
+    if (series_index != kModelTabletPC)
+        SendCommandToTablet(WAC_StopTablet);
+    else if (!args.forcepc && !listened)
+        SendCommandToTablet(TPC_StopTablet);
+}
+
+//
+// WatchStream(dropped, errors)
+//
+// Called after each run of bytes is framed. Too many dropped
+// phrases calls for a resync, and a phrase left unfinished
+// gets looked at again once it's had time to complete.
+// Line errors are only counted and reported.
+//
+void WacomTablet::WatchStream(int dropped, int errors) {
+    double now = CFAbsoluteTimeGetCurrent();
+
+    if (watchdog.LineErrors(errors, now) && !quiet_mode)
+        fprintf(output, "[PORT] %lu framing or parity errors in one second (%lu packets dropped)\n", watchdog.errorsPerSecond, framer.corrupted);
+
+    StreamVerdict verdict = watchdog.Bytes(dropped, now);
+
+    if (verdict != kStreamOK) {
+        resync_reason = verdict;
+        ArmWatchdog(0);
+    }
+    else if (framer.Pending() && !watchdog_armed)
+        ArmWatchdog(watchdog.StallDeadline());
+    else if (framer.Holding() && !watchdog_armed)
+        ArmWatchdog(watchdog.HoldDeadline());
+}
+
+//
+// WatchReply
+// A reply that no request was waiting for
+//
+void WacomTablet::WatchReply() {
+    if (watchdog.Reply(CFAbsoluteTimeGetCurrent()) != kStreamOK) {
+        resync_reason = kStreamGarbled;
+        ArmWatchdog(0);
+    }
+}
+
+//
+// ArmWatchdog(when)
+//
+// Resyncs are done from the timer, not from the middle of
+// framing or reading. A time of 0 means as soon as possible.
+//
+void WacomTablet::ArmWatchdog(CFAbsoluteTime when) {
+    if (when == 0)
+        when = CFAbsoluteTimeGetCurrent();
+
+    if (watchdogTimer == NULL) {
+        CFRunLoopTimerContext ctx = { 0, this, NULL, NULL, NULL };
+        watchdogTimer = CFRunLoopTimerCreate(NULL, when, 1.0e10, 0, 0, WacomTablet::WatchdogTimerCallback, &ctx);
+        CFRunLoopAddTimer(CFRunLoopGetCurrent(), watchdogTimer, kCFRunLoopDefaultMode);
+    }
+    else
+        CFRunLoopTimerSetNextFireDate(watchdogTimer, when);
+
+    watchdog_armed = true;
+}
+
+void WacomTablet::WatchdogTimerCallback( CFRunLoopTimerRef timer, void *info ) {
+    WacomTablet *t = (WacomTablet*)info;
+    t->watchdog_armed = false;
+
+    if (t->resync_settling != kStreamOK) {
+        t->FinishResync();
+        return;
+    }
+
+    if (!t->IsActive() || t->AwaitingModalReply() || !(t->serialSource.IsAttached() || t->serialReader.IsRunning()))
+        return;
+
+    double now = CFAbsoluteTimeGetCurrent();
+    StreamVerdict verdict = t->resync_reason;
+    if (verdict == kStreamOK)
+        verdict = t->watchdog.Check(t->framer.Pending(), now);
+
+    if (verdict != kStreamOK)
+        t->ResyncStream(verdict);
+    else if (t->framer.Pending())
+        t->ArmWatchdog(now < t->watchdog.StallDeadline() ? t->watchdog.StallDeadline() : now + kStallTimeout);
+    else if (t->framer.Holding()) {
+        // The tablet went quiet after a whole packet. Unless a
+        // query reply may still be coming, it was just a packet.
+        if (now >= t->watchdog.HoldDeadline() && !t->requests.IsBusy()) {
+            t->framer.ReleaseHeld();
+            t->DecodeStagedPackets();
 #if !EVENT_TIMER_IS_SEPARATE
-    PostChangeEvents();
+            t->PostSamples();
 #endif
+        }
+        else
+            t->ArmWatchdog(now < t->watchdog.HoldDeadline() ? t->watchdog.HoldDeadline() : now + kHoldTimeout);
+    }
+}
+
+//
+// ResyncStream(why)
+//
+// Get back in step with the tablet without looking for it
+// all over again: stop it, throw away whatever is on the way,
+// forget the partial phrase and start it up again. The bytes
+// still on the way after the stop are given a moment on the
+// watchdog timer, so the run loop isn't held up, and then
+// FinishResync takes it from there. The time until the next
+// good packet is logged when it arrives.
+//
+void WacomTablet::ResyncStream(StreamVerdict why) {
+    if (!quiet_mode)
+        fprintf(output, "[SYNC] %s, resynchronizing\n", why == kStreamStalled ? "The stream stalled mid-packet" : "The stream is garbled");
+
+    DetachSerialSource();
+
+    StopTablet();
+    (void)serialPort.Drain();
+
+    resync_reason = kStreamOK;
+    resync_settling = why;
+    resync_started = TMTabletProbe::Milliseconds();
+    ArmWatchdog(CFAbsoluteTimeGetCurrent() + kResyncSettle);
+}
+
+//
+// FinishResync
+// The line has settled after the stop. Start the stream again.
+//
+void WacomTablet::FinishResync() {
+    StreamVerdict why = resync_settling;
+    resync_settling = kStreamOK;
+
+    if (!IsActive())
+        return;
+
+    (void)serialPort.Flush();
+    framer.Reset();
+    resync_reason = kStreamOK;              // Including anything the reader had queued
 
+    // Restart at the governed rate, if any
+    if (govern_rate && series_index == kModelTabletPC)
+        SendReportRate(governor.Level());
+    else
+        StartTablet();
+
+    watchdog.Resynced(why, CFAbsoluteTimeGetCurrent());
+    UpdateSerialSource();
+
+    if (!quiet_mode)
+        fprintf(output, "[SYNC] Restarted the stream in %.0f ms (%lu stalls, %lu garbled)\n", TMTabletProbe::Milliseconds() - resync_started, watchdog.stalls, watchdog.garbles);
 }
 
+
 //
 // PostChangeEvents
 //
@@ -2609,13 +3764,8 @@ void WacomTablet::ProcessWacomIIS_Binary(char *packet, int pack_size) {
     //
     // Get X/Y Coordinates (or motion)
     //
-    h =     ((UInt32)   (packet[0] & IIs_Mask0_X) << 14)
-    |   ((UInt32)   (packet[1] & IIs_Mask1_X) << 7)
-    |               (packet[2] & IIs_Mask2_X);
-
-    v =     ((UInt32)   (packet[3] & IIs_Mask3_Y) << 14)
-    |   ((UInt32)   (packet[4] & IIs_Mask4_Y) << 7)
-    |               (packet[5] & IIs_Mask5_Y);
+    h = TMField<IIs_FieldX>(packet);
+    v = TMField<IIs_FieldY>(packet);
 
     //
     // Relative Mode
@@ -2680,10 +3830,12 @@ void WacomTablet::ProcessWacomIIS_Binary(char *packet, int pack_size) {
             // 22 = high pressure
             // 00 = extra high pressure
 
+            // Compare with the last packet, which may not be posted yet
+            UInt16 last_raw = stylus.raw_pressure;
             stylus.raw_pressure = c;
             switch(c) {
                 case 0x00:
-                    if (oldStylus.raw_pressure == 0x22) {
+                    if (last_raw == 0x22) {
                         press = (UInt16)PRESSURE_SCALE;
                         stylus.raw_pressure = 0x22;
                     }
@@ -2823,7 +3975,12 @@ void WacomTablet::ProcessWacomIIS_ASCII(char *packet, int pack_size) {
     long    xx, yy;
     bool    ot = false;
 
-    if (packet[1] != ',' || sscanf(packet+2, "%ld,%ld,%d", &xx, &yy, &b) < 3)
+    if (pack_size < 2 || packet[1] != ',')
+        return;
+
+    // "#,xxxxx,yyyyy,bb"
+    TMScan scan(packet + 2, pack_size - 2);
+    if (!(scan.Decimal(&xx) && scan.Literal(',') && scan.Decimal(&yy) && scan.Literal(',') && scan.Decimal(&b)))
         return;
 
     //
@@ -2890,6 +4047,7 @@ void WacomTablet::ProcessWacomIIS_ASCII(char *packet, int pack_size) {
             case '#':
                 ot = (b == 99);
                 if (series_index == kModelSDSeries) {       // This is based on an SD420L with DIPs set to: 11110000 11000001 11111100
+                    UInt16 last_raw = stylus.raw_pressure;  // The last packet, which may not be posted yet
                     stylus.raw_pressure = b;
                     ot = ot || (b == 0x01);
                     stylus.pen_near = !ot;
@@ -2907,7 +4065,7 @@ void WacomTablet::ProcessWacomIIS_ASCII(char *packet, int pack_size) {
 
                         switch(b) {
                             case 0x00:
-                                if (oldStylus.raw_pressure == 0x02) {
+                                if (last_raw == 0x02) {
                                     press = (UInt16)PRESSURE_SCALE;
                                     stylus.raw_pressure = 0x02;
                                 }
@@ -3037,22 +4195,17 @@ void WacomTablet::ProcessWacomIV_Base(char *packet, int pack_size) {
         //      stylus.tool = (packet[0] & IV_Mask0_Stylus) ? kToolTypePen : kToolTypeMouse;
 
         // x , y
-        stylus.point.x =        ((short)    (packet[0] & IV_Mask0_X) << 14)
-        |   ((short)    (packet[1] & IV_Mask1_X) <<  7)
-        |               (packet[2] & IV_Mask2_X);
-
-        stylus.point.y =        ((short)    (packet[3] & IV_Mask3_Y) << 14)
-        |   ((short)    (packet[4] & IV_Mask4_Y) <<  7)
-        |               (packet[5] & IV_Mask5_Y);
+        stylus.point.x = TMField<IV_FieldX>(packet);
+        stylus.point.y = TMField<IV_FieldY>(packet);
 
         if (settings[0].origin == kOriginLL)
             stylus.point.y = settings[0].yscale - stylus.point.y;
 
         // pressure
-        if (base_version < 1.199)
-            press = (UInt16)((packet[6] & IV_Mask6_PressureLo) | (~packet[6] & IV_Mask6_PressureHi)) << 1;
+        if (iv_short_pressure)
+            press = TMField<IV_FieldPressureOld>(packet);
         else
-            press = ((packet[3] & IV_Mask3_Pressure0) >> 2) | ((packet[6] & IV_Mask6_PressureLo) << 1) | ((~packet[6] & IV_Mask6_PressureHi) << 1);
+            press = TMField<IV_FieldPressure>(packet);
 
         if (press > 0) press--;
     }
@@ -3096,8 +4249,8 @@ void WacomTablet::ProcessWacomIV_14(char *packet, int pack_size) {
     // Get Tilt
     //
     if (pack_size == 9) {
-        stylus.tilt.x = (SInt16)(((SInt16)(packet[7] & IV_Mask7_TiltX) - (SInt16)(packet[7] & IV_Mask7_TiltXBase)) * TILT_SCALE / 63);
-        stylus.tilt.y = (SInt16)(((SInt16)(packet[8] & IV_Mask8_TiltY) - (SInt16)(packet[8] & IV_Mask8_TiltYBase)) * TILT_SCALE / 63);
+        stylus.tilt.x = (SInt16)(TMField<IV_FieldTiltX>(packet) * TILT_SCALE / 63);
+        stylus.tilt.y = (SInt16)(TMField<IV_FieldTiltY>(packet) * TILT_SCALE / 63);
     }
     else
         stylus.tilt.x = stylus.tilt.y = 0;
@@ -3116,7 +4269,7 @@ void WacomTablet::ProcessWacomIV_13(char *packet, int pack_size) {
     //
     UInt16 bm = 0;
     if (/* stylus.pen_near && */ packet[0] & IV_Mask0_ButtonFlag) {
-        UInt8 b = ((packet[3] & IV_Mask3_Buttons) >> 3);    // IV button bits
+        UInt8 b = TMField<IV_FieldButtons>(packet);         // IV button bits
         bm = b & (kBitStylusTip|kBitStylusButton1);
 
         if (b & kBitStylusButton2) {                        // button 3 or eraser?
@@ -3164,15 +4317,8 @@ void WacomTablet::ProcessWacomV(char *packet, int pack_size) {
     // B & 1111:1100 == 1100:0000   (C0-C3)
     //
     if ((packet[0] & 0xFC) == 0xC0) {
-        stylus.toolid =     ((short)(packet[1] & V_Mask1_ToolHi) << 5)
-        |   ((short)(packet[2] & V_Mask2_ToolLo) >> 2);         // 04 50    0000:0100 0101:0000     0000:1001:0100      094
-
-        stylus.serialno = ((long)(packet[2] & V_Mask2_Serial) << 30)
-        | ((long)(packet[3] & V_Mask3_Serial) << 23)
-        | ((long)(packet[4] & V_Mask4_Serial) << 16)
-        | ((long)(packet[5] & V_Mask5_Serial) <<  9)
-        | ((long)(packet[6] & V_Mask6_Serial) <<  2)
-        | ((long)(packet[7] & V_Mask7_Serial) >>  5);
+        stylus.toolid = TMField<V_FieldToolID>(packet);     // 04 50    0000:0100 0101:0000     0000:1001:0100      094
+        stylus.serialno = TMField<V_FieldSerial>(packet);
 
         UInt16 tool = kToolTypePen;
         bool ef = false;
@@ -3260,26 +4406,17 @@ void WacomTablet::ProcessWacomV(char *packet, int pack_size) {
     // B & 1011:1110 == 1011:0100   (B4-B5 F4-F5) Stylus with wheel
     //
     else if ( (packet[0] & 0xB8) == 0xA0 || (packet[0] & 0xBE) == 0xB4 ) {
-        stylus.point.x =  ((UInt32)(packet[1] & V_Mask1_X) <<  9)
-        | ((UInt32)(packet[2] & V_Mask2_X) <<  2)
-        | ((UInt32)(packet[3] & V_Mask3_X) >>  5);
-
-        stylus.point.y =  ((UInt32)(packet[3] & V_Mask3_Y) << 11)
-        | ((UInt32)(packet[4] & V_Mask4_Y) <<  4)
-        | ((UInt32)(packet[5] & V_Mask5_Y) >>  3);
-
-        stylus.tilt.x = packet[7] & V_Mask7_TiltX;
-        if (packet[7] & V_Mask7_TiltXBase) stylus.tilt.x -= 0x40;
+        stylus.point.x = TMField<V_FieldX>(packet);
+        stylus.point.y = TMField<V_FieldY>(packet);
 
-        stylus.tilt.y = packet[8] & V_Mask8_TiltY;
-        if (packet[8] & V_Mask8_TiltYBase) stylus.tilt.y -= 0x40;
+        stylus.tilt.x = TMField<V_FieldTiltX>(packet);
+        stylus.tilt.y = TMField<V_FieldTiltY>(packet);
 
         //
         // Stylus with buttons + pressure
         //
         if ((packet[0] & 0xB8) == 0xA0) {
-            UInt16 op, press = op = ((short)(packet[5] & V_Mask5_PressureHi) << 7)
-            |  (short)(packet[6] & V_Mask6_PressureLo);
+            UInt16 op, press = op = TMField<V_FieldPressure>(packet);
 
             press = (press < 100) ? 0 : (UInt16)((press - 99) * PRESSURE_SCALE / 924.0);
 
@@ -3302,8 +4439,7 @@ void WacomTablet::ProcessWacomV(char *packet, int pack_size) {
             stylus.pressure = 0;
             bm = 0;
 
-            stylus.wheel =   ((short)(packet[5] & V_Mask5_WheelHi) << 7)
-            | (short)(packet[6] & V_Mask6_WheelLo);
+            stylus.wheel = TMField<V_FieldWheel>(packet);
 
 #if LOG_STREAM_TO_FILE
             if (logfile) fprintf(logfile, "    Airbrush X=%d Y=%d TX=%d TY=%d W=%d", stylus.point.x, stylus.point.y, stylus.tilt.x, stylus.tilt.y, stylus.wheel);
@@ -3318,16 +4454,10 @@ void WacomTablet::ProcessWacomV(char *packet, int pack_size) {
     // B & 1011:1110 == 1011:0000   (B0-B1 F0-F1)
     //
     else if ( (packet[0] & 0xBE) == 0xA8 || (packet[0] & 0xBE) == 0xB0 ) {
-        stylus.point.x =  ((UInt32)(packet[1] & V_Mask1_X) <<  9)
-        | ((UInt32)(packet[2] & V_Mask2_X) <<  2)
-        | ((UInt32)(packet[3] & V_Mask3_X) >>  5);
+        stylus.point.x = TMField<V_FieldX>(packet);
+        stylus.point.y = TMField<V_FieldY>(packet);
 
-        stylus.point.y =  ((UInt32)(packet[3] & V_Mask3_Y) << 11)
-        | ((UInt32)(packet[4] & V_Mask4_Y) <<  4)
-        | ((UInt32)(packet[5] & V_Mask5_Y) >>  3);
-
-        stylus.throttle = ((UInt32)(packet[5] & V_Mask5_ThrottleHi) << 7)
-        |  (UInt32)(packet[6] & V_Mask6_ThrottleLo);
+        stylus.throttle = TMField<V_FieldThrottle>(packet);
 
         if (packet[8] & V_Mask8_ThrottleSign) stylus.throttle = -stylus.throttle;
 
@@ -3337,7 +4467,7 @@ void WacomTablet::ProcessWacomV(char *packet, int pack_size) {
         // 4D Mouse
         //
         if (stylus.toolid == kToolMouse4D) {
-            bm = (((packet[8] & V_Mask8_4dButtonsHi) >> 1) | (packet[8] & V_Mask8_4dButtonsLo));
+            bm = TMField<V_Field4dButtons>(packet);
 
 #if LOG_STREAM_TO_FILE
             fprintf(logfile, "    4D Mouse (1) X=%d Y=%d T=%d", stylus.point.x, stylus.point.y, stylus.throttle);
@@ -3348,7 +4478,7 @@ void WacomTablet::ProcessWacomV(char *packet, int pack_size) {
         // Lens Cursor
         //
         else if (stylus.toolid == kToolLens) {
-            bm = packet[8] & V_Mask8_LensButtons;
+            bm = TMField<V_FieldLensButtons>(packet);
 
 #if LOG_STREAM_TO_FILE
             fprintf(logfile, "    Lens X=%d Y=%d T=%d", stylus.point.x, stylus.point.y, stylus.throttle);
@@ -3359,8 +4489,8 @@ void WacomTablet::ProcessWacomV(char *packet, int pack_size) {
         // 2D Mouse
         //
         else {
-            wheel = ((packet[8] & V_Mask8_WheelUp) >> 1) - (packet[8] & V_Mask8_WheelDown);
-            bm = (packet[8] & V_Mask8_2dButtons) >> 2;
+            wheel = TMField<V_Field2dWheel>(packet);
+            bm = TMField<V_Field2dButtons>(packet);
 
 #if LOG_STREAM_TO_FILE
             fprintf(logfile, "    2D Mouse X=%d Y=%d T=%d", stylus.point.x, stylus.point.y, stylus.throttle);
@@ -3391,19 +4521,13 @@ void WacomTablet::ProcessWacomV(char *packet, int pack_size) {
         // B & 1011:1110 == 1010:1010 (AA-AB EA-EB)
         //
         if ((packet[0] & 0xBE) == 0xAA) {
-            stylus.point.x =  ((UInt32)(packet[1] & V_Mask1_X) <<  9)
-            | ((UInt32)(packet[2] & V_Mask2_X) <<  2)
-            | ((UInt32)(packet[3] & V_Mask3_X) >>  5);
-
-            stylus.point.y =  ((UInt32)(packet[3] & V_Mask3_Y) << 11)
-            | ((UInt32)(packet[4] & V_Mask4_Y) <<  4)
-            | ((UInt32)(packet[5] & V_Mask5_Y) >>  3);
+            stylus.point.x = TMField<V_FieldX>(packet);
+            stylus.point.y = TMField<V_FieldY>(packet);
 
             //
             // 4D Mouse has Rotation
             //
-            SInt16 rot = ((short)(packet[6] & V_Mask6_4dRotationHi) << 7)
-            | (short)(packet[7] & V_Mask7_4dRotationLo);
+            SInt16 rot = TMField<V_FieldRotation>(packet);
 
             if (rot < 900) rot = -rot;
             else rot = 1799 - rot;
@@ -3540,13 +4664,8 @@ void WacomTablet::ProcessTabletPC(char *packet, int pack_size) {
     //
     // Get X/Y Coordinates
     //
-    stylus.point.x =    ((short)(packet[6] & TPC_Mask6_X) >> 5)
-    |   ((short) packet[2] << 2)
-    |   ((short) packet[1] << 9);
-
-    stylus.point.y =    ((short)(packet[6] & TPC_Mask6_Y) >> 3)
-    |   ((short) packet[4] << 2)
-    |   ((short) packet[3] << 9);
+    stylus.point.x = TMField<TPC_FieldX>(packet);
+    stylus.point.y = TMField<TPC_FieldY>(packet);
 
     //
     // Proximity
@@ -3567,7 +4686,7 @@ void WacomTablet::ProcessTabletPC(char *packet, int pack_size) {
         //
         stylus.eraser_flag = (packet[0] & TPC_Mask0_Eraser) != 0;
 
-        UInt16 press = ((UInt16)(packet[6] & TPC_Mask6_PressureHi) << 7) | (packet[5] & TPC_Mask5_PressureLo);
+        UInt16 press = TMField<TPC_FieldPressure>(packet);
         press = (press < 25) ? 0 : (UInt16)((press - 24) * PRESSURE_SCALE / 231.0);
         stylus.pressure = press;
 
@@ -3604,11 +4723,14 @@ void WacomTablet::ProcessFinepoint(char *packet, int pack_size) {
 
 
 //
-// ProcessFujitsuPSeries(packet)
+// ProcessFujitsuPSeries(packet, size)
 //
-void WacomTablet::ProcessFujitsuPSeries(char *packet) {
+void WacomTablet::ProcessFujitsuPSeries(char *packet, int pack_size) {
     bool    ot = false;
 
+    // The packet starts with a status byte
+    UInt8   status = ((UInt8)packet[0] == 136) ? 1 : ((UInt8)packet[0] == 138) ? 2 : 0;
+
     // Always assume the pen
     stylus.tool = kToolTypePen;
 
@@ -3626,7 +4748,7 @@ void WacomTablet::ProcessFujitsuPSeries(char *packet) {
      SInt32 x = 1024 * (((float)xint -  93) / 3940);
      SInt32 y =  768 * (((float)yint - 152) / 3848);
      */
-    float xdec = packet[1] + ((float)packet[0] / 128);
+    float xdec = packet[1] + ((float)status / 128);
     float ydec = packet[3] + ((float)packet[2] / 128);
 
     SInt32 x = (SInt32)(1024.0f * (xdec - 0.73f) / 30.78f);
@@ -3641,7 +4763,7 @@ void WacomTablet::ProcessFujitsuPSeries(char *packet) {
     stylus.point.y = y;
 
     stylus.pen_near = true;     // the pen is always "near" (move this to init?)
-    switch(packet[0]) {
+    switch(status) {
         case 1:     // button engaged
             SetButtons(kBitStylusTip);
             stylus.pressure = PRESSURE_SCALE;
@@ -3882,7 +5004,7 @@ CFDataRef WacomTablet::HandleMessage(CFMessagePortRef loc, SInt32 msgid, CFDataR
 
     }
 
-    char message_reply[100];
+    char message_reply[sizeof(out_message)];
 
     if (ismatch) {
         strcpy(message_reply, "[ok]");
@@ -3898,9 +5020,12 @@ CFDataRef WacomTablet::HandleMessage(CFMessagePortRef loc, SInt32 msgid, CFDataR
 
             case PREF_REINIT_PORT: {
                 SendUDSetupString(msgptr, 0, false);
+                commands.Wait();            // Out at the old settings first
+                (void)serialPort.Drain();
+                DetachSerialSource();
                 serialPort.ReInit(&settings[0]);
-                (void)usleep(100000);   // 0.1 seconds
-                if (can_parse_ud_setup) GetUDSettingsOrFail(0);
+                UpdateSerialSource();
+                QueueUDSettingsRequest(0, 100);
                 break;
             }
 
@@ -3933,7 +5058,7 @@ CFDataRef WacomTablet::HandleMessage(CFMessagePortRef loc, SInt32 msgid, CFDataR
                 strcpy(message_reply, GetMessageScale());
                 break;
             case PREF_QUIT:
-                quitProcessor = true;
+                request_quit();
                 break;
 
             case PREF_GET_MEMORY_BANK: {
@@ -3947,6 +5072,13 @@ CFDataRef WacomTablet::HandleMessage(CFMessagePortRef loc, SInt32 msgid, CFDataR
                 strcpy(message_reply, GetMessageSerialPort());
                 break;
 
+            case PREF_GET_READER_STATS: {
+                char group[16] = "";
+                (void)sscanf(msgptr, "%15s", group);
+                strcpy(message_reply, GetMessageReaderStats(group));
+                break;
+            }
+
                 //
                 // Raw data streaming, for the preference pane
                 //
@@ -3963,9 +5095,13 @@ CFDataRef WacomTablet::HandleMessage(CFMessagePortRef loc, SInt32 msgid, CFDataR
             case PREF_SEND_COMMAND:
                 SendCommandToTablet(msgptr);
                 break;
-            case PREF_SEND_REQUEST:
-                (void)SendRequestToTablet(msgptr);
+            case PREF_SEND_REQUEST: {
+                // Wacom replies start like the command, others are taken as they come
+                char prefix[3] = "";
+                if (msgptr[0] == '~') strncat(prefix, msgptr, 2);
+                (void)requests.Add(msgptr, prefix);
                 break;
+            }
 
             case PREF_SET_SETUP:
                 SendUDSetupString(msgptr);
@@ -4261,6 +5397,70 @@ char* WacomTablet::GetMessageSerialPort() {
     return out_message;
 }
 
+//
+// GetMessageReaderStats(group)
+//
+// Reply with one group of the stream counters as "[group] key=value ..."
+//
+//  reader   - the reader thread: bytes, chunks, dropped bytes, overflows,
+//             ring high water and max latency (us)
+//  requests - queries answered, timed out and failed, and the longest wait
+//  rate     - governor level changes and the seconds at each level
+//  reads    - packet reads, wakeups, packets and low latency mode
+//  line     - line errors, the error rate, corrupted packets and flushes
+//  commands - commands written, the writes they took and the hold time
+//  samples  - sample batches posted and the largest batch
+//
+// No group, or an empty one, is "reader".
+//
+char* WacomTablet::GetMessageReaderStats(const char *group) {
+    if (group == NULL || *group == '\0')
+        group = kReaderStats[0];
+
+    if (!strcmp(group, "reader"))
+        snprintf(out_message, sizeof(out_message), "[reader] thread=%d bytes=%llu chunks=%llu dropped=%llu overflows=%u highwater=%u latency=%u",
+                use_reader ? 1 : 0,
+                (unsigned long long)serialReader.BytesRead(),
+                (unsigned long long)serialReader.ChunksRead(),
+                (unsigned long long)serialReader.BytesDropped(),
+                serialReader.Overflows(), serialReader.HighWater(), serialReader.MaxLatency());
+
+    else if (!strcmp(group, "requests"))
+        snprintf(out_message, sizeof(out_message), "[requests] answered=%lu timeouts=%lu failures=%lu maxwait=%.0f",
+                requests.answered, requests.timeouts, requests.failures, requests.maxWait);
+
+    else if (!strcmp(group, "rate"))
+        snprintf(out_message, sizeof(out_message), "[rate] changes=%lu full=%.0f hover=%.0f idle=%.0f",
+                governor.changes, governor.secondsAt[kRateFull], governor.secondsAt[kRateHover], governor.secondsAt[kRateIdle]);
+
+    else if (!strcmp(group, "reads")) {
+        // Reads per packet, which packet reads (-P) should bring close to 1 or less
+        unsigned long wakeups = use_reader ? (unsigned long)serialReader.ChunksRead() : streamReads;
+        float per_packet = streamPackets ? (float)wakeups / streamPackets : 0;
+
+        snprintf(out_message, sizeof(out_message), "[reads] packetreads=%d wakeups=%lu packets=%lu perpacket=%.2f lowlatency=%d",
+                serialPort.PacketReads(), wakeups, streamPackets, per_packet, serialPort.LowLatency() ? 1 : 0);
+    }
+
+    else if (!strcmp(group, "line"))
+        snprintf(out_message, sizeof(out_message), "[line] errors=%lu persecond=%lu corrupted=%lu flushed=%lu flushtimeouts=%lu",
+                watchdog.lineErrors, watchdog.errorsPerSecond, framer.corrupted,
+                serialPort.flushedBytes, serialPort.flushTimeouts);
+
+    else if (!strcmp(group, "commands"))
+        snprintf(out_message, sizeof(out_message), "[commands] commands=%lu writes=%lu held=%.0f",
+                commands.commands, commands.writes, commands.paced);
+
+    else if (!strcmp(group, "samples"))
+        snprintf(out_message, sizeof(out_message), "[samples] batches=%lu maxbatch=%d",
+                samples.batches, samples.maxBatch);
+
+    else
+        snprintf(out_message, sizeof(out_message), "[nostats] %s", group);
+
+    return out_message;
+}
+
 
 #pragma mark - Utility Functions
 
@@ -4357,14 +5557,6 @@ bool GetFloatArgument(char *arg, int flag, float *dest) {
     return true;
 }
 
-//
-// ShortSleep
-//
-void ShortSleep() {
-    struct timespec rqtp = { 0, 50000000 };
-    nanosleep(&rqtp, NULL);
-}
-
 //
 // ReadablePacket
 //
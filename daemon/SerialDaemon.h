@@ -27,6 +27,18 @@
 
 #include "TabletSettings.h"
 #include "TMSerialPort.h"
+#include "TMInputSource.h"
+#include "TMSerialReader.h"
+#include "TMPacketFramer.h"
+#include "TMConnectionCache.h"
+#include "TMRequestQueue.h"
+#include "TMCommandQueue.h"
+#include "TMSampleBuffer.h"
+#include "TMBatchDecoder.h"
+#include "TMRateGovernor.h"
+#include "TMStreamWatchdog.h"
+#include "TMPortMonitor.h"
+#include "TMBaudDetector.h"
 
 //
 // Wacom.h is a very sparse header provided by Wacom.
@@ -41,6 +53,16 @@
 
 #define kNumRetries             3
 
+// Command holds (ms), the time a tablet needs before the next command
+#define kSetupHold              50      //!< UD tablets taking in a new setup
+#define kSpeedChangeHold        100     //!< Switching to a new line speed
+#define kTPCStopHold            100     //!< A TabletPC finishing its last packets
+
+// Picking up a port that was unplugged and came back (seconds)
+#define kReturnSettle           0.5     //!< Quiet after the last event for the port
+#define kReturnRetry            1.0     //!< Between tries of the last connection
+#define kReturnTries            3       //!< Tries of the last connection before a full scan
+
 
 //! Command-line options
 typedef struct init_arguments {
@@ -54,6 +76,12 @@ typedef struct init_arguments {
     bool    startoff;   //!< start up in disabled mode
     bool    quit;       //!< quit after testing the connection
     bool    logging;    //!< redirect output to a log file
+    bool    threaded;   //!< read the serial port on its own thread
+    bool    keepspeed;  //!< don't raise the line speed after detection
+    bool    adaptive;   //!< lower the report rate while the pen isn't drawing
+    bool    packetreads;//!< have the kernel wake us once per packet
+    bool    lowlatency; //!< ask the serial driver not to hold bytes back
+    bool    rescan;     //!< ignore the last known connection and scan all ports
     char    *port;      //!< the serial port to connect to (null = Automatic)
     char    *init;      //!< initial setup string to send to the tablet
     char    *digi;      //!< digitizer string, if any
@@ -106,6 +134,11 @@ typedef struct {
 
 #pragma mark -
 
+class WacomTablet;
+
+//! A member that decodes one data packet
+typedef void (WacomTablet::*PacketDecoder)(char *pkt, int size);
+
 class WacomTablet {
 
 private:
@@ -144,17 +177,49 @@ private:
 
     StylusState     stylus;             //!< The state of the (single) stylus
     StylusState     oldStylus;          //!< A mirrored state used to track changes
+    TMSampleBuffer  samples;            //!< Decoded samples waiting to be posted
+    char            staged[kMaxSamples * 9]; //!< TabletPC packets from this read, to decode together
+    int             staged_count;       //!< Packets in staged
     bool            buttonState[kSystemClickTypes];     //!< The state of all the system-level buttons
     bool            oldButtonState[kSystemClickTypes];  //!< The previous state of all system-level buttons
 
     TMSerialPort    serialPort;         //!< The serial port instance associated with this tablet
-
-    char            phrase[100];        //!< A single "phrase" of the tablet stream, with room to spare
-    int             phrase_count;       //!< length of the phrase so far
-    int             comma_count;        //!< comma counting for model replies of certain tablets
+    TMInputSource   serialSource;       //!< Wakes the run loop when serial data arrives
+    TMInputSource   quitSource;         //!< Wakes the run loop when a quit is requested
+    TMSerialReader  serialReader;       //!< Optional reader thread feeding the stream processor
+    bool            use_reader;         //!< If set, serial input comes through serialReader
+    CFRunLoopTimerRef tailTimer;        //!< Picks up partial packets when using packet reads
+    unsigned long   streamReads;        //!< Reads that returned stream data
+    unsigned long   streamPackets;      //!< Packets found in the stream
+
+    TMPacketFramer  framer;             //!< Splits the stream into packets and replies
+    PacketDecoder   decoder;            //!< Where ProcessPacket sends each packet, set by UpdateDecoder
+    SInt16          bin_mode;           //!< The last packet was binary (1) or ASCII (0), or none yet (-1)
+    bool            iv_short_pressure;  //!< A Wacom IV ROM before 1.2, with one less bit of pressure
+    TMRequestQueue  requests;           //!< Queries answered through the framer, without blocking
+    TMCommandQueue  commands;           //!< Joins and paces the commands written to the tablet
+    TMRateGovernor  governor;           //!< Picks the report rate from pen activity
+    bool            govern_rate;        //!< The governor is in use for this tablet
+    CFRunLoopTimerRef governTimer;      //!< Lets the rate drop when the packets stop
+    int             full_interval;      //!< The UD report interval to use while drawing
+    int             rate_interval;      //!< The UD report interval last sent by the governor
+    TMStreamWatchdog watchdog;          //!< Notices a stalled or garbled stream
+    CFRunLoopTimerRef watchdogTimer;    //!< Looks again when a phrase is left unfinished
+    bool            watchdog_armed;     //!< The watchdog timer is due to fire
+    StreamVerdict   resync_reason;      //!< Why the next watchdog check should resync
+    StreamVerdict   resync_settling;    //!< A resync waiting for the line to settle, and why
+    double          resync_started;     //!< When it began (ms), for the log
+    TMPortMonitor   portMonitor;        //!< Notices the port being unplugged and coming back
+    char            unplugged_port[MAXPATHLEN]; //!< The port to reconnect to when it returns
+    CFRunLoopTimerRef returnTimer;      //!< Tries the returned port once its events settle
+    int             return_tries;       //!< Tries since the port came back
+    TMConnectionCache lastConnection;   //!< The last connection that worked
+    bool            resuming;           //!< Initializing from lastConnection instead of querying
+    bool            listened;           //!< Found by listening to its stream, so it isn't asked anything
+    int             initialized_model;  //!< The model InitializeTablet succeeded with
     char            buffer[1024];       //!< Buffer for the raw stream, with room to spare
     char            modalbuffer[1024];  //!< Buffer for the raw stream when awaiting modal replies
-    char            out_message[200];   //!< A buffer for composing messages sent to the pref pane
+    char            out_message[400];   //!< A buffer for composing messages sent to the pref pane
 
     int             commandSent;        //!< Flag if we are waiting for a command result
 
@@ -164,8 +229,6 @@ private:
     bool            test_mode;          //!< If set, quit after initial connection
     bool            quiet_mode;         //!< If set, don't print any messages
 
-    bool            in_packet;          //!< Set when a packet start bit is detected
-
     CGRect          tabletMapping;      //!< The active area of the tablet
     CGRect          screenMapping;      //!< The corresponding active area of the screen
 
@@ -180,12 +243,25 @@ public:
     void            InitStylus();
     void            ResetStylus();
     bool            FindTabletOnPort(char *port_name=NULL);
+    bool            ProbePortsAtOnce(char *port_name, int *models_to_try);
+    bool            ScanPortsInTurn(char *port_name, int *models_to_try);
+    bool            ListenPortsInTurn(char *port_name);
+    bool            ResumeLastConnection(char *port_name);
+    void            SaveLastConnection();
     bool            InitializeTablet(int try_tablet_model=kModelUnknown);
-    bool            SendCommandToTablet(const char *command);
-    int             SendRequestToTablet(const char *command);
+    bool            RaiseLinkSpeed(bool ud_setup);
+    bool            ChangeLinkSpeed(const char *command, speed_t speed);
+    bool            SendCommandToTablet(const char *command, int hold_ms=-1, TMCommandCallback cb=NULL, void *info=NULL);
+    int             CommandHold(const char *command);
+    static void     CommandWriter(const char *bytes, int length, bool written, void *info);
+    int             SendRequestToTablet(const char *command, int reply_size=0);
+    static bool     RequestSender(const char *command, void *info);
+    static void     RequestWritten(bool written, void *info);
 
     void            SendUDSetupString(char *setup, int bank=0, bool insist=true);
     void            RequestUDSettings(int bank=0);
+    void            QueueUDSettingsRequest(int bank=0, int delay_ms=0);
+    static void     UDSettingsCallback(RequestStatus status, char *reply, void *info);
     char*           GetUDSettings(int bank=0);
     bool            GetUDSettingsOrFail(int bank=0);
 
@@ -212,14 +288,37 @@ public:
     char*           RequestCalCompMaxCoordinatesModal(){ SendRequestToTablet(CAL_TabletSize); return modalbuffer; }
 
     void            RunEventLoop();
-    static void     TabletTimerCallback( CFRunLoopTimerRef timer, void *info );
+    void            UpdateSerialSource();
+    void            DetachSerialSource();
+    void            UpdateReadMode();
+    void            ArmTailTimer();
+    static void     TailTimerCallback( CFRunLoopTimerRef timer, void *info );
+    static void     SerialInputCallback( int fd, void *info );
+    static void     ReaderInputCallback( int fd, void *info );
+    static void     QuitInputCallback( int fd, void *info );
     static void     EventTimerCallback( CFRunLoopTimerRef timer, void *info );
 
     void            SetStreamLogging(bool do_stream);
     static void     StreamTimerCallback( CFRunLoopTimerRef timer, void *info );
 
     void            ProcessSerialStream();
+    void            ProcessReaderChunks();
+    void            ProcessSerialBytes(char *buff, int numBytes);
+    void            UpdateFramer();
+    void            UpdateDecoder();
+    bool            TrackOutputFormat(char *pkt);
+    void            DecodeWacomIIS(char *pkt, int size);
+    void            DecodeWacomIV_13(char *pkt, int size);
+    void            DecodeWacomIV_14(char *pkt, int size);
+    void            DecodeTabletPC(char *pkt, int size);
+    void            DecodeUnsupported(char *pkt, int size);
+    static void     FramerCallback(FrameKind kind, char *data, int length, void *info);
     void            ProcessPacket(char *pkt, int size);
+    void            RecordSample();
+    void            StagePacket(char *pkt, int size);
+    void            DecodeStagedPackets();
+    void            ApplySample(int i);
+    void            PostSamples();
     void            ProcessCommandReply(char *response);
     void            ProcessTabletPCCommandReply(char *response);
     void            ProcessCalCompCommandReply(char *response);
@@ -233,7 +332,28 @@ public:
     void            ProcessGraphire(char *pkt, int size);
     void            ProcessTabletPC(char *pkt, int size);
     void            ProcessFinepoint(char *pkt, int size);
-    void            ProcessFujitsuPSeries(char *pkt);
+    void            ProcessFujitsuPSeries(char *pkt, int size);
+
+    void            GovernReportRate();
+    void            ArmGovernor();
+    static void     GovernorTimerCallback( CFRunLoopTimerRef timer, void *info );
+    void            SendReportRate(RateLevel level);
+
+    void            StartTablet();
+    void            StopTablet();
+    void            WatchStream(int dropped, int errors);
+    void            WatchReply();
+    void            ArmWatchdog(CFAbsoluteTime when);
+    static void     WatchdogTimerCallback( CFRunLoopTimerRef timer, void *info );
+    void            ResyncStream(StreamVerdict why);
+    void            FinishResync();
+
+    void            StartPortMonitor();
+    static void     PortEventCallback(PortEvent event, const char *path, void *info);
+    void            PortRemoved();
+    void            PortReturned();
+    void            ArmReturn(CFTimeInterval delay);
+    static void     ReturnTimerCallback( CFRunLoopTimerRef timer, void *info );
 
     void            PostChangeEvents();
     void            PostNXEvent(int eventType, SInt16 eventSubType, UInt8 otherButton=0);
@@ -284,6 +404,7 @@ public:
     char*           GetMessageGeometry();
     char*           GetMessageStream();
     char*           GetMessageSerialPort();
+    char*           GetMessageReaderStats(const char *group=NULL);
 
     // Commands - As sent by the PreferencePane
     void            SetProcessing(bool ena) { tablet_on = ena; }
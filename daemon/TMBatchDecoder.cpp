@@ -0,0 +1,224 @@
+/**
+ * TMBatchDecoder.cpp
+ *
+ * TabletMagicDaemon
+ * Thinkyhead Software
+ *
+ * This program is a component of TabletMagic. See the
+ * accompanying documentation for more details about the
+ * TabletMagic project.
+ *
+ * LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include "TMBatchDecoder.h"
+#include "TMPacketLayout.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define BATCH_SSE2  1
+#endif
+
+#define kPressureScale  65535.0         //!< As PRESSURE_SCALE in the daemon
+
+#if BATCH_SSE2
+
+//
+// Eight 16-bit lanes, one per packet
+//
+typedef __m128i Lanes;
+static inline Lanes LanesSplat(int n)               { return _mm_set1_epi16((short)n); }
+static inline Lanes LanesAnd(Lanes a, Lanes b)      { return _mm_and_si128(a, b); }
+static inline Lanes LanesOr(Lanes a, Lanes b)       { return _mm_or_si128(a, b); }
+static inline Lanes LanesXor(Lanes a, Lanes b)      { return _mm_xor_si128(a, b); }
+template <int N> static inline Lanes LanesLeft(Lanes a)  { return _mm_slli_epi16(a, N); }
+template <int N> static inline Lanes LanesRight(Lanes a) { return _mm_srli_epi16(a, N); }
+
+//
+// SliceLanes<byte, mask, shift, invert>(rows)
+// One slice of a field for eight packets. Row k holds byte k of each.
+//
+template <int Byte, int Mask, int Shift, int Invert>
+static inline Lanes SliceLanes(const Lanes *rows) {
+    Lanes bits = LanesAnd(Invert ? LanesXor(rows[Byte], LanesSplat(Invert)) : rows[Byte], LanesSplat(Mask));
+    return (Shift >= 0) ? LanesLeft<(Shift >= 0 ? Shift : 0)>(bits) : LanesRight<(Shift < 0 ? -Shift : 1)>(bits);
+}
+
+//
+// FieldLanes<field, index>::Get(rows)
+// The vector twin of TMFieldSlices, for unsigned fields of 16 bits or less
+//
+template <const TMBitField &F, int I>
+struct FieldLanes {
+    static inline Lanes Get(const Lanes *rows) {
+        return LanesOr(SliceLanes<F.slice[I].byte, F.slice[I].mask, F.slice[I].shift, F.slice[I].invert>(rows),
+                       FieldLanes<F, I - 1>::Get(rows));
+    }
+};
+
+template <const TMBitField &F>
+struct FieldLanes<F, 0> {
+    static inline Lanes Get(const Lanes *rows) {
+        return SliceLanes<F.slice[0].byte, F.slice[0].mask, F.slice[0].shift, F.slice[0].invert>(rows);
+    }
+};
+
+template <const TMBitField &F>
+static inline Lanes FieldOfLanes(const Lanes *rows) {
+    static_assert(F.signMask == 0, "Signed fields don't fit in unsigned lanes");
+    return FieldLanes<F, F.count - 1>::Get(rows);
+}
+
+#endif
+
+const char* TMBatchDecoder::Engine() {
+#if BATCH_SSE2
+    return "SSE2";
+#else
+    return "scalar";
+#endif
+}
+
+//
+// TabletPCPressure(raw)
+// The scaled pressure for each raw TabletPC value, worked out once
+//
+static inline UInt16 TabletPCPressure(int raw) {
+    static UInt16   table[256];
+    static bool     ready = false;
+
+    if (!ready) {
+        for (int i=0; i<256; i++)
+            table[i] = (i < 25) ? 0 : (UInt16)((i - 24) * kPressureScale / 231.0);
+        ready = true;
+    }
+
+    return table[raw & 0xFF];
+}
+
+//
+// TabletPCFinish(out, i, status, raw pressure)
+//
+// The parts of a TabletPC packet that hang on the status byte,
+// just as ProcessTabletPC has them
+//
+static inline void TabletPCFinish(TMSampleBuffer *out, int i, UInt8 status, int raw) {
+    out->tiltX[i] = out->tiltY[i] = 0;
+
+    if ((status & TPC_Mask0_Proximity) == 0) {
+        out->pressure[i] = 0;
+        out->buttons[i] = 0;
+        out->flags[i] = kSampleOffTablet;
+        return;
+    }
+
+    bool    eraser = (status & TPC_Mask0_Eraser) != 0;
+    UInt16  press = TabletPCPressure(raw);
+    UInt16  bm = 0;
+
+    if (press)
+        bm = (status & TPC_Mask0_Touch) ? kBitStylusTip : 0;
+
+    if (!eraser)
+        bm |= ((status & TPC_Mask0_Switch1) ? kBitStylusButton1 : 0)
+            | ((status & TPC_Mask0_Switch2) ? kBitStylusButton2 : 0);
+
+    out->pressure[i] = press;
+    out->buttons[i] = bm;
+    out->flags[i] = kSamplePenNear | (eraser ? kSampleEraser : 0);
+}
+
+//
+// TabletPCScalar(packets, count, out, at)
+//
+// Decode count 9-byte TabletPC packets one at a time, into the
+// samples starting at index at. This is the fallback, and the
+// yardstick for the vector version.
+//
+void TMBatchDecoder::TabletPCScalar(const char *packets, int count, TMSampleBuffer *out, int at) {
+    const UInt8 *p = (const UInt8*)packets;
+
+    for (int n=0; n<count; n++, p+=9) {
+        int i = at + n;
+
+        out->x[i] = (SInt32)TMField<TPC_FieldX>(p);
+        out->y[i] = (SInt32)TMField<TPC_FieldY>(p);
+
+        TabletPCFinish(out, i, p[0], (int)TMField<TPC_FieldPressure>(p));
+    }
+}
+
+//
+// TabletPC(packets, count, out, at)
+//
+// Decode count 9-byte TabletPC packets into the samples starting
+// at index at. Only the first seven bytes of a packet carry data,
+// so eight bytes from each one make a neat 8x8 block.
+//
+void TMBatchDecoder::TabletPC(const char *packets, int count, TMSampleBuffer *out, int at) {
+    const UInt8 *p = (const UInt8*)packets;
+    int         n = 0;
+
+#if BATCH_SSE2
+
+    const __m128i zero = _mm_setzero_si128();
+
+    for (; n + 8 <= count; n += 8, p += 72) {
+        // Turn the block on its side: row k gets byte k of all eight
+        __m128i s0 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(p)),      _mm_loadl_epi64((const __m128i*)(p + 9)));
+        __m128i s1 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(p + 18)), _mm_loadl_epi64((const __m128i*)(p + 27)));
+        __m128i s2 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(p + 36)), _mm_loadl_epi64((const __m128i*)(p + 45)));
+        __m128i s3 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(p + 54)), _mm_loadl_epi64((const __m128i*)(p + 63)));
+
+        __m128i t0 = _mm_unpacklo_epi16(s0, s1), t1 = _mm_unpackhi_epi16(s0, s1);
+        __m128i t2 = _mm_unpacklo_epi16(s2, s3), t3 = _mm_unpackhi_epi16(s2, s3);
+
+        __m128i u0 = _mm_unpacklo_epi32(t0, t2);        // Bytes 0 and 1
+        __m128i u1 = _mm_unpackhi_epi32(t0, t2);        // Bytes 2 and 3
+        __m128i u2 = _mm_unpacklo_epi32(t1, t3);        // Bytes 4 and 5
+        __m128i u3 = _mm_unpackhi_epi32(t1, t3);        // Bytes 6 and 7
+
+        // Widen to 16 bits, which holds every field
+        __m128i b[7];
+        b[0] = _mm_unpacklo_epi8(u0, zero), b[1] = _mm_unpackhi_epi8(u0, zero);
+        b[2] = _mm_unpacklo_epi8(u1, zero), b[3] = _mm_unpackhi_epi8(u1, zero);
+        b[4] = _mm_unpacklo_epi8(u2, zero), b[5] = _mm_unpackhi_epi8(u2, zero);
+        b[6] = _mm_unpacklo_epi8(u3, zero);
+
+        __m128i x = FieldOfLanes<TPC_FieldX>(b);
+        __m128i y = FieldOfLanes<TPC_FieldY>(b);
+        __m128i press = FieldOfLanes<TPC_FieldPressure>(b);
+
+        int i = at + n;
+        _mm_storeu_si128((__m128i*)&out->x[i],     _mm_unpacklo_epi16(x, zero));
+        _mm_storeu_si128((__m128i*)&out->x[i + 4], _mm_unpackhi_epi16(x, zero));
+        _mm_storeu_si128((__m128i*)&out->y[i],     _mm_unpacklo_epi16(y, zero));
+        _mm_storeu_si128((__m128i*)&out->y[i + 4], _mm_unpackhi_epi16(y, zero));
+
+        UInt16 raw[8];
+        _mm_storeu_si128((__m128i*)raw, press);
+
+        for (int k=0; k<8; k++)
+            TabletPCFinish(out, i + k, p[9 * k], raw[k]);
+    }
+
+#endif
+
+    if (n < count)
+        TabletPCScalar((const char*)p, count - n, out, at + n);
+}
@@ -0,0 +1,64 @@
+/**
+ * TMBatchDecoder.h
+ *
+ * TabletMagicDaemon
+ * Thinkyhead Software
+ *
+ * This program is a component of TabletMagic. See the
+ * accompanying documentation for more details about the
+ * TabletMagic project.
+ *
+ * LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef __TMBATCHDECODER_H__
+#define __TMBATCHDECODER_H__
+
+#include "TMSampleBuffer.h"
+
+//===================================================================
+//
+//  TMBatchDecoder
+//
+//  Decodes a run of whole packets at once, straight into the
+//  sample arrays. A USB-serial adapter tends to deliver a burst
+//  of packets per read, and those can be taken apart together.
+//
+//  The bit fields are pulled out eight packets at a time with
+//  SSE2 when the compiler offers it. The bytes of the eight
+//  packets are first turned on their side, so each vector holds
+//  one byte position from every packet, and each field is then a
+//  few shifts and masks. Packets left over at the end, and builds
+//  without SSE2, go through the plain loop.
+//
+//  Only what a single packet says is decoded here. Anything that
+//  depends on the packet before it, like motion, is up to the
+//  caller.
+//
+//===================================================================
+
+class TMBatchDecoder {
+
+public:
+    static const char*  Engine();
+
+    static void         TabletPC(const char *packets, int count, TMSampleBuffer *out, int at);
+    static void         TabletPCScalar(const char *packets, int count, TMSampleBuffer *out, int at);
+};
+
+#endif
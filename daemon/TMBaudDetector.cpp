@@ -0,0 +1,145 @@
+/**
+ * TMBaudDetector.cpp
+ *
+ * TabletMagicDaemon
+ * Thinkyhead Software
+ *
+ * This program is a component of TabletMagic. See the
+ * accompanying documentation for more details about the
+ * TabletMagic project.
+ *
+ * LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "TMBaudDetector.h"
+#include "TMTabletProbe.h"
+
+TMBaudDetector::TMBaudDetector() {
+    output = NULL;
+    resultCount = 0;
+    best = -1;
+    elapsed = 0;
+    packets = 0;
+    framer.SetCallback(TMBaudDetector::FrameCallback, this);
+}
+
+void TMBaudDetector::FrameCallback(FrameKind kind, char *, int, void *info) {
+    if (kind == kFramePacket)
+        ((TMBaudDetector*)info)->packets++;
+}
+
+//
+// Detect(port, speeds, count, protocol, size, sd, window)
+//
+// Listen at each speed in turn and stop at the first one that
+// sounds right. The port is left at the winning speed, or at the
+// speed it started with if none won. Nothing is ever written.
+//
+bool TMBaudDetector::Detect(TMSerialPort *port, const speed_t *speeds, int count, FramerProtocol proto, int size, bool sd, long window_ms) {
+    double  start = TMTabletProbe::Milliseconds();
+    speed_t oldSpeed = port->Speed();
+    bool    oldMarks = port->ErrorMarks();
+
+    best = -1;
+    resultCount = 0;
+
+    framer.Configure(proto, size, false, sd);
+    framer.SetErrorMarks(true);
+    (void)port->SetErrorMarks(true);
+
+    for (int i=0; i<count && resultCount < kMaxListenSpeeds && best == -1; i++) {
+        TMListenResult *r = &results[resultCount++];
+        r->speed = speeds[i];
+
+        (void)port->SetSpeed(speeds[i]);
+        Listen(port, r, window_ms);
+
+        if (output != NULL)
+            fprintf(output, "[LISTEN] %ld baud: %d bytes, %d packets, %d dropped, %d errors, score %.2f\n",
+                    TMSerialPort::BaudValue(r->speed), r->bytes, r->packets, r->dropped, r->errors, r->score);
+
+        if (r->packets >= kListenMinPackets && r->score >= kListenMinScore)
+            best = resultCount - 1;
+
+        // Silence at one speed is silence at all of them
+        if (r->bytes == 0)
+            break;
+    }
+
+    (void)port->SetErrorMarks(oldMarks);
+
+    if (best == -1)
+        (void)port->SetSpeed(oldSpeed);
+
+    elapsed = TMTabletProbe::Milliseconds() - start;
+    return best != -1;
+}
+
+//
+// Listen(port, result, window)
+//
+// Read whatever arrives for the window and score it by the
+// share of bytes that ended up in good packets. The partial
+// packets at either end keep a perfect stream a little under 1.
+//
+void TMBaudDetector::Listen(TMSerialPort *port, TMListenResult *result, long window_ms) {
+    char    buf[kReadAheadSize + 1];    // One spare byte for the framer
+    double  deadline = TMTabletProbe::Milliseconds() + window_ms;
+    double  now;
+
+    unsigned long dropped = framer.Dropped(), errors = framer.lineErrors;
+
+    (void)port->Flush();                // Only what arrives at this speed counts
+    framer.Reset();
+    packets = 0;
+    result->bytes = 0;
+
+    while ((now = TMTabletProbe::Milliseconds()) < deadline) {
+        long usec = (long)((deadline - now) * 1000.0);
+        if (usec < 1) usec = 1;
+        if (usec > 999999) usec = 999999;
+
+        if (port->Select((suseconds_t)usec) <= 0)
+            continue;
+
+        int len = port->Read(buf, kReadAheadSize);
+        if (len <= 0)
+            break;
+
+        result->bytes += len;
+        framer.Feed(buf, len);
+    }
+
+    result->packets = packets;
+    result->dropped = (int)(framer.Dropped() - dropped);
+    result->errors = (int)(framer.lineErrors - errors);
+
+    // Marked bytes and spoiled packets never count as good
+    result->score = result->bytes ? (double)(packets * framer.PacketSize()) / result->bytes : 0;
+}
+
+//
+// HeardAnything()
+// Did any bytes arrive at all?
+//
+bool TMBaudDetector::HeardAnything() {
+    for (int i=0; i<resultCount; i++)
+        if (results[i].bytes > 0)
+            return true;
+
+    return false;
+}
@@ -0,0 +1,98 @@
+/**
+ * TMBaudDetector.h
+ *
+ * TabletMagicDaemon
+ * Thinkyhead Software
+ *
+ * This program is a component of TabletMagic. See the
+ * accompanying documentation for more details about the
+ * TabletMagic project.
+ *
+ * LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __TMBAUDDETECTOR_H__
+#define __TMBAUDDETECTOR_H__
+
+#include "TMSerialPort.h"
+#include "TMPacketFramer.h"
+
+#include <stdio.h>
+
+#define kMaxListenSpeeds    8
+#define kListenWindow       120         //!< Milliseconds to listen at each speed
+#define kListenMinPackets   4           //!< Good packets needed to believe a speed
+#define kListenMinScore     0.75        //!< Share of the stream that must frame cleanly
+
+//! What was heard at one speed
+typedef struct TMListenResult {
+    speed_t         speed;
+    int             bytes;
+    int             packets;            //!< Phrases of the expected size
+    int             dropped;            //!< Phrases of the wrong size
+    int             errors;             //!< Bytes with framing or parity errors
+    double          score;              //!< 0 (noise) ... 1 (every byte in a good packet)
+} TMListenResult;
+
+//===================================================================
+//
+//  TMBaudDetector
+//
+//  Finds the speed of a tablet that is already sending, without
+//  sending it anything. Some TabletPC digitizers never answer a
+//  query, so listening is the only way to know.
+//
+//  At each candidate speed the port is read for a moment with
+//  error marks on, and the bytes are run through a framer set up
+//  for the expected packets. At the right speed the high bits fall
+//  every packet-size bytes and nearly everything frames. At the
+//  wrong speed bytes come in the wrong number, with line errors.
+//
+//  A tablet that isn't sending (the pen is away) can't be heard,
+//  so failing here only means asking is the next thing to try.
+//
+//===================================================================
+
+class TMBaudDetector {
+
+private:
+    TMPacketFramer  framer;
+    int             packets;            //!< Counted by the framer callback
+
+    FILE            *output;
+
+    static void     FrameCallback(FrameKind kind, char *data, int length, void *info);
+    void            Listen(TMSerialPort *port, TMListenResult *result, long window_ms);
+
+public:
+    TMListenResult  results[kMaxListenSpeeds];
+    int             resultCount;
+    int             best;               //!< Index of the winning result, or -1
+    double          elapsed;            //!< Milliseconds taken by the last Detect
+
+    TMBaudDetector();
+
+    inline void     SetOutput(FILE *f)  { output = f; }
+
+    bool            Detect(TMSerialPort *port, const speed_t *speeds, int count, FramerProtocol proto, int size, bool sd=false, long window_ms=kListenWindow);
+
+    inline speed_t  BestSpeed()         { return best == -1 ? 0 : results[best].speed; }
+    inline double   BestScore()         { return best == -1 ? 0 : results[best].score; }
+    bool            HeardAnything();
+};
+
+#endif
@@ -0,0 +1,101 @@
+/**
+ * TMByteRing.h
+ *
+ * TabletMagicDaemon
+ * Thinkyhead Software
+ *
+ * This program is a component of TabletMagic. See the
+ * accompanying documentation for more details about the
+ * TabletMagic project.
+ *
+ * LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __TMBYTERING_H__
+#define __TMBYTERING_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define kRingChunks     256         //!< Must be a power of 2
+#define kChunkSize      256         //!< Bytes per chunk (a read never returns more)
+
+//! A single read from the serial port
+typedef struct TMSerialChunk {
+    uint64_t    stamp;              //!< When the bytes were read (microseconds)
+    int         length;             //!< Number of bytes in data
+    char        data[kChunkSize + 1];   //!< With a spare byte for the framer
+} TMSerialChunk;
+
+//===================================================================
+//
+//  TMByteRing
+//
+//  A bounded single-producer / single-consumer queue of serial
+//  chunks. The reader thread fills slots in place and the main
+//  thread drains them, with no locks on either side.
+//
+//  head is only written by the producer, tail by the consumer.
+//
+//===================================================================
+
+class TMByteRing {
+
+private:
+    TMSerialChunk   chunk[kRingChunks];
+    uint32_t        head;           //!< Next slot to fill
+    uint32_t        tail;           //!< Next slot to drain
+
+public:
+    TMByteRing() : head(0), tail(0) {}
+
+    inline void Reset()         { head = tail = 0; }
+
+    inline uint32_t Count() {
+        return __atomic_load_n(&head, __ATOMIC_ACQUIRE) - __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+    }
+
+    //
+    // Producer side: get a free slot (or NULL if full), fill it, then Commit
+    //
+    inline TMSerialChunk* WriteSlot() {
+        uint32_t h = __atomic_load_n(&head, __ATOMIC_RELAXED);
+        if (h - __atomic_load_n(&tail, __ATOMIC_ACQUIRE) >= kRingChunks)
+            return NULL;
+        return &chunk[h & (kRingChunks - 1)];
+    }
+
+    inline void Commit() {
+        __atomic_store_n(&head, __atomic_load_n(&head, __ATOMIC_RELAXED) + 1, __ATOMIC_RELEASE);
+    }
+
+    //
+    // Consumer side: get the oldest chunk (or NULL if empty), use it, then Release
+    //
+    inline TMSerialChunk* ReadSlot() {
+        uint32_t t = __atomic_load_n(&tail, __ATOMIC_RELAXED);
+        if (t == __atomic_load_n(&head, __ATOMIC_ACQUIRE))
+            return NULL;
+        return &chunk[t & (kRingChunks - 1)];
+    }
+
+    inline void Release() {
+        __atomic_store_n(&tail, __atomic_load_n(&tail, __ATOMIC_RELAXED) + 1, __ATOMIC_RELEASE);
+    }
+};
+
+#endif
@@ -0,0 +1,245 @@
+/**
+ * TMCommandQueue.cpp
+ *
+ * TabletMagicDaemon
+ * Thinkyhead Software
+ *
+ * This program is a component of TabletMagic. See the
+ * accompanying documentation for more details about the
+ * TabletMagic project.
+ *
+ * LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include "TMCommandQueue.h"
+
+#include <string.h>
+#include <unistd.h>
+
+#define kNever  1.0e10                  //!< Fire date for an idle timer
+
+TMCommandQueue::TMCommandQueue() {
+    head = count = 0;
+    pumping = false;
+    lastWritten = true;
+    holdUntil = 0;
+    settleCallback = NULL;
+    settleInfo = NULL;
+    settleWritten = false;
+    port = NULL;
+    timer = NULL;
+    writer = NULL;
+    writerInfo = NULL;
+    commands = writes = 0;
+    paced = 0;
+}
+
+TMCommandQueue::~TMCommandQueue() {
+    if (timer != NULL) {
+        CFRunLoopTimerInvalidate(timer);
+        CFRelease(timer);
+    }
+}
+
+bool TMCommandQueue::Add(const char *command, int hold_ms, TMCommandCallback cb, void *info) {
+    int len = (int)strlen(command);
+    if (count >= kMaxCommands || len >= kCommandTextSize)
+        return false;
+
+    TMCommand *c = &queue[(head + count) % kMaxCommands];
+    strcpy(c->text, command);
+    c->length = len;
+    c->hold = hold_ms / 1000.0;
+    c->callback = cb;
+    c->info = info;
+    count++;
+
+    return true;
+}
+
+//
+// Send(command, hold, callback, info)
+//
+// Queue a command to go out with the next write. The callback
+// is called once it's written and its hold is over.
+//
+bool TMCommandQueue::Send(const char *command, int hold_ms, TMCommandCallback cb, void *info) {
+    if (!Add(command, hold_ms, cb, info))
+        return false;
+
+    Arm(CFAbsoluteTimeGetCurrent());
+    return true;
+}
+
+//
+// SendNow(command, hold, callback, info)
+//
+// Write the command, and anything queued ahead of it, before
+// returning. Waits for any hold that's still running first.
+// A callback can't write in the middle of a write, so there
+// it fails and the command should go through Send instead.
+//
+bool TMCommandQueue::SendNow(const char *command, int hold_ms, TMCommandCallback cb, void *info) {
+    if (pumping || !Add(command, hold_ms, cb, info))
+        return false;
+
+    while (count > 0) {
+        CFTimeInterval wait = holdUntil - CFAbsoluteTimeGetCurrent();
+        if (wait > 0)
+            (void)usleep((useconds_t)(wait * 1000000.0));
+
+        Pump();
+    }
+
+    return lastWritten;
+}
+
+//
+// Wait
+// Block until everything is written and the last hold is over
+//
+void TMCommandQueue::Wait() {
+    while (!pumping && (IsBusy() || CFAbsoluteTimeGetCurrent() < holdUntil)) {
+        CFTimeInterval wait = holdUntil - CFAbsoluteTimeGetCurrent();
+        if (wait > 0)
+            (void)usleep((useconds_t)(wait * 1000000.0));
+
+        Pump();
+    }
+}
+
+//
+// Clear
+// Drop the commands that haven't gone out. Their callbacks
+// are told they weren't written.
+//
+void TMCommandQueue::Clear() {
+    while (count > 0) {
+        TMCommand c = queue[head];
+        head = (head + 1) % kMaxCommands;
+        count--;
+
+        if (c.callback != NULL)
+            c.callback(false, c.info);
+    }
+
+    holdUntil = 0;
+    Settle(0);
+    Arm(kNever);
+}
+
+//
+// Pump
+//
+// Write the queued commands as long as no hold is running.
+// Each write takes every command up to and including the
+// first one with a hold.
+//
+void TMCommandQueue::Pump() {
+    if (pumping)
+        return;
+
+    pumping = true;
+
+    CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+    Settle(now);
+
+    while (count > 0) {
+        if (now < holdUntil) {
+            Arm(holdUntil);
+            break;
+        }
+
+        char        bytes[kMaxCommands * kCommandTextSize];
+        int         len = 0, n = 0;
+        TMCommand   *c;
+
+        do {
+            c = &queue[(head + n) % kMaxCommands];
+            memcpy(bytes + len, c->text, c->length);
+            len += c->length;
+            n++;
+        } while (n < count && c->hold == 0);
+
+        int wrote = (port != NULL) ? port->Write(bytes, len) : kSerialError;
+        lastWritten = (wrote == len);
+        bytes[len] = '\0';
+
+        writes++;
+        commands += n;
+
+        CFTimeInterval hold = lastWritten ? c->hold : 0;
+        holdUntil = now + hold;
+        paced += hold * 1000.0;
+
+        if (writer != NULL)
+            writer(bytes, len, lastWritten, writerInfo);
+
+        // Only the last command can still be holding
+        for (int i=0; i<n; i++) {
+            TMCommand done = queue[head];
+            head = (head + 1) % kMaxCommands;
+            count--;
+
+            if (done.callback == NULL)
+                continue;
+
+            if (i == n - 1 && hold > 0) {
+                settleCallback = done.callback;
+                settleInfo = done.info;
+                settleWritten = lastWritten;
+            }
+            else
+                done.callback(lastWritten, done.info);
+        }
+    }
+
+    if (count == 0)
+        Arm(settleCallback != NULL ? holdUntil : kNever);
+
+    pumping = false;
+}
+
+//
+// Settle(now)
+// Tell the last held command's caller that the hold is over
+//
+void TMCommandQueue::Settle(CFAbsoluteTime now) {
+    if (settleCallback != NULL && now >= holdUntil) {
+        TMCommandCallback cb = settleCallback;
+        settleCallback = NULL;
+        cb(settleWritten, settleInfo);
+    }
+}
+
+void TMCommandQueue::Arm(CFAbsoluteTime when) {
+    if (timer == NULL) {
+        if (when == kNever)
+            return;
+
+        CFRunLoopTimerContext ctx = { 0, this, NULL, NULL, NULL };
+        timer = CFRunLoopTimerCreate(NULL, when, kNever, 0, 0, TMCommandQueue::TimerCallback, &ctx);
+        CFRunLoopAddTimer(CFRunLoopGetCurrent(), timer, kCFRunLoopDefaultMode);
+    }
+    else
+        CFRunLoopTimerSetNextFireDate(timer, when);
+}
+
+void TMCommandQueue::TimerCallback(CFRunLoopTimerRef, void *info) {
+    ((TMCommandQueue*)info)->Pump();
+}
@@ -0,0 +1,118 @@
+/**
+ * TMCommandQueue.h
+ *
+ * TabletMagicDaemon
+ * Thinkyhead Software
+ *
+ * This program is a component of TabletMagic. See the
+ * accompanying documentation for more details about the
+ * TabletMagic project.
+ *
+ * LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef __TMCOMMANDQUEUE_H__
+#define __TMCOMMANDQUEUE_H__
+
+#include "TMSerialPort.h"
+
+#include <CoreFoundation/CoreFoundation.h>
+
+#define kMaxCommands        16          //!< Commands that can wait to be written
+#define kCommandTextSize    64          //!< Longest command that can be queued
+
+//! Called once a command is written and its hold is over
+typedef void (*TMCommandCallback)(bool written, void *info);
+
+//! Called after each write, with all the bytes that went out
+typedef void (*TMCommandWriter)(const char *bytes, int length, bool written, void *info);
+
+typedef struct {
+    char                text[kCommandTextSize];
+    int                 length;
+    CFTimeInterval      hold;                       //!< Seconds before anything else may follow
+    TMCommandCallback   callback;
+    void                *info;
+} TMCommand;
+
+//===================================================================
+//
+//  TMCommandQueue
+//
+//  Writes commands to the tablet, joining back-to-back commands
+//  into a single write so a "SP / setup / ST" sequence costs one
+//  trip through the driver instead of three.
+//
+//  A command can carry a hold: the time the tablet needs to act
+//  on it before it will listen again. A hold ends a run, so the
+//  commands after it go out in the next write once it's over.
+//  This takes the place of the fixed sleeps between commands,
+//  and nothing waits at all when nothing needs to.
+//
+//  Send() leaves the writing to a run loop timer, so commands
+//  sent from the same callout are joined. SendNow() writes at
+//  once, waiting out any hold still running, for the modal
+//  code that reads its reply straight after. It can't be used
+//  from a callback, which runs in the middle of a write.
+//
+//===================================================================
+
+class TMCommandQueue {
+
+private:
+    TMCommand           queue[kMaxCommands];
+    int                 head, count;
+    bool                pumping;            //!< Guards against Pump re-entry from callbacks
+    bool                lastWritten;        //!< How the last write went
+    CFAbsoluteTime      holdUntil;          //!< When the last write's hold is over
+
+    TMCommandCallback   settleCallback;     //!< Waiting for the hold to end
+    void                *settleInfo;
+    bool                settleWritten;
+
+    TMSerialPort        *port;
+    CFRunLoopTimerRef   timer;
+    TMCommandWriter     writer;
+    void                *writerInfo;
+
+    bool                Add(const char *command, int hold_ms, TMCommandCallback cb, void *info);
+    void                Pump();
+    void                Settle(CFAbsoluteTime now);
+    void                Arm(CFAbsoluteTime when);
+    static void         TimerCallback(CFRunLoopTimerRef timer, void *info);
+
+public:
+    unsigned long       commands;           //!< Commands written
+    unsigned long       writes;             //!< Writes it took
+    double              paced;              //!< Hold time put between commands (ms)
+
+    TMCommandQueue();
+    ~TMCommandQueue();
+
+    inline void         SetPort(TMSerialPort *p)                    { port = p; }
+    inline void         SetWriter(TMCommandWriter fn, void *info)   { writer = fn; writerInfo = info; }
+
+    bool                Send(const char *command, int hold_ms=0, TMCommandCallback cb=NULL, void *info=NULL);
+    bool                SendNow(const char *command, int hold_ms=0, TMCommandCallback cb=NULL, void *info=NULL);
+    void                Wait();
+    void                Clear();
+
+    inline bool         IsBusy()            { return count > 0 || settleCallback != NULL; }
+};
+
+#endif
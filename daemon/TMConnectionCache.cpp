@@ -0,0 +1,129 @@
+/**
+ * TMConnectionCache.cpp
+ *
+ * TabletMagicDaemon
+ * Thinkyhead Software
+ *
+ * This program is a component of TabletMagic. See the
+ * accompanying documentation for more details about the
+ * TabletMagic project.
+ *
+ * LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "TMConnectionCache.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+TMConnectionCache::TMConnectionCache() {
+    Clear();
+}
+
+void TMConnectionCache::Clear() {
+    port[0] = id[0] = setup[0] = scale[0] = '\0';
+    speed = 0;
+    model = series = -1;
+}
+
+//
+// CopyField(dst, src, size)
+// Copy a string, dropping the trailing CR or LF
+//
+void TMConnectionCache::CopyField(char *dst, const char *src, int size) {
+    int len = 0;
+    while (len < size - 1 && src[len] != '\0' && src[len] != '\r' && src[len] != '\n')
+        len++;
+
+    memcpy(dst, src, len);
+    dst[len] = '\0';
+}
+
+//
+// Load(path)
+//
+// Read the cache file. Unknown keys are ignored so older
+// daemons can read files written by newer ones.
+//
+bool TMConnectionCache::Load(const char *path) {
+    Clear();
+
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+        return false;
+
+    char line[MAXPATHLEN + 16];
+    while (fgets(line, sizeof(line), file) != NULL) {
+        char *value = strchr(line, '=');
+        if (line[0] == '#' || value == NULL)
+            continue;
+
+        *value++ = '\0';
+
+        if (!strcmp(line, "port"))          CopyField(port, value, sizeof(port));
+        else if (!strcmp(line, "speed"))    speed = strtol(value, NULL, 10);
+        else if (!strcmp(line, "model"))    model = (int)strtol(value, NULL, 10);
+        else if (!strcmp(line, "series"))   series = (int)strtol(value, NULL, 10);
+        else if (!strcmp(line, "id"))       CopyField(id, value, sizeof(id));
+        else if (!strcmp(line, "setup"))    CopyField(setup, value, sizeof(setup));
+        else if (!strcmp(line, "scale"))    CopyField(scale, value, sizeof(scale));
+    }
+
+    fclose(file);
+
+    if (!IsValid() || speed <= 0) {
+        Clear();
+        return false;
+    }
+
+    return true;
+}
+
+//
+// Save(path)
+//
+// Write to a temporary file and rename it into place, so a
+// daemon killed mid-write never leaves half a cache behind.
+//
+bool TMConnectionCache::Save(const char *path) {
+    char temp[MAXPATHLEN];
+    snprintf(temp, sizeof(temp), "%s.new", path);
+
+    FILE *file = fopen(temp, "w");
+    if (file == NULL)
+        return false;
+
+    fprintf(file, "# TabletMagic last known good connection\n");
+    fprintf(file, "port=%s\n", port);
+    fprintf(file, "speed=%ld\n", speed);
+    fprintf(file, "model=%d\n", model);
+    fprintf(file, "series=%d\n", series);
+    fprintf(file, "id=%s\n", id);
+    fprintf(file, "setup=%s\n", setup);
+    fprintf(file, "scale=%s\n", scale);
+
+    bool ok = (fclose(file) == 0);
+
+    if (ok)
+        ok = (rename(temp, path) == 0);
+
+    if (!ok)
+        (void)unlink(temp);
+
+    return ok;
+}
@@ -0,0 +1,69 @@
+/**
+ * TMConnectionCache.h
+ *
+ * TabletMagicDaemon
+ * Thinkyhead Software
+ *
+ * This program is a component of TabletMagic. See the
+ * accompanying documentation for more details about the
+ * TabletMagic project.
+ *
+ * LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __TMCONNECTIONCACHE_H__
+#define __TMCONNECTIONCACHE_H__
+
+#include <stdio.h>
+#include <sys/param.h>
+
+//===================================================================
+//
+//  TMConnectionCache
+//
+//  Remembers the last connection that worked so the daemon can
+//  go straight to it next time instead of scanning every port.
+//
+//  The file is a short list of key=value lines. The ID reply is
+//  kept so a single "~#" query can confirm that the same tablet
+//  is still there, and the setup and scale replies stand in for
+//  the "~R" and "~C" queries that would otherwise follow.
+//
+//===================================================================
+
+class TMConnectionCache {
+
+public:
+    char        port[MAXPATHLEN];   //!< Device path, as opened
+    long        speed;              //!< Line speed (a termios B-constant)
+    int         model;              //!< The model tried when the tablet answered
+    int         series;             //!< The series_index that was identified
+    char        id[64];             //!< The full ~# reply
+    char        setup[64];          //!< The ~R reply, or empty if not asked
+    char        scale[64];          //!< The ~C reply, or empty if not asked
+
+    TMConnectionCache();
+
+    void        Clear();
+    bool        Load(const char *path);
+    bool        Save(const char *path);
+    inline bool IsValid()           { return port[0] != '\0' && id[0] != '\0'; }
+
+    static void CopyField(char *dst, const char *src, int size);
+};
+
+#endif
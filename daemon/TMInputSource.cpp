@@ -0,0 +1,191 @@
+/**
+ * TMInputSource.cpp
+ *
+ * TabletMagicDaemon
+ * Thinkyhead Software
+ *
+ * This program is a component of TabletMagic. See the
+ * accompanying documentation for more details about the
+ * TabletMagic project.
+ *
+ * LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "TMInputSource.h"
+
+#include <errno.h>
+#include <stddef.h>
+
+#ifndef __APPLE__
+#include <poll.h>
+#endif
+
+TMInputSource::TMInputSource() {
+    fd = -1;
+    callback = NULL;
+    info = NULL;
+
+#ifdef __APPLE__
+    fdRef = NULL;
+    loopSource = NULL;
+#endif
+}
+
+TMInputSource::~TMInputSource() {
+    Detach();
+}
+
+#ifdef __APPLE__
+
+//
+// Attach(fd, callback, info)
+//
+// Watch a descriptor from the current run loop. The descriptor is
+// not closed on Detach, since it belongs to the caller.
+//
+bool TMInputSource::Attach(int filedes, TMInputCallback cb, void *cbinfo) {
+    Detach();
+
+    if (filedes == -1)
+        return false;
+
+    CFFileDescriptorContext ctx = { 0, this, NULL, NULL, NULL };
+    fdRef = CFFileDescriptorCreate(kCFAllocatorDefault, filedes, false, TMInputSource::FileDescriptorCallback, &ctx);
+    if (fdRef == NULL)
+        return false;
+
+    loopSource = CFFileDescriptorCreateRunLoopSource(kCFAllocatorDefault, fdRef, 0);
+    if (loopSource == NULL) {
+        CFFileDescriptorInvalidate(fdRef);
+        CFRelease(fdRef);
+        fdRef = NULL;
+        return false;
+    }
+
+    fd = filedes;
+    callback = cb;
+    info = cbinfo;
+
+    CFRunLoopAddSource(CFRunLoopGetCurrent(), loopSource, kCFRunLoopDefaultMode);
+    CFFileDescriptorEnableCallBacks(fdRef, kCFFileDescriptorReadCallBack);
+
+    return true;
+}
+
+void TMInputSource::Detach() {
+    if (loopSource != NULL) {
+        CFRunLoopRemoveSource(CFRunLoopGetCurrent(), loopSource, kCFRunLoopDefaultMode);
+        CFRunLoopSourceInvalidate(loopSource);
+        CFRelease(loopSource);
+        loopSource = NULL;
+    }
+
+    if (fdRef != NULL) {
+        CFFileDescriptorInvalidate(fdRef);
+        CFRelease(fdRef);
+        fdRef = NULL;
+    }
+
+    fd = -1;
+}
+
+//
+// FileDescriptorCallback
+//
+// CFFileDescriptor callbacks are one-shot, so re-arm after the
+// handler unless it detached (or re-attached) the source.
+//
+void TMInputSource::FileDescriptorCallback(CFFileDescriptorRef f, CFOptionFlags, void *info) {
+    TMInputSource *src = (TMInputSource*)info;
+
+    if (src->callback != NULL)
+        src->callback(src->fd, src->info);
+
+    if (src->fdRef == f)
+        CFFileDescriptorEnableCallBacks(f, kCFFileDescriptorReadCallBack);
+}
+
+#else
+
+TMInputSource *TMInputSource::sources[kMaxInputSources];
+
+bool TMInputSource::Attach(int filedes, TMInputCallback cb, void *cbinfo) {
+    Detach();
+
+    if (filedes == -1)
+        return false;
+
+    for (int i=0; i<kMaxInputSources; i++) {
+        if (sources[i] == NULL) {
+            sources[i] = this;
+            fd = filedes;
+            callback = cb;
+            info = cbinfo;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void TMInputSource::Detach() {
+    for (int i=0; i<kMaxInputSources; i++)
+        if (sources[i] == this)
+            sources[i] = NULL;
+
+    fd = -1;
+}
+
+//
+// RunOnce(msec)
+//
+// Sleep in poll() until an attached descriptor is readable (or the
+// timeout expires) and dispatch the callbacks. A negative timeout
+// waits indefinitely, so an idle line costs no wakeups at all.
+//
+// Returns the number of sources serviced, or -1 on error.
+//
+int TMInputSource::RunOnce(int msec) {
+    struct pollfd   pfd[kMaxInputSources];
+    TMInputSource   *src[kMaxInputSources];
+    int             count = 0;
+
+    for (int i=0; i<kMaxInputSources; i++) {
+        if (sources[i] != NULL) {
+            pfd[count].fd = sources[i]->fd;
+            pfd[count].events = POLLIN;
+            pfd[count].revents = 0;
+            src[count++] = sources[i];
+        }
+    }
+
+    int n = poll(pfd, count, msec);
+
+    if (n > 0) {
+        for (int i=0; i<count; i++) {
+            // A callback may detach other sources, so check again
+            if ((pfd[i].revents & (POLLIN|POLLHUP|POLLERR)) && src[i]->fd == pfd[i].fd && src[i]->callback != NULL)
+                src[i]->callback(src[i]->fd, src[i]->info);
+        }
+    }
+    else if (n < 0 && errno == EINTR)
+        n = 0;
+
+    return n;
+}
+
+#endif
@@ -0,0 +1,84 @@
+/**
+ * TMInputSource.h
+ *
+ * TabletMagicDaemon
+ * Thinkyhead Software
+ *
+ * This program is a component of TabletMagic. See the
+ * accompanying documentation for more details about the
+ * TabletMagic project.
+ *
+ * LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __TMINPUTSOURCE_H__
+#define __TMINPUTSOURCE_H__
+
+#ifdef __APPLE__
+#include <CoreFoundation/CoreFoundation.h>
+#endif
+
+//! Called when the attached descriptor has bytes (or an EOF) waiting
+typedef void (*TMInputCallback)(int fd, void *info);
+
+#define kMaxInputSources    8
+
+//===================================================================
+//
+//  TMInputSource
+//
+//  Calls back whenever a file descriptor becomes readable, so
+//  the daemon sleeps until there is actually something to read.
+//
+//  On Mac OS X this is a CFFileDescriptor in the current run loop.
+//  Elsewhere all attached sources are serviced by poll() through
+//  TMInputSource::RunOnce(), which stands in for the run loop.
+//
+//===================================================================
+
+class TMInputSource {
+
+private:
+    int                 fd;
+    TMInputCallback     callback;
+    void                *info;
+
+#ifdef __APPLE__
+    CFFileDescriptorRef fdRef;
+    CFRunLoopSourceRef  loopSource;
+
+    static void         FileDescriptorCallback(CFFileDescriptorRef f, CFOptionFlags types, void *info);
+#else
+    static TMInputSource *sources[kMaxInputSources];
+#endif
+
+public:
+    TMInputSource();
+    ~TMInputSource();
+
+    bool                Attach(int filedes, TMInputCallback cb, void *cbinfo);
+    void                Detach();
+
+    inline int          FileDevice()    { return fd; }
+    inline bool         IsAttached()    { return fd != -1; }
+
+#ifndef __APPLE__
+    static int          RunOnce(int msec=-1);
+#endif
+};
+
+#endif
@@ -0,0 +1,404 @@
+/**
+ * TMPacketFramer.cpp
+ *
+ * TabletMagicDaemon
+ * Thinkyhead Software
+ *
+ * This program is a component of TabletMagic. See the
+ * accompanying documentation for more details about the
+ * TabletMagic project.
+ *
+ * LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "TMPacketFramer.h"
+
+#include <stddef.h>
+#include <string.h>
+
+TMPacketFramer::TMPacketFramer() {
+    callback = NULL;
+    info = NULL;
+    bytesCarried = overruns = wrongSize = 0;
+    lineErrors = corrupted = 0;
+    marking = anyMarks = false;
+    markState = markHead = 0;
+    fed = carryStart = 0;
+    feedBuf = NULL;
+    for (int i=0; i<kFramerMarks; i++)
+        marks[i] = ~0ULL;             // Never matches
+    protocol = kFramerWacom;
+    packetSize = -1;
+    asciiPackets = sdReplies = false;
+    Configure(kFramerWacom, 7, false, false);
+    Reset();
+}
+
+//
+// Configure(protocol, packet size, ascii, sd)
+//
+// Select the framing machine for the given settings. This only
+// happens when the tablet or its settings change, never per byte.
+// When called from the callback it takes effect from the next byte.
+//
+void TMPacketFramer::Configure(FramerProtocol proto, int size, bool ascii, bool sd) {
+    if (proto == protocol && size == packetSize && ascii == asciiPackets && sd == sdReplies)
+        return;
+
+    protocol = proto;
+    packetSize = size;
+    asciiPackets = ascii;
+    sdReplies = sd;
+
+    if (proto == kFramerFujitsu)
+        machine = &TMPacketFramer::Machine<kFramerFujitsu, 5, 0, 0>;    // Fujitsu P-Series
+    else if (proto == kFramerTabletPC && size == 9 && !ascii && sd)
+        machine = &TMPacketFramer::Machine<kFramerTabletPC, 9, 0, 1>;   // TabletPC ISD-V4
+    else if (proto == kFramerWacom && size == 7 && ascii && !sd)
+        machine = &TMPacketFramer::Machine<kFramerWacom, 7, 1, 0>;      // II-S, ASCII and binary
+    else if (proto == kFramerWacom && size == 7 && ascii && sd)
+        machine = &TMPacketFramer::Machine<kFramerWacom, 7, 1, 1>;      // SD Series (II-S)
+    else if (proto == kFramerWacom && size == 7 && !ascii && !sd)
+        machine = &TMPacketFramer::Machine<kFramerWacom, 7, 0, 0>;      // Wacom IV
+    else if (proto == kFramerWacom && size == 9 && !ascii && !sd)
+        machine = &TMPacketFramer::Machine<kFramerWacom, 9, 0, 0>;      // Wacom IV with tilt, Wacom V
+    else
+        machine = &TMPacketFramer::Machine<-1, -1, -1, -1>;             // Anything else
+
+    reconfigured = true;
+}
+
+void TMPacketFramer::Reset() {
+    inPacket = false;
+    count = 0;
+    commaCount = 0;
+    start = 0;
+    carrying = false;
+    markState = 0;
+}
+
+//
+// ReleaseHeld()
+//
+// Hand out a held TabletPC packet as a packet. Call this once
+// the stream has been quiet for a while and no query reply is
+// expected. The phrase is always in the carry by then.
+//
+void TMPacketFramer::ReleaseHeld() {
+    if (!Holding())
+        return;
+
+    int n = count;
+    inPacket = carrying = false;
+    count = 0;
+    Emit(kFramePacket, carry, n);
+}
+
+//
+// SetErrorMarks(on)
+//
+// Tell the framer whether the port is marking line errors.
+// This should change along with the port's setting.
+//
+void TMPacketFramer::SetErrorMarks(bool on) {
+    marking = on;
+    markState = 0;
+}
+
+//
+// Unmark(buf, len)
+//
+// Take the PARMRK marks out of a buffer, in place, and return
+// the new length. A byte with an error arrives as FF 00 byte
+// and a real FF as FF FF. The place of each error is kept so
+// Emit can tell which phrases it spoiled.
+//
+int TMPacketFramer::Unmark(char *buf, int len) {
+    if (markState == 0 && memchr(buf, 0xFF, len) == NULL)
+        return len;
+
+    int out = 0;
+    for (int i=0; i<len; i++) {
+        unsigned char c = (unsigned char)buf[i];
+
+        switch (markState) {
+            case 0:
+                if (c == 0xFF)
+                    markState = 1;
+                else
+                    buf[out++] = c;
+                break;
+
+            case 1:
+                if (c == 0x00)
+                    markState = 2;
+                else {
+                    buf[out++] = c;     // FF FF is a real FF
+                    markState = 0;
+                }
+                break;
+
+            case 2:
+                // Keep the bad byte so the packet still has its length
+                lineErrors++;
+                marks[markHead] = fed + out;
+                markHead = (markHead + 1) % kFramerMarks;
+                anyMarks = true;
+                buf[out++] = c;
+                markState = 0;
+                break;
+        }
+    }
+
+    return out;
+}
+
+//
+// Corrupted(data, length)
+// Does a phrase contain any of the recent errors?
+//
+bool TMPacketFramer::Corrupted(char *data, int length) {
+    unsigned long long first = (data == carry) ? carryStart : fed + (unsigned long long)(data - feedBuf);
+
+    // Nothing since the phrase began?
+    if (marks[(markHead + kFramerMarks - 1) % kFramerMarks] < first)
+        return false;
+
+    for (int i=0; i<kFramerMarks; i++)
+        if (marks[i] >= first && marks[i] < first + length)
+            return true;
+
+    return false;
+}
+
+//
+// Restart(buf, len)
+//
+// Continue feeding with a newly selected machine. Only called
+// right after a reply, when no phrase is in progress.
+//
+void TMPacketFramer::Restart(char *buf, int len) {
+    inPacket = false;
+    count = 0;
+    carrying = false;
+    reconfigured = false;
+    (this->*machine)(buf, len);
+}
+
+//
+// Emit(kind, data, length)
+//
+// Hand a phrase to the callback, NUL-terminated in place.
+// The byte after a view belongs to the stream, so it's restored.
+//
+void TMPacketFramer::Emit(FrameKind kind, char *data, int length) {
+    if (kind != kFrameTabletPCReply)
+        commaCount = 0;
+
+    reconfigured = false;
+
+    // Marks are rare, so most of the time this is one test
+    if (anyMarks && Corrupted(data, length)) {
+        corrupted++;
+        return;
+    }
+
+    if (callback != NULL) {
+        char save = data[length];
+        data[length] = '\0';
+        callback(kind, data, length, info);
+        data[length] = save;
+    }
+}
+
+//
+// Machine<protocol, size, ascii, sd>(buf, len)
+//
+// Frame a run of bytes from the tablet. The buffer must have room
+// for one byte past len, and ASCII line endings are normalized in it.
+//
+// Each instantiation has the protocol details fixed at compile time,
+// so none of them are tested per byte. A -1 parameter is read from
+// the current settings instead.
+//
+// Phrases are always contiguous, so a view only has to remember
+// where it began. The state is kept in locals while scanning, since
+// stores into the (char) buffer would otherwise force reloads.
+//
+template <int P, int Size, int Ascii, int SD>
+void TMPacketFramer::Machine(char *buf, int len) {
+    const FramerProtocol    proto = (P < 0) ? protocol : (FramerProtocol)P;
+    const int               size = (Size < 0) ? packetSize : Size;
+    const bool              ascii = (Ascii < 0) ? asciiPackets : (Ascii != 0);
+    const bool              sd = (SD < 0) ? sdReplies : (SD != 0);
+
+    bool    in = inPacket, carried = carrying;
+    int     n = count, first = start;
+
+// Extend the current phrase with buf[at]
+#define APPEND(at) do {                                                 \
+        if (carried) {                                                  \
+            if (n < kFramerCarrySize) {                                 \
+                carry[n++] = buf[at];                                   \
+                bytesCarried++;                                         \
+                break;                                                  \
+            }                                                           \
+            overruns++;             /* Too long to be anything useful */ \
+            carried = false;                                            \
+            n = 0;                                                      \
+        }                                                               \
+        if (n++ == 0) first = at;                                       \
+    } while(0)
+
+#define PHRASE  (carried ? carry : buf + first)
+
+    for (int i=0; i<len; i++) {
+        int at = i;
+        unsigned char s = (unsigned char)buf[i];
+
+        if (proto == kFramerFujitsu) {
+            // A status byte starts each 5 byte packet
+            if (s > 130) {
+                if (in && n) wrongSize++;
+                n = 0;
+                carried = false;
+                in = true;
+            }
+
+            if (in) {
+                APPEND(at);
+                if (n == 5) {
+                    Emit(kFramePacket, PHRASE, n);
+                    in = carried = false;
+                    n = 0;
+                }
+            }
+            continue;
+        }
+
+        // In binary mode the high bit indicates a new phrase
+        // All Wacom IV modes are binary. II-S has an ASCII mode
+        if (s & 0x80) {
+            if (in) {
+                // Sanity check packets before processing. This is redundant, as
+                // each processing function does its own sanity-checking.
+                if (proto == kFramerTabletPC && n == TPC_QUERY_REPLY_SIZE)
+                    Emit(kFrameTabletPCReply, PHRASE, n);
+                else if (n == size)
+                    Emit(kFramePacket, PHRASE, n);
+                else
+                    wrongSize++;
+            }
+            else if (n) {
+                // This is a hack for replies that don't end in CR
+                // (Which should be rare or non-existent)
+                Emit(kFrameReply, PHRASE, n);
+            }
+
+            // A reply may have changed the settings. If so start this
+            // byte over in the newly selected machine.
+            if (reconfigured) { Restart(buf + at, len - at); return; }
+
+            // Prepare to start capturing the binary packet
+            n = 0;
+            carried = false;
+            in = true;
+        }
+
+        // Normalize line endings for ASCII packets
+        if (!in) {
+            if (s == '\n') buf[i] = s = '\r';
+            if (i < len-1 && s=='\r' && (buf[i+1]=='\n' || buf[i+1]=='\r')) i++;
+        }
+
+        // Extend the phrase, ignore any leading newlines
+        if (n || s != '\r')
+            APPEND(at);
+
+        // Are we inside a binary packet?
+        if (in) {
+            // TabletPC may return a normal 9 byte packet or an 11 byte Info reply.
+            // Thus we can't assume the packet is complete after 9 bytes.
+            if (proto == kFramerTabletPC) {
+                if (n == TPC_QUERY_REPLY_SIZE) {
+                    Emit(kFrameTabletPCReply, PHRASE, n);
+                    in = carried = false;
+                    n = 0;
+                    if (reconfigured) { Restart(buf + i + 1, len - i - 1); return; }
+                }
+            }
+            else if (n == size) {
+                // This sends a packet when it reaches the proper packet size
+                // The assumption here is that a trailing packet could get lost
+                Emit(kFramePacket, PHRASE, n);
+                in = carried = false;
+                n = 0;
+            }
+
+            // Skip over the body of a packet in the buffer. Only the last
+            // byte needs the checks above, and the view needs no copying.
+            if (in && !carried) {
+                int last = (proto == kFramerTabletPC ? TPC_QUERY_REPLY_SIZE : size) - 1;
+                while (n < last && i < len-1 && !(buf[i+1] & 0x80)) { i++; n++; }
+            }
+        }
+        else if (n) {
+            char *phrase = PHRASE;
+
+            // The 3rd comma marks the end of an SD tablet info string
+            if (sd && n > 4 && phrase[0] == '~' && s == ',' && ++commaCount == 3)
+                s = '\r';
+
+            // Then check for a newline, indicating the end of a line
+            // in a potential packet
+            if (s == '\r') {
+                // If we're in II-S ASCII mode, process valid data packets
+                if (ascii && phrase[1] == ',' && (phrase[0] == '#' || phrase[0] == '!' || phrase[0] == '*'))
+                    Emit(kFramePacket, phrase, n-1);
+                else
+                    Emit(kFrameReply, phrase, n);
+
+                carried = false;
+                n = 0;
+                if (reconfigured) { Restart(buf + i + 1, len - i - 1); return; }
+            }
+        }
+    }
+
+#undef APPEND
+#undef PHRASE
+
+    // Keep an unfinished phrase for the next read
+    if (n && !carried) {
+        if (n > kFramerCarrySize) {
+            overruns++;
+            n = 0;
+        }
+        else {
+            for (int i=0; i<n; i++)
+                carry[i] = buf[first + i];
+            bytesCarried += n;
+            carried = true;
+            carryStart = fed + (unsigned long long)(buf + first - feedBuf);
+        }
+    }
+
+    inPacket = in;
+    carrying = carried;
+    count = n;
+    start = first;
+}
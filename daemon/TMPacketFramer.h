@@ -0,0 +1,153 @@
+/**
+ * TMPacketFramer.h
+ *
+ * TabletMagicDaemon
+ * Thinkyhead Software
+ *
+ * This program is a component of TabletMagic. See the
+ * accompanying documentation for more details about the
+ * TabletMagic project.
+ *
+ * LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __TMPACKETFRAMER_H__
+#define __TMPACKETFRAMER_H__
+
+#define kFramerCarrySize    256         //!< Longest phrase that can straddle two reads
+#define kFramerMarks        16          //!< Recent line errors remembered
+
+//! Stream layouts understood by the framer
+typedef enum {
+    kFramerWacom,                       //!< High-bit binary packets and CR-terminated ASCII
+    kFramerTabletPC,                    //!< As above, plus 11-byte query replies
+    kFramerFujitsu                      //!< 5-byte packets starting with a status byte
+} FramerProtocol;
+
+//! What kind of phrase was found
+typedef enum {
+    kFramePacket,                       //!< A data packet, for ProcessPacket
+    kFrameReply,                        //!< A command reply, for ProcessCommandReply
+    kFrameTabletPCReply                 //!< A TabletPC query reply
+} FrameKind;
+
+//! Receives each phrase. The data is NUL-terminated for the duration of the call.
+typedef void (*TMFrameCallback)(FrameKind kind, char *data, int length, void *info);
+
+class TMPacketFramer;
+
+//! One of the framing machines, selected by Configure
+typedef void (TMPacketFramer::*FramerMachine)(char *buf, int len);
+
+//===================================================================
+//
+//  TMPacketFramer
+//
+//  Splits the raw serial stream into packets and command replies.
+//
+//  Phrases are handed out as views into the caller's buffer, so
+//  normally nothing is copied. Only a phrase that is still open
+//  at the end of a buffer is copied aside, to be completed by the
+//  next Feed().
+//
+//  There is a separate machine for each protocol family, chosen
+//  whenever the settings change, so the byte loop never has to
+//  ask which tablet it's talking to.
+//
+//  A TabletPC packet can't be handed out the moment it's whole,
+//  since the same 9 bytes may begin an 11-byte query reply. It's
+//  held until the next byte, and a tablet that falls silent after
+//  a burst leaves it held. ReleaseHeld() hands it out then.
+//
+//  With error marks on, the port reports each byte that arrived
+//  with a framing or parity error (termios PARMRK). The marks are
+//  taken out before framing and their places remembered, and any
+//  phrase containing one is dropped instead of handed out.
+//
+//===================================================================
+
+class TMPacketFramer {
+
+private:
+    FramerProtocol  protocol;
+    int             packetSize;         //!< Expected binary packet size
+    bool            asciiPackets;       //!< II-S: CR-terminated lines starting "#," "!," "*," are packets
+    bool            sdReplies;          //!< SD: the 3rd comma ends a ~ reply
+
+    bool            inPacket;           //!< Set when a packet start bit is detected
+    int             count;              //!< Length of the current phrase
+    int             commaCount;         //!< Comma counting for SD model replies
+    int             start;              //!< Start of the phrase in the buffer being fed
+    bool            carrying;           //!< The phrase is in carry, not the buffer
+    char            carry[kFramerCarrySize + 1];
+
+    FramerMachine   machine;            //!< The machine for the current settings
+    bool            reconfigured;       //!< Set when Configure selected a new machine
+
+    bool            marking;            //!< The stream has PARMRK error marks in it
+    int             markState;          //!< Progress through a mark split across reads
+    unsigned long long fed;             //!< Stream offset of the buffer being fed
+    char            *feedBuf;           //!< The buffer being fed
+    unsigned long long carryStart;      //!< Stream offset of the carried phrase
+    unsigned long long marks[kFramerMarks]; //!< Stream offsets of recent errors
+    int             markHead;
+    bool            anyMarks;
+
+    TMFrameCallback callback;
+    void            *info;
+
+    template <int P, int Size, int Ascii, int SD>
+    void            Machine(char *buf, int len);
+
+    void            Emit(FrameKind kind, char *data, int length);
+    void            Restart(char *buf, int len);
+    int             Unmark(char *buf, int len);
+    bool            Corrupted(char *data, int length);
+
+public:
+    unsigned long   bytesCarried;       //!< Bytes copied because a phrase straddled two reads
+    unsigned long   overruns;           //!< Phrases dropped for being too long
+    unsigned long   wrongSize;          //!< Packets dropped for being cut short
+    unsigned long   lineErrors;         //!< Bytes marked with a framing or parity error
+    unsigned long   corrupted;          //!< Phrases dropped for containing one
+
+    TMPacketFramer();
+
+    void            SetCallback(TMFrameCallback cb, void *cbinfo) { callback = cb; info = cbinfo; }
+    void            Configure(FramerProtocol proto, int size, bool ascii, bool sd);
+    void            Reset();
+
+    void            SetErrorMarks(bool on);
+    inline bool     ErrorMarks()                { return marking; }
+    inline int      PacketSize()                { return packetSize; }
+
+    inline void     Feed(char *buf, int len) {
+                        if (marking) len = Unmark(buf, len);
+                        feedBuf = buf;
+                        (this->*machine)(buf, len);
+                        fed += len;
+                    }
+    void            ReleaseHeld();
+
+    //! A whole TabletPC packet, kept until the next byte shows it isn't the start of a query reply
+    inline bool     Holding()                   { return protocol == kFramerTabletPC && inPacket && count == packetSize; }
+    //! A phrase that is still missing bytes
+    inline bool     Pending()                   { return count != 0 && !Holding(); }
+    inline unsigned long Dropped()              { return overruns + wrongSize + corrupted; }
+};
+
+#endif
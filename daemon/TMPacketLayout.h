@@ -0,0 +1,151 @@
+/**
+ * TMPacketLayout.h
+ *
+ * TabletMagicDaemon
+ * Thinkyhead Software
+ *
+ * This program is a component of TabletMagic. See the
+ * accompanying documentation for more details about the
+ * TabletMagic project.
+ *
+ * LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef __TMPACKETLAYOUT_H__
+#define __TMPACKETLAYOUT_H__
+
+#include "Constants.h"
+
+#define kMaxSlices      6               //!< Most bytes a field is spread over
+
+//! Bits of one packet byte, and where they go in the field value
+typedef struct TMBitSlice {
+    int     byte;                       //!< Which byte of the packet
+    int     mask;                       //!< Which bits, after inverting
+    int     shift;                      //!< Left if positive, right if negative
+    int     invert;                     //!< Bits sent inverted by the tablet
+} TMBitSlice;
+
+//! A field made of slices OR'ed together, optionally signed by a base bit
+typedef struct TMBitField {
+    int         count;                  //!< Slices used
+    TMBitSlice  slice[kMaxSlices];
+    int         signByte;               //!< Byte with the sign bit
+    int         signMask;               //!< Sign bit, subtracted from the value (0 = unsigned)
+} TMBitField;
+
+//===================================================================
+//
+//  Packet Layouts
+//
+//  Where each field lives in the binary packets, built from the
+//  masks in Constants.h. These tables are the one description of
+//  each layout. The decoders, and the batch decoder's vector
+//  code, get their shifts and masks from here.
+//
+//  TMField<layout>(packet) is expanded by the compiler into the
+//  same shifts and masks that would be written out by hand. The
+//  tables are never read at run time, and nothing branches.
+//
+//===================================================================
+
+//
+// Wacom II-S binary
+//
+constexpr TMBitField IIs_FieldX          = { 3, { { 0, IIs_Mask0_X, 14, 0 }, { 1, IIs_Mask1_X, 7, 0 }, { 2, IIs_Mask2_X, 0, 0 } }, 0, 0 };
+constexpr TMBitField IIs_FieldY          = { 3, { { 3, IIs_Mask3_Y, 14, 0 }, { 4, IIs_Mask4_Y, 7, 0 }, { 5, IIs_Mask5_Y, 0, 0 } }, 0, 0 };
+
+//
+// TabletPC ISD-V4
+//
+constexpr TMBitField TPC_FieldX          = { 3, { { 6, TPC_Mask6_X, -5, 0 }, { 2, TPC_Mask2_X, 2, 0 }, { 1, TPC_Mask1_X, 9, 0 } }, 0, 0 };
+constexpr TMBitField TPC_FieldY          = { 3, { { 6, TPC_Mask6_Y, -3, 0 }, { 4, TPC_Mask4_Y, 2, 0 }, { 3, TPC_Mask3_Y, 9, 0 } }, 0, 0 };
+constexpr TMBitField TPC_FieldPressure   = { 2, { { 6, TPC_Mask6_PressureHi, 7, 0 }, { 5, TPC_Mask5_PressureLo, 0, 0 } }, 0, 0 };
+
+//
+// Wacom IV. ROMs before 1.2 have one less bit of pressure.
+//
+constexpr TMBitField IV_FieldX           = { 3, { { 0, IV_Mask0_X, 14, 0 }, { 1, IV_Mask1_X, 7, 0 }, { 2, IV_Mask2_X, 0, 0 } }, 0, 0 };
+constexpr TMBitField IV_FieldY           = { 3, { { 3, IV_Mask3_Y, 14, 0 }, { 4, IV_Mask4_Y, 7, 0 }, { 5, IV_Mask5_Y, 0, 0 } }, 0, 0 };
+constexpr TMBitField IV_FieldPressure    = { 3, { { 3, IV_Mask3_Pressure0, -2, 0 }, { 6, IV_Mask6_PressureLo, 1, 0 }, { 6, IV_Mask6_PressureHi, 1, IV_Mask6_PressureHi } }, 0, 0 };
+constexpr TMBitField IV_FieldPressureOld = { 2, { { 6, IV_Mask6_PressureLo, 1, 0 }, { 6, IV_Mask6_PressureHi, 1, IV_Mask6_PressureHi } }, 0, 0 };
+constexpr TMBitField IV_FieldButtons     = { 1, { { 3, IV_Mask3_Buttons, -3, 0 } }, 0, 0 };
+constexpr TMBitField IV_FieldTiltX       = { 1, { { 7, IV_Mask7_TiltX, 0, 0 } }, 7, IV_Mask7_TiltXBase };
+constexpr TMBitField IV_FieldTiltY       = { 1, { { 8, IV_Mask8_TiltY, 0, 0 } }, 8, IV_Mask8_TiltYBase };
+
+//
+// Wacom V
+//
+constexpr TMBitField V_FieldToolID       = { 2, { { 1, V_Mask1_ToolHi, 5, 0 }, { 2, V_Mask2_ToolLo, -2, 0 } }, 0, 0 };
+constexpr TMBitField V_FieldSerial       = { 6, { { 2, V_Mask2_Serial, 30, 0 }, { 3, V_Mask3_Serial, 23, 0 }, { 4, V_Mask4_Serial, 16, 0 },
+                                                   { 5, V_Mask5_Serial, 9, 0 }, { 6, V_Mask6_Serial, 2, 0 }, { 7, V_Mask7_Serial, -5, 0 } }, 0, 0 };
+constexpr TMBitField V_FieldX            = { 3, { { 1, V_Mask1_X, 9, 0 }, { 2, V_Mask2_X, 2, 0 }, { 3, V_Mask3_X, -5, 0 } }, 0, 0 };
+constexpr TMBitField V_FieldY            = { 3, { { 3, V_Mask3_Y, 11, 0 }, { 4, V_Mask4_Y, 4, 0 }, { 5, V_Mask5_Y, -3, 0 } }, 0, 0 };
+constexpr TMBitField V_FieldTiltX        = { 1, { { 7, V_Mask7_TiltX, 0, 0 } }, 7, V_Mask7_TiltXBase };
+constexpr TMBitField V_FieldTiltY        = { 1, { { 8, V_Mask8_TiltY, 0, 0 } }, 8, V_Mask8_TiltYBase };
+constexpr TMBitField V_FieldPressure     = { 2, { { 5, V_Mask5_PressureHi, 7, 0 }, { 6, V_Mask6_PressureLo, 0, 0 } }, 0, 0 };
+constexpr TMBitField V_FieldWheel        = { 2, { { 5, V_Mask5_WheelHi, 7, 0 }, { 6, V_Mask6_WheelLo, 0, 0 } }, 0, 0 };
+constexpr TMBitField V_FieldThrottle     = { 2, { { 5, V_Mask5_ThrottleHi, 7, 0 }, { 6, V_Mask6_ThrottleLo, 0, 0 } }, 0, 0 };
+constexpr TMBitField V_FieldRotation     = { 2, { { 6, V_Mask6_4dRotationHi, 7, 0 }, { 7, V_Mask7_4dRotationLo, 0, 0 } }, 0, 0 };
+constexpr TMBitField V_Field4dButtons    = { 2, { { 8, V_Mask8_4dButtonsHi, -1, 0 }, { 8, V_Mask8_4dButtonsLo, 0, 0 } }, 0, 0 };
+constexpr TMBitField V_Field2dButtons    = { 1, { { 8, V_Mask8_2dButtons, -2, 0 } }, 0, 0 };
+constexpr TMBitField V_Field2dWheel      = { 1, { { 8, V_Mask8_WheelUp, -1, 0 } }, 8, V_Mask8_WheelDown };
+constexpr TMBitField V_FieldLensButtons  = { 1, { { 8, V_Mask8_LensButtons, 0, 0 } }, 0, 0 };
+
+//
+// TMSliceBits<byte, mask, shift, invert>(packet)
+// One slice, with every detail a constant
+//
+template <int Byte, int Mask, int Shift, int Invert>
+inline unsigned long TMSliceBits(const UInt8 *p) {
+    unsigned long bits = (unsigned long)((p[Byte] ^ Invert) & Mask);
+    return (Shift >= 0) ? bits << (Shift >= 0 ? Shift : 0) : bits >> (Shift < 0 ? -Shift : 0);
+}
+
+//
+// TMFieldSlices<field, index>::Get(packet)
+// The slices of a field from index down, unrolled at compile time
+//
+template <const TMBitField &F, int I>
+struct TMFieldSlices {
+    static inline unsigned long Get(const UInt8 *p) {
+        return TMSliceBits<F.slice[I].byte, F.slice[I].mask, F.slice[I].shift, F.slice[I].invert>(p)
+             | TMFieldSlices<F, I - 1>::Get(p);
+    }
+};
+
+template <const TMBitField &F>
+struct TMFieldSlices<F, -1> {
+    static inline unsigned long Get(const UInt8 *) { return 0; }
+};
+
+//
+// TMField<field>(packet)
+// The value of a field in a packet
+//
+template <const TMBitField &F>
+inline long TMField(const UInt8 *p) {
+    return (long)TMFieldSlices<F, F.count - 1>::Get(p) - (long)(p[F.signByte] & F.signMask);
+}
+
+template <const TMBitField &F>
+inline long TMField(const char *p) {
+    return TMField<F>((const UInt8*)p);
+}
+
+#endif
@@ -0,0 +1,236 @@
+/**
+ * TMPortMonitor.cpp
+ *
+ * TabletMagicDaemon
+ * Thinkyhead Software
+ *
+ * This program is a component of TabletMagic. See the
+ * accompanying documentation for more details about the
+ * TabletMagic project.
+ *
+ * LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "TMPortMonitor.h"
+
+#include <errno.h>
+#include <string.h>
+
+#ifdef __APPLE__
+
+#include <IOKit/serial/IOSerialKeys.h>
+
+TMPortMonitor::TMPortMonitor() {
+    callback = NULL;
+    info = NULL;
+    output = NULL;
+    notifyPort = NULL;
+    arrivals = removals = 0;
+}
+
+TMPortMonitor::~TMPortMonitor() {
+    Stop();
+}
+
+bool TMPortMonitor::IsRunning() {
+    return notifyPort != NULL;
+}
+
+//
+// Start(dir)
+//
+// Ask IOKit about serial devices being published and terminated.
+// The directory is only used elsewhere. The devices that are
+// already there are passed over, which also arms the iterators.
+//
+bool TMPortMonitor::Start(const char *dir) {
+    Stop();
+
+    notifyPort = IONotificationPortCreate(kIOMasterPortDefault);
+    if (notifyPort == NULL) {
+        if (output != NULL)
+            fprintf(output, "Can't create an IOKit notification port\n");
+        return false;
+    }
+
+    CFRunLoopAddSource(CFRunLoopGetCurrent(), IONotificationPortGetRunLoopSource(notifyPort), kCFRunLoopDefaultMode);
+
+    // Each notification consumes a reference to the matching dictionary
+    CFMutableDictionaryRef match = IOServiceMatching(kIOSerialBSDServiceValue);
+    CFDictionarySetValue(match, CFSTR(kIOSerialBSDTypeKey), CFSTR(kIOSerialBSDAllTypes));
+    CFRetain(match);
+
+    kern_return_t kernResult = IOServiceAddMatchingNotification(notifyPort, kIOFirstMatchNotification, match, TMPortMonitor::DeviceArrived, this, &arrivals);
+    if (kernResult == KERN_SUCCESS)
+        kernResult = IOServiceAddMatchingNotification(notifyPort, kIOTerminatedNotification, match, TMPortMonitor::DeviceRemoved, this, &removals);
+    else
+        CFRelease(match);
+
+    if (kernResult != KERN_SUCCESS) {
+        if (output != NULL)
+            fprintf(output, "IOServiceAddMatchingNotification returned %d\n", kernResult);
+        Stop();
+        return false;
+    }
+
+    Report(arrivals, kPortArrived, true);
+    Report(removals, kPortRemoved, true);
+
+    return true;
+}
+
+void TMPortMonitor::Stop() {
+    if (arrivals != 0) {
+        IOObjectRelease(arrivals);
+        arrivals = 0;
+    }
+
+    if (removals != 0) {
+        IOObjectRelease(removals);
+        removals = 0;
+    }
+
+    if (notifyPort != NULL) {
+        CFRunLoopRemoveSource(CFRunLoopGetCurrent(), IONotificationPortGetRunLoopSource(notifyPort), kCFRunLoopDefaultMode);
+        IONotificationPortDestroy(notifyPort);
+        notifyPort = NULL;
+    }
+}
+
+void TMPortMonitor::DeviceArrived(void *refcon, io_iterator_t iterator) {
+    ((TMPortMonitor*)refcon)->Report(iterator, kPortArrived);
+}
+
+void TMPortMonitor::DeviceRemoved(void *refcon, io_iterator_t iterator) {
+    ((TMPortMonitor*)refcon)->Report(iterator, kPortRemoved);
+}
+
+//
+// Report(iterator, event, quiet)
+//
+// Pass on the callout path of each device in the iterator.
+// The iterator has to be emptied each time or it won't fire again.
+//
+void TMPortMonitor::Report(io_iterator_t iterator, PortEvent event, bool quiet) {
+    io_object_t service;
+
+    while ((service = IOIteratorNext(iterator))) {
+        char path[MAXPATHLEN] = "";
+
+        if (!quiet) {
+            CFTypeRef pathAsCFString = IORegistryEntryCreateCFProperty(service, CFSTR(kIOCalloutDeviceKey), kCFAllocatorDefault, 0);
+            if (pathAsCFString) {
+                (void)CFStringGetCString((CFStringRef)pathAsCFString, path, sizeof(path), kCFStringEncodingASCII);
+                CFRelease(pathAsCFString);
+            }
+        }
+
+        (void)IOObjectRelease(service);
+
+        if (!quiet && callback != NULL)
+            callback(event, path, info);
+    }
+}
+
+#else
+
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#define kNotifyEvents   (IN_CREATE | IN_ATTRIB | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM)
+
+TMPortMonitor::TMPortMonitor() {
+    callback = NULL;
+    info = NULL;
+    output = NULL;
+    notifyFd = -1;
+    directory[0] = '\0';
+}
+
+TMPortMonitor::~TMPortMonitor() {
+    Stop();
+}
+
+bool TMPortMonitor::IsRunning() {
+    return notifyFd != -1;
+}
+
+//
+// Start(dir)
+// Watch a directory (/dev if none) for device nodes coming and going
+//
+bool TMPortMonitor::Start(const char *dir) {
+    Stop();
+
+    snprintf(directory, sizeof(directory), "%s", (dir != NULL && dir[0] != '\0') ? dir : "/dev");
+
+    notifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (notifyFd == -1) {
+        if (output != NULL)
+            fprintf(output, "Can't watch for serial devices - %s(%d).\n", strerror(errno), errno);
+        return false;
+    }
+
+    if (inotify_add_watch(notifyFd, directory, kNotifyEvents) == -1) {
+        if (output != NULL)
+            fprintf(output, "Can't watch %s for serial devices - %s(%d).\n", directory, strerror(errno), errno);
+        Stop();
+        return false;
+    }
+
+    return source.Attach(notifyFd, TMPortMonitor::NotifyCallback, this);
+}
+
+void TMPortMonitor::Stop() {
+    source.Detach();
+
+    if (notifyFd != -1) {
+        close(notifyFd);
+        notifyFd = -1;
+    }
+}
+
+//
+// NotifyCallback(fd, info)
+//
+// A new node may not be ready to open when it's created,
+// so attribute changes are reported as arrivals too.
+//
+void TMPortMonitor::NotifyCallback(int fd, void *info) {
+    TMPortMonitor *m = (TMPortMonitor*)info;
+    char events[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    ssize_t len;
+
+    while ((len = read(fd, events, sizeof(events))) > 0) {
+        for (char *p = events; p < events + len; ) {
+            struct inotify_event *event = (struct inotify_event*)p;
+            p += sizeof(struct inotify_event) + event->len;
+
+            if (event->len == 0 || m->callback == NULL)
+                continue;
+
+            // A path too long to open can't be the port
+            char path[MAXPATHLEN];
+            if (snprintf(path, sizeof(path), "%s/%s", m->directory, event->name) >= (int)sizeof(path))
+                continue;
+
+            m->callback((event->mask & (IN_DELETE | IN_MOVED_FROM)) ? kPortRemoved : kPortArrived, path, m->info);
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,102 @@
+/**
+ * TMPortMonitor.h
+ *
+ * TabletMagicDaemon
+ * Thinkyhead Software
+ *
+ * This program is a component of TabletMagic. See the
+ * accompanying documentation for more details about the
+ * TabletMagic project.
+ *
+ * LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __TMPORTMONITOR_H__
+#define __TMPORTMONITOR_H__
+
+#include <stdio.h>
+#include <sys/param.h>
+
+#ifdef __APPLE__
+#include <IOKit/IOKitLib.h>
+#else
+#include "TMInputSource.h"
+#endif
+
+//! What happened to a device
+typedef enum {
+    kPortArrived,
+    kPortRemoved
+} PortEvent;
+
+//! Receives each arrival and removal. The path may be empty if the device is already gone.
+typedef void (*TMPortCallback)(PortEvent event, const char *path, void *info);
+
+//===================================================================
+//
+//  TMPortMonitor
+//
+//  Reports serial devices coming and going, so an unplugged
+//  USB-serial adapter can be let go and picked up again when
+//  it comes back.
+//
+//  On Mac OS X this uses IOKit matching notifications for
+//  IOSerialBSDClient. Elsewhere a directory is watched with
+//  inotify: /dev by default, or the directory holding the port,
+//  so a pty linked from somewhere else can be tested too.
+//
+//  Every device is reported. Picking out the one that matters
+//  is left to the callback.
+//
+//===================================================================
+
+class TMPortMonitor {
+
+private:
+    TMPortCallback  callback;
+    void            *info;
+    FILE            *output;
+
+#ifdef __APPLE__
+    IONotificationPortRef notifyPort;
+    io_iterator_t   arrivals;
+    io_iterator_t   removals;
+
+    static void     DeviceArrived(void *refcon, io_iterator_t iterator);
+    static void     DeviceRemoved(void *refcon, io_iterator_t iterator);
+    void            Report(io_iterator_t iterator, PortEvent event, bool quiet=false);
+#else
+    int             notifyFd;
+    char            directory[MAXPATHLEN];
+    TMInputSource   source;
+
+    static void     NotifyCallback(int fd, void *info);
+#endif
+
+public:
+    TMPortMonitor();
+    ~TMPortMonitor();
+
+    inline void     SetOutput(FILE *f)  { output = f; }
+    inline void     SetCallback(TMPortCallback cb, void *cbinfo) { callback = cb; info = cbinfo; }
+
+    bool            Start(const char *dir=NULL);
+    void            Stop();
+    bool            IsRunning();
+};
+
+#endif
@@ -0,0 +1,242 @@
+/**
+ * TMPortScanner.cpp
+ *
+ * TabletMagicDaemon
+ * Thinkyhead Software
+ *
+ * This program is a component of TabletMagic. See the
+ * accompanying documentation for more details about the
+ * TabletMagic project.
+ *
+ * LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "TMPortScanner.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __APPLE__
+
+#include <IOKit/serial/IOSerialKeys.h>
+
+TMPortScanner::TMPortScanner() {
+    serialPortIterator = 0;
+    output = NULL;
+}
+
+TMPortScanner::~TMPortScanner() {
+    End();
+}
+
+//
+// Begin(portname, RS232Only?)
+//
+// Prepare a list of ports (i.e., that could have a tablet attached)
+// The portname is matched later by TMSerialPort::OpenNextMatchingPort.
+//
+// Once again, thanks be to Apple for the samples.
+//
+bool TMPortScanner::Begin(const char *portname, bool RS232Only) {
+    End();
+
+    kern_return_t           kernResult;
+    mach_port_t             masterPort;
+    CFMutableDictionaryRef  classesToMatch;
+
+    //
+    // Get the masterPort, whatever that is
+    //
+    kernResult = IOMasterPort(MACH_PORT_NULL, &masterPort);
+    if (KERN_SUCCESS != kernResult) {
+        if (output != NULL)
+            fprintf(output, "IOMasterPort returned %d\n", kernResult);
+        goto exit;
+    }
+
+    //
+    // Serial devices are instances of class IOSerialBSDClient.
+    // Here I search for ports with RS232Type because with my
+    // Keyspan USB-Serial adapter the first port shows up
+    //
+    classesToMatch = IOServiceMatching(kIOSerialBSDServiceValue);
+    if (classesToMatch == NULL) {
+        if (output != NULL)
+            fprintf(output, "No BSD Serial Service?\n");
+    }
+    else
+        CFDictionarySetValue(classesToMatch, CFSTR(kIOSerialBSDTypeKey), RS232Only ? CFSTR(kIOSerialBSDRS232Type) : CFSTR(kIOSerialBSDAllTypes));
+
+    //
+    // Find the next matching service
+    //
+    kernResult = IOServiceGetMatchingServices(masterPort, classesToMatch, &serialPortIterator);
+    if (KERN_SUCCESS != kernResult) {
+        if (output != NULL)
+            fprintf(output, "IOServiceGetMatchingServices returned %d\n", kernResult);
+        goto exit;
+    }
+
+exit:
+    return KERN_SUCCESS == kernResult;
+}
+
+void TMPortScanner::End() {
+    if (serialPortIterator != 0) {
+        IOObjectRelease(serialPortIterator);
+        serialPortIterator = 0;
+    }
+}
+
+bool TMPortScanner::IsValid() {
+    return (serialPortIterator != 0) && IOIteratorIsValid(serialPortIterator);
+}
+
+//
+// Next(path, maxlen)
+// Get the path in /dev that represents the next eligible port.
+//
+// Muchas gracias to Apple for this code.
+//
+bool TMPortScanner::Next(char *path, int maxlen) {
+    io_object_t     portService;
+    bool            result = false;
+
+    path[0] = '\0';
+
+    // Keep iterating until successful
+    while (!result && (portService = IOIteratorNext(serialPortIterator))) {
+        CFTypeRef   deviceFilePathAsCFString;
+
+        // Get the callout device's path (/dev/cu.xxxxx).
+        deviceFilePathAsCFString = IORegistryEntryCreateCFProperty(
+                                                                   portService,
+                                                                   CFSTR(kIOCalloutDeviceKey),
+                                                                   kCFAllocatorDefault,
+                                                                   0);
+
+        if (deviceFilePathAsCFString) {
+            // Convert the path from CFString to C string
+            result = CFStringGetCString((CFStringRef)deviceFilePathAsCFString,
+                                        path,
+                                        maxlen,
+                                        kCFStringEncodingASCII);
+
+            CFRelease(deviceFilePathAsCFString);
+        }
+
+        // Release the io_service_t now that we are done with it.
+        (void) IOObjectRelease(portService);
+    }
+
+    return result;
+}
+
+#else
+
+#include <dirent.h>
+
+//
+// Device names that may be serial ports. RS232Only
+// skips the USB adapters.
+//
+static const char *kSerialPrefixes[] = { "ttyS", "ttyUSB", "ttyACM", "ttyAMA", "ttyu", "cuau", NULL };
+static const int kFirstUSBPrefix = 1, kFirstOtherPrefix = 3;
+
+TMPortScanner::TMPortScanner() {
+    pathCount = pathIndex = 0;
+    output = NULL;
+}
+
+TMPortScanner::~TMPortScanner() {
+    End();
+}
+
+void TMPortScanner::AddPath(const char *path) {
+    if (pathCount < kMaxScanPorts)
+        paths[pathCount++] = strdup(path);
+}
+
+static int ComparePaths(const void *a, const void *b) {
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+//
+// Begin(portname, RS232Only?)
+//
+// Prepare a list of ports. An absolute portname is used as-is,
+// so ptys and unusual devices can be named on the command line.
+//
+bool TMPortScanner::Begin(const char *portname, bool RS232Only) {
+    End();
+
+    if (portname != NULL && portname[0] == '/') {
+        AddPath(portname);
+        return true;
+    }
+
+    DIR *dir = opendir("/dev");
+    if (dir == NULL) {
+        if (output != NULL)
+            fprintf(output, "Can't scan /dev for serial ports\n");
+        return false;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        for (int i=0; kSerialPrefixes[i] != NULL; i++) {
+            if (RS232Only && i >= kFirstUSBPrefix && i < kFirstOtherPrefix)
+                continue;
+
+            if (strncmp(entry->d_name, kSerialPrefixes[i], strlen(kSerialPrefixes[i])) == 0) {
+                char path[300];
+                snprintf(path, sizeof(path), "/dev/%s", entry->d_name);
+                AddPath(path);
+                break;
+            }
+        }
+    }
+
+    closedir(dir);
+
+    qsort(paths, pathCount, sizeof(paths[0]), ComparePaths);
+
+    return true;
+}
+
+void TMPortScanner::End() {
+    for (int i=0; i<pathCount; i++)
+        free(paths[i]);
+
+    pathCount = pathIndex = 0;
+}
+
+bool TMPortScanner::IsValid() {
+    return pathIndex < pathCount;
+}
+
+bool TMPortScanner::Next(char *path, int maxlen) {
+    path[0] = '\0';
+
+    if (pathIndex >= pathCount)
+        return false;
+
+    snprintf(path, maxlen, "%s", paths[pathIndex++]);
+    return true;
+}
+
+#endif
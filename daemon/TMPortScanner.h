@@ -0,0 +1,79 @@
+/**
+ * TMPortScanner.h
+ *
+ * TabletMagicDaemon
+ * Thinkyhead Software
+ *
+ * This program is a component of TabletMagic. See the
+ * accompanying documentation for more details about the
+ * TabletMagic project.
+ *
+ * LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __TMPORTSCANNER_H__
+#define __TMPORTSCANNER_H__
+
+#include <stdio.h>
+
+#ifdef __APPLE__
+#include <IOKit/IOKitLib.h>
+#else
+#define kMaxScanPorts   64
+#endif
+
+//===================================================================
+//
+//  TMPortScanner
+//
+//  Lists the serial devices that could have a tablet attached.
+//
+//  On Mac OS X the list comes from IOKit (IOSerialBSDClient).
+//  Elsewhere /dev is scanned for the usual serial device names.
+//  If a full path is given (such as a pty) only that one is
+//  listed, since it won't look like a serial port.
+//
+//===================================================================
+
+class TMPortScanner {
+
+private:
+#ifdef __APPLE__
+    io_iterator_t   serialPortIterator;
+#else
+    char            *paths[kMaxScanPorts];
+    int             pathCount;
+    int             pathIndex;
+
+    void            AddPath(const char *path);
+#endif
+
+    FILE            *output;
+
+public:
+    TMPortScanner();
+    ~TMPortScanner();
+
+    inline void     SetOutput(FILE *f)  { output = f; }
+
+    bool            Begin(const char *portname=NULL, bool RS232Only=false);
+    bool            Next(char *path, int maxlen);
+    bool            IsValid();
+    void            End();
+};
+
+#endif
@@ -0,0 +1,116 @@
+/**
+ * TMRateGovernor.cpp
+ *
+ * TabletMagicDaemon
+ * Thinkyhead Software
+ *
+ * This program is a component of TabletMagic. See the
+ * accompanying documentation for more details about the
+ * TabletMagic project.
+ *
+ * LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "TMRateGovernor.h"
+
+TMRateGovernor::TMRateGovernor() {
+    Reset(0);
+}
+
+void TMRateGovernor::Reset(double now) {
+    level = kRateFull;
+    lastDrawing = lastMotion = lastChange = now;
+    lastNear = false;
+    lastX = lastY = 0;
+    changes = 0;
+    for (int i=0; i<kRateLevels; i++)
+        secondsAt[i] = 0;
+}
+
+//
+// Update(drawing, near, x, y, now)
+//
+// Called for each packet. Returns true if the level changed,
+// so the caller can send the new rate to the tablet.
+//
+bool TMRateGovernor::Update(bool drawing, bool near, long x, long y, double now) {
+    long dx = x - lastX, dy = y - lastY;
+    bool moved = dx > kRateMotionSlop || dx < -kRateMotionSlop || dy > kRateMotionSlop || dy < -kRateMotionSlop;
+
+    if (moved) {
+        lastX = x;
+        lastY = y;
+    }
+
+    if (drawing)
+        lastDrawing = now;
+
+    if (near && moved)
+        lastMotion = now;
+
+    lastNear = near;
+    return Decide(drawing, now);
+}
+
+//
+// Tick(now)
+//
+// Called when Deadline() comes with no packet since. The pen is
+// taken to be as the latest packet left it, but not drawing.
+// Returns true if the level changed.
+//
+bool TMRateGovernor::Tick(double now) {
+    return Decide(false, now);
+}
+
+//
+// Deadline()
+// When the level will drop if nothing else arrives, or 0 if it can't
+//
+double TMRateGovernor::Deadline() {
+    switch (level) {
+        case kRateFull:
+            return lastDrawing + kRateHoverDelay;
+        case kRateHover:
+            return lastMotion + kRateIdleDelay;
+        default:
+            return 0;
+    }
+}
+
+//
+// Decide(drawing, now)
+// Pick the level for the state so far
+//
+bool TMRateGovernor::Decide(bool drawing, double now) {
+    RateLevel want;
+    if (drawing || now - lastDrawing < kRateHoverDelay)
+        want = kRateFull;
+    else if (lastNear && now - lastMotion < kRateIdleDelay)
+        want = kRateHover;
+    else
+        want = kRateIdle;
+
+    if (want == level)
+        return false;
+
+    secondsAt[level] += now - lastChange;
+    lastChange = now;
+    level = want;
+    changes++;
+    return true;
+}
@@ -0,0 +1,88 @@
+/**
+ * TMRateGovernor.h
+ *
+ * TabletMagicDaemon
+ * Thinkyhead Software
+ *
+ * This program is a component of TabletMagic. See the
+ * accompanying documentation for more details about the
+ * TabletMagic project.
+ *
+ * LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __TMRATEGOVERNOR_H__
+#define __TMRATEGOVERNOR_H__
+
+#define kRateHoverDelay     0.25        //!< Seconds at full rate after the pen lifts
+#define kRateIdleDelay      2.0         //!< Seconds without motion before going idle
+#define kRateMotionSlop     4           //!< Tablet units of jitter that don't count as motion
+
+//! Report rates, fastest first
+typedef enum {
+    kRateFull,                          //!< Drawing, or just finished
+    kRateHover,                         //!< In proximity and moving
+    kRateIdle,                          //!< Out of proximity, or resting
+    kRateLevels
+} RateLevel;
+
+//===================================================================
+//
+//  TMRateGovernor
+//
+//  Decides how fast the tablet should report, from what the pen
+//  is doing. Drawing always gets the full rate at once. Lifting
+//  the pen drops to the hover rate after a short delay, and a pen
+//  that rests or leaves proximity drops to the idle rate.
+//
+//  A tablet may stop sending when the pen leaves, so the levels
+//  can't only move on packets. Deadline() says when the level
+//  would next drop, and Tick() then moves it without a packet.
+//
+//  The governor only decides. Sending the commands that change
+//  the rate is up to the tablet, since each protocol does it
+//  differently.
+//
+//===================================================================
+
+class TMRateGovernor {
+
+private:
+    RateLevel       level;
+    double          lastDrawing;        //!< When a button was last down
+    double          lastMotion;         //!< When the pen last moved while near
+    double          lastChange;         //!< When the level last changed
+    bool            lastNear;           //!< The pen was near in the latest packet
+    long            lastX, lastY;
+
+    bool            Decide(bool drawing, double now);
+
+public:
+    unsigned long   changes;            //!< Number of level changes
+    double          secondsAt[kRateLevels]; //!< Time spent at each level
+
+    TMRateGovernor();
+
+    void            Reset(double now);
+    bool            Update(bool drawing, bool near, long x, long y, double now);
+    bool            Tick(double now);
+    double          Deadline();
+
+    inline RateLevel Level()            { return level; }
+};
+
+#endif
@@ -0,0 +1,229 @@
+/**
+ * TMRequestQueue.cpp
+ *
+ * TabletMagicDaemon
+ * Thinkyhead Software
+ *
+ * This program is a component of TabletMagic. See the
+ * accompanying documentation for more details about the
+ * TabletMagic project.
+ *
+ * LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "TMRequestQueue.h"
+
+#include <string.h>
+
+#define kNever  1.0e10                  //!< Fire date for an idle timer
+
+TMRequestQueue::TMRequestQueue() {
+    head = count = 0;
+    inFlight = pumping = false;
+    deadline = 0;
+    timer = NULL;
+    sender = NULL;
+    senderInfo = NULL;
+    answered = timeouts = failures = 0;
+    maxWait = 0;
+}
+
+TMRequestQueue::~TMRequestQueue() {
+    if (timer != NULL) {
+        CFRunLoopTimerInvalidate(timer);
+        CFRelease(timer);
+    }
+}
+
+//
+// Add(command, prefix, callback, info, timeout, tries, delay)
+//
+// Queue a command. With a prefix the queue holds until a reply
+// starting with it arrives, resending up to "tries" times. The
+// delay is counted from when the request reaches the front.
+//
+bool TMRequestQueue::Add(const char *command, const char *prefix, TMRequestCallback cb, void *info, int timeout_ms, int tries, int delay_ms) {
+    if (count >= kMaxRequests || strlen(command) >= kRequestTextSize)
+        return false;
+
+    TMRequest *r = &queue[(head + count) % kMaxRequests];
+    strcpy(r->command, command);
+    r->awaitReply = (prefix != NULL);
+    r->prefix[0] = '\0';
+    if (prefix != NULL)
+        strncat(r->prefix, prefix, kRequestTextSize - 1);
+    r->tries = tries < 1 ? 1 : tries;
+    r->timeout = timeout_ms / 1000.0;
+    r->delay = delay_ms / 1000.0;
+    r->notBefore = 0;
+    r->callback = cb;
+    r->info = info;
+    count++;
+
+    Pump();
+    return true;
+}
+
+//
+// Match(reply)
+//
+// Called with every reply the framer finds. Returns true if the
+// reply answered the request in flight.
+//
+bool TMRequestQueue::Match(char *reply) {
+    if (!inFlight)
+        return false;
+
+    TMRequest *r = &queue[head];
+    if (strncmp(reply, r->prefix, strlen(r->prefix)) != 0)
+        return false;
+
+    double wait = (CFAbsoluteTimeGetCurrent() - (deadline - r->timeout)) * 1000.0;
+    if (wait > maxWait) maxWait = wait;
+
+    answered++;
+    Finish(kRequestAnswered, reply);
+    Pump();
+    return true;
+}
+
+//
+// Written(written)
+//
+// The sender's command has actually gone out. Time the reply
+// from here, so a command that waited behind a hold still gets
+// its whole timeout.
+//
+void TMRequestQueue::Written(bool written) {
+    if (!inFlight || !written)
+        return;
+
+    deadline = CFAbsoluteTimeGetCurrent() + queue[head].timeout;
+    Arm(deadline);
+}
+
+//
+// Clear
+// Drop everything, as when the port is closed
+//
+void TMRequestQueue::Clear() {
+    while (count > 0)
+        Finish(kRequestCancelled, NULL);
+
+    Arm(kNever);
+}
+
+//
+// Finish(status, reply)
+// Remove the front request, then let its owner know
+//
+void TMRequestQueue::Finish(RequestStatus status, char *reply) {
+    TMRequest done = queue[head];
+
+    head = (head + 1) % kMaxRequests;
+    count--;
+    inFlight = false;
+
+    if (done.callback != NULL)
+        done.callback(status, reply, done.info);
+}
+
+//
+// Pump
+//
+// Send whatever is due at the front of the queue. Plain commands
+// go straight through, a query stops the pump until it's done.
+//
+void TMRequestQueue::Pump() {
+    if (pumping)
+        return;
+
+    pumping = true;
+
+    while (count > 0 && !inFlight) {
+        TMRequest *r = &queue[head];
+        CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+
+        if (r->notBefore == 0)
+            r->notBefore = now + r->delay;
+
+        if (r->notBefore > now) {
+            Arm(r->notBefore);
+            break;
+        }
+
+        r->tries--;
+        bool sent = (sender != NULL) && sender(r->command, senderInfo);
+
+        if (!sent || !r->awaitReply) {
+            if (!sent) failures++;
+            Finish(sent ? kRequestAnswered : kRequestTimedOut, NULL);
+            continue;
+        }
+
+        inFlight = true;
+        deadline = now + r->timeout;
+        Arm(deadline);
+    }
+
+    if (count == 0)
+        Arm(kNever);
+
+    pumping = false;
+}
+
+//
+// Arm(when)
+// Set the timer, creating it the first time
+//
+void TMRequestQueue::Arm(CFAbsoluteTime when) {
+    if (timer == NULL) {
+        if (when == kNever)
+            return;
+
+        CFRunLoopTimerContext ctx = { 0, this, NULL, NULL, NULL };
+        timer = CFRunLoopTimerCreate(NULL, when, kNever, 0, 0, TMRequestQueue::TimerCallback, &ctx);
+        CFRunLoopAddTimer(CFRunLoopGetCurrent(), timer, kCFRunLoopDefaultMode);
+    }
+    else
+        CFRunLoopTimerSetNextFireDate(timer, when);
+}
+
+//
+// TimerCallback
+//
+// A delay has run out or a reply is overdue. Overdue requests
+// are sent again until they run out of tries.
+//
+void TMRequestQueue::TimerCallback(CFRunLoopTimerRef, void *info) {
+    TMRequestQueue *q = (TMRequestQueue*)info;
+
+    if (q->inFlight && CFAbsoluteTimeGetCurrent() >= q->deadline) {
+        TMRequest *r = &q->queue[q->head];
+        q->timeouts++;
+        q->inFlight = false;
+
+        if (r->tries > 0)
+            r->notBefore = CFAbsoluteTimeGetCurrent();
+        else {
+            q->failures++;
+            q->Finish(kRequestTimedOut, NULL);
+        }
+    }
+
+    q->Pump();
+}
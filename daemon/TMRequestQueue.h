@@ -0,0 +1,122 @@
+/**
+ * TMRequestQueue.h
+ *
+ * TabletMagicDaemon
+ * Thinkyhead Software
+ *
+ * This program is a component of TabletMagic. See the
+ * accompanying documentation for more details about the
+ * TabletMagic project.
+ *
+ * LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __TMREQUESTQUEUE_H__
+#define __TMREQUESTQUEUE_H__
+
+#include <CoreFoundation/CoreFoundation.h>
+
+#define kMaxRequests        16          //!< Requests that can wait in the queue
+#define kRequestTextSize    32          //!< Longest command or reply prefix
+
+//! How a request ended
+typedef enum {
+    kRequestAnswered,                   //!< The expected reply arrived (or none was expected)
+    kRequestTimedOut,                   //!< Every try timed out
+    kRequestCancelled                   //!< The queue was cleared first
+} RequestStatus;
+
+//! Called when a request ends. The reply is NULL unless answered.
+typedef void (*TMRequestCallback)(RequestStatus status, char *reply, void *info);
+
+//! Writes a command to the tablet
+typedef bool (*TMRequestSender)(const char *command, void *info);
+
+typedef struct {
+    char                command[kRequestTextSize];
+    char                prefix[kRequestTextSize];   //!< The reply starts with this
+    bool                awaitReply;                 //!< False for plain commands
+    int                 tries;                      //!< Sends remaining
+    CFTimeInterval      timeout;                    //!< Seconds to wait for each try
+    CFTimeInterval      delay;                      //!< Seconds to wait before the first send
+    CFAbsoluteTime      notBefore;                  //!< When the delay runs out (0 = not yet due)
+    TMRequestCallback   callback;
+    void                *info;
+} TMRequest;
+
+//===================================================================
+//
+//  TMRequestQueue
+//
+//  Sends commands to the tablet one at a time and matches the
+//  replies as they come out of the framer, so nothing has to
+//  sit and wait in ReadLine while the stream piles up.
+//
+//  A request names the reply prefix it expects ("~R", "~C"...).
+//  Until that reply turns up the next request is held back, and
+//  a run loop timer resends it or gives up. Plain commands can be
+//  queued too, so they go out in order after the queries.
+//
+//  The sender may only queue the command for a later write. It
+//  calls Written() when the command is out, and the wait for the
+//  reply starts over from there.
+//
+//  Replies are still handed to ProcessCommandReply as usual. The
+//  queue only decides when a request is over.
+//
+//===================================================================
+
+class TMRequestQueue {
+
+private:
+    TMRequest           queue[kMaxRequests];
+    int                 head, count;
+    bool                inFlight;           //!< The head request was sent and awaits its reply
+    bool                pumping;            //!< Guards against Pump re-entry from callbacks
+    CFAbsoluteTime      deadline;           //!< When the request in flight times out
+
+    CFRunLoopTimerRef   timer;
+    TMRequestSender     sender;
+    void                *senderInfo;
+
+    void                Pump();
+    void                Finish(RequestStatus status, char *reply);
+    void                Arm(CFAbsoluteTime when);
+    static void         TimerCallback(CFRunLoopTimerRef timer, void *info);
+
+public:
+    unsigned long       answered;           //!< Requests that got their reply
+    unsigned long       timeouts;           //!< Tries that went unanswered
+    unsigned long       failures;           //!< Requests that ran out of tries
+    double              maxWait;            //!< Longest wait for a reply (ms)
+
+    TMRequestQueue();
+    ~TMRequestQueue();
+
+    inline void         SetSender(TMRequestSender fn, void *info) { sender = fn; senderInfo = info; }
+
+    bool                Add(const char *command, const char *prefix=NULL,
+                            TMRequestCallback cb=NULL, void *info=NULL,
+                            int timeout_ms=100, int tries=1, int delay_ms=0);
+    bool                Match(char *reply);
+    void                Written(bool written);
+    void                Clear();
+
+    inline bool         IsBusy()            { return count > 0; }
+};
+
+#endif
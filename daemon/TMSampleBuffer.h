@@ -0,0 +1,114 @@
+/**
+ * TMSampleBuffer.h
+ *
+ * TabletMagicDaemon
+ * Thinkyhead Software
+ *
+ * This program is a component of TabletMagic. See the
+ * accompanying documentation for more details about the
+ * TabletMagic project.
+ *
+ * LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef __TMSAMPLEBUFFER_H__
+#define __TMSAMPLEBUFFER_H__
+
+#include <CoreFoundation/CoreFoundation.h>
+
+#define kMaxSamples     64              //!< Samples held before they must be taken
+
+//! Sample flags
+enum {
+    kSampleOffTablet    = 1 << 0,       //!< Nothing is near or clicked
+    kSamplePenNear      = 1 << 1,       //!< Pen or eraser is near or clicked
+    kSampleEraser       = 1 << 2        //!< The eraser end is in use
+};
+
+//===================================================================
+//
+//  TMSampleBuffer
+//
+//  Decoded samples waiting to be taken, stored as one array per
+//  field so a stage that only looks at positions or pressure
+//  runs through just those.
+//
+//  The decoders write a sample for each packet straight into the
+//  arrays, and the run of packets from one read is posted as a
+//  batch when it's done. The buffer doesn't wrap. It's emptied
+//  by whoever takes the samples, which must happen before it fills.
+//
+//===================================================================
+
+class TMSampleBuffer {
+
+private:
+    int             count;
+
+public:
+    SInt32          x[kMaxSamples], y[kMaxSamples];         //!< Tablet coordinates
+    SInt32          dx[kMaxSamples], dy[kMaxSamples];       //!< Motion since the last report
+    UInt16          pressure[kMaxSamples];                  //!< Scaled for NX Event usage
+    SInt16          tiltX[kMaxSamples], tiltY[kMaxSamples]; //!< Scaled for NX Event usage
+    UInt16          buttons[kMaxSamples];                   //!< Button bits, as in StylusState.button_mask
+    UInt16          tool[kMaxSamples];                      //!< Tool type
+    UInt8           flags[kMaxSamples];                     //!< kSampleOffTablet, kSamplePenNear, kSampleEraser
+    CFAbsoluteTime  time[kMaxSamples];                      //!< When the packet was decoded
+
+    unsigned long   appended;           //!< Samples appended so far
+    unsigned long   batches;            //!< Times the samples were taken
+    int             maxBatch;           //!< Most samples taken at once
+
+    TMSampleBuffer() : count(0), appended(0), batches(0), maxBatch(0) {}
+
+    inline int      Count()             { return count; }
+    inline bool     IsFull()            { return count >= kMaxSamples; }
+
+    //
+    // Reserve(n)
+    //
+    // Make room for n samples to be written straight into the
+    // arrays. Returns the index of the first, or -1 if they
+    // don't fit.
+    //
+    inline int Reserve(int n) {
+        if (count + n > kMaxSamples)
+            return -1;
+
+        int at = count;
+        count += n;
+        appended += n;
+        return at;
+    }
+
+    //
+    // Taken()
+    // Empty the buffer once a batch has been used up
+    //
+    inline void Taken() {
+        if (count > 0) {
+            batches++;
+            if (count > maxBatch) maxBatch = count;
+        }
+        count = 0;
+    }
+
+    inline void Clear()                 { count = 0; }
+};
+
+#endif
@@ -0,0 +1,143 @@
+/**
+ * TMScan.h
+ *
+ * TabletMagicDaemon
+ * Thinkyhead Software
+ *
+ * This program is a component of TabletMagic. See the
+ * accompanying documentation for more details about the
+ * TabletMagic project.
+ *
+ * LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef __TMSCAN_H__
+#define __TMSCAN_H__
+
+#include <string.h>
+
+#define kScanMaxDigits  9               //!< Longest number that always fits an int
+#define kScanMaxHex     8               //!< Longest hex number that fits 32 bits
+
+//===================================================================
+//
+//  TMScan
+//
+//  Reads numbers out of fixed-format ASCII text, such as the II-S
+//  ASCII reports and the settings replies, for the places that
+//  used sscanf once per packet.
+//
+//  It never reads past the end given, nor past a NUL. Numbers
+//  skip leading white space, as in scanf, and literals must match
+//  exactly. A number longer than fits is refused instead of
+//  overflowing. Nothing is allocated and no locale is consulted.
+//
+//===================================================================
+
+class TMScan {
+
+private:
+    const char  *at;                    //!< Next character to read
+    const char  *end;                   //!< One past the last character
+
+    inline bool More()                  { return at < end && *at != '\0'; }
+
+    inline void SkipSpace() {
+        while (More() && (*at == ' ' || (*at >= '\t' && *at <= '\r')))
+            at++;
+    }
+
+public:
+    TMScan(const char *text, int len) : at(text), end(text + len) {}
+    TMScan(const char *text) : at(text), end(text + strlen(text)) {}
+
+    inline bool AtEnd()                 { return !More(); }
+
+    //
+    // Literal(c)
+    // Step over the character c, if it's next
+    //
+    inline bool Literal(char c) {
+        if (!More() || *at != c) return false;
+        at++;
+        return true;
+    }
+
+    //
+    // Decimal(&value)
+    // A decimal number, with an optional sign
+    //
+    inline bool Decimal(long *value) {
+        SkipSpace();
+
+        const char *start = at;
+        bool neg = false;
+        if (More() && (*at == '-' || *at == '+'))
+            neg = (*at++ == '-');
+
+        long v = 0;
+        int digits = 0;
+        while (More() && *at >= '0' && *at <= '9') {
+            if (++digits > kScanMaxDigits) { at = start; return false; }
+            v = v * 10 + (*at++ - '0');
+        }
+
+        if (!digits) { at = start; return false; }
+
+        *value = neg ? -v : v;
+        return true;
+    }
+
+    inline bool Decimal(int *value) {
+        long v;
+        if (!Decimal(&v)) return false;
+        *value = (int)v;
+        return true;
+    }
+
+    //
+    // Hex(&value)
+    // An unsigned hexadecimal number in either case
+    //
+    inline bool Hex(unsigned int *value) {
+        SkipSpace();
+
+        const char *start = at;
+        unsigned int v = 0;
+        int digits = 0;
+        while (More()) {
+            char c = *at;
+            unsigned int d;
+            if (c >= '0' && c <= '9')       d = c - '0';
+            else if (c >= 'A' && c <= 'F')  d = c - 'A' + 10;
+            else if (c >= 'a' && c <= 'f')  d = c - 'a' + 10;
+            else break;
+
+            if (++digits > kScanMaxHex) { at = start; return false; }
+            v = (v << 4) | d;
+            at++;
+        }
+
+        if (!digits) { at = start; return false; }
+
+        *value = v;
+        return true;
+    }
+};
+
+#endif
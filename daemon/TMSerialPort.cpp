@@ -28,9 +28,6 @@
 #include "TMSerialPort.h"
 #include "TabletSettings.h"
 
-#include <IOKit/IOKitLib.h>
-#include <IOKit/serial/IOSerialKeys.h>
-
 #include <errno.h>
 #include <fcntl.h>
 #include <paths.h>
@@ -46,6 +43,14 @@
 #include <sysexits.h>
 #include <unistd.h>
 
+#ifdef __APPLE__
+#include <IOKit/serial/ioss.h>
+#endif
+
+#ifdef __linux__
+#include <linux/serial.h>
+#endif
+
 #if LOG_STREAM_TO_FILE
 extern FILE* logfile;
 #endif
@@ -53,6 +58,13 @@ extern FILE* logfile;
 TMSerialPort::TMSerialPort() {
     output = NULL;
     fd = kSerialError;          // No serial port yet
+    aheadStart = aheadEnd = 0;  // Nothing read ahead
+    packetBytes = 0;            // Wake for every byte
+    errorMarks = false;         // Pass bad bytes on as they are
+    lowLatency = false;         // Let the driver buffer as it likes
+    latencyState = kLatencyOff;
+    savedSerialFlags = -1;
+    ResetCounters();
     (void)SetDefaultParameters();
 }
 
@@ -68,6 +80,10 @@ bool TMSerialPort::SetParameters(TabletSettings *sett) {
     speed_t     rate[] = { B2400, B4800, B9600, B19200, B38400 };
     int         parity[] = { 0, 0, 1, 2 };
 
+    // Packet reads follow the packet size
+    if (packetBytes)
+        packetBytes = sett->packet_size;
+
     return SetParameters(rate[sett->baud_rate], (sett->data_bits ? CS8 : CS7), parity[sett->parity], (sett->stop_bits ? 2 : 1), sett->cts, sett->dsr);
 }
 
@@ -103,6 +119,9 @@ int TMSerialPort::Open(char *filepath) {
     // be non-blocking.
     // See open(2) ("man 2 open") for details.
 
+    aheadStart = aheadEnd = 0;
+    ResetCounters();
+
     fd = open(deviceFilePath, O_RDWR | O_NOCTTY | O_NONBLOCK);
     if (fd == kSerialError) {
         if (output != NULL)
@@ -161,8 +180,8 @@ int TMSerialPort::Open(char *filepath) {
     // for details.
 
     cfmakeraw(&attribs);
-    attribs.c_cc[VMIN] = 1;         // 1 byte minimum
-    attribs.c_cc[VTIME] = 10;       // 1 second
+    SetReadTimes(&attribs);
+    SetErrorFlags(&attribs);
 
     // The Baud Rate
     cfsetspeed(&attribs, openSpeed);            // Set the baud rate
@@ -207,12 +226,14 @@ int TMSerialPort::Open(char *filepath) {
     // Assert Data Terminal Ready (DTR)
     // To set the port handshake lines, use the following ioctls.
     // See tty(4) ("man 4 tty") and ioctl(2) ("man 2 ioctl") for details.
+#ifdef TIOCSDTR
     if (ioctl(fd, TIOCSDTR) == kSerialError && output != NULL)
         fprintf(output, "Error asserting DTR %s - %s(%d).\n", deviceFilePath, strerror(errno), errno);
 
     // Clear Data Terminal Ready (DTR)
     if (ioctl(fd, TIOCCDTR) == kSerialError && output != NULL)
         fprintf(output, "Error clearing DTR %s - %s(%d).\n", deviceFilePath, strerror(errno), errno);
+#endif
 
     // Set the serial port lines depending on the bits set in handshake.
     handshake = TIOCM_DTR | TIOCM_RTS;
@@ -235,6 +256,8 @@ int TMSerialPort::Open(char *filepath) {
     //  if (output != NULL)
     //      fprintf(output, "Handshake lines currently set to %d\n", handshake);
 
+    ApplyLowLatency();
+
     // Success:
     return fd;
 
@@ -260,6 +283,7 @@ bool TMSerialPort::ApplySettings() {
 
         if (tcgetattr(fd, &attribs) != kSerialError) {
             cfsetspeed(&attribs, openSpeed);
+            SetReadTimes(&attribs);
 
             // Data Bits - 7 or 8
             attribs.c_cflag &= ~CSIZE;                  // Clear the data size bits
@@ -301,6 +325,207 @@ bool TMSerialPort::ApplySettings() {
     return result;
 }
 
+//
+// SetReadTimes(attribs)
+//
+// Normally the port becomes readable as soon as a byte arrives.
+// With packet reads VMIN is the packet size and VTIME is zero,
+// so select() waits for a whole packet and each read() gets one
+// or more. A partial packet never wakes anyone, so whoever reads
+// the port must also look again after PacketTimeout(), and then
+// ask for no more than BytesOnPort(), since reads block until
+// VMIN bytes arrive.
+//
+void TMSerialPort::SetReadTimes(struct termios *attribs) {
+    if (packetBytes > 1) {
+        attribs->c_cc[VMIN] = packetBytes;
+        attribs->c_cc[VTIME] = 0;
+    }
+    else {
+        attribs->c_cc[VMIN] = 1;    // 1 byte minimum
+        attribs->c_cc[VTIME] = 10;  // 1 second
+    }
+}
+
+//
+// SetPacketReads(size)
+//
+// Turn packet reads on (size > 1) or off. Only the read times
+// change, and nothing waiting on the port is flushed.
+//
+bool TMSerialPort::SetPacketReads(int size) {
+    struct termios attribs;
+
+    packetBytes = size;
+
+    if (!IsOpen())
+        return true;
+
+    if (tcgetattr(fd, &attribs) == kSerialError)
+        return false;
+
+    SetReadTimes(&attribs);
+    return tcsetattr(fd, TCSANOW, &attribs) != kSerialError;
+}
+
+//
+// SetErrorFlags(attribs)
+//
+// With error marks each byte received with a framing or parity
+// error arrives as FF 00 byte, and a real FF as FF FF. Without
+// them (the raw default) the bad byte just looks like data.
+// Breaks are marked too, as FF 00 00.
+//
+void TMSerialPort::SetErrorFlags(struct termios *attribs) {
+    if (errorMarks) {
+        attribs->c_iflag |= (PARMRK | INPCK);
+        attribs->c_iflag &= ~(IGNPAR | ISTRIP | IGNBRK | BRKINT);
+    }
+    else
+        attribs->c_iflag &= ~(PARMRK | INPCK);
+}
+
+//
+// SetErrorMarks(on)
+//
+// Turn error marks on or off. Like packet reads, nothing
+// waiting on the port is flushed, so whoever reads the
+// stream has to follow along.
+//
+bool TMSerialPort::SetErrorMarks(bool on) {
+    struct termios attribs;
+
+    errorMarks = on;
+
+    if (!IsOpen())
+        return true;
+
+    if (tcgetattr(fd, &attribs) == kSerialError)
+        return false;
+
+    SetErrorFlags(&attribs);
+    return tcsetattr(fd, TCSANOW, &attribs) != kSerialError;
+}
+
+//
+// PacketTimeout()
+// Long enough for two packets at the current speed
+//
+suseconds_t TMSerialPort::PacketTimeout() {
+    long baud = BaudValue(openSpeed);
+    long usec = baud ? 2 * (packetBytes > 1 ? packetBytes : 1) * 10 * 1000000L / baud : 10000;
+    return usec < 2000 ? 2000 : (suseconds_t)usec;
+}
+
+long TMSerialPort::BaudValue(speed_t speed) {
+    switch (speed) {
+        case B2400:     return 2400;
+        case B4800:     return 4800;
+        case B9600:     return 9600;
+        case B19200:    return 19200;
+        case B38400:    return 38400;
+    }
+    return 0;
+}
+
+//
+// SetLowLatency(on)
+//
+// Ask for low latency from now on. If the port is open it
+// changes right away, otherwise at the next Open. Returns
+// false if it was asked for and the driver didn't take it.
+//
+bool TMSerialPort::SetLowLatency(bool on) {
+    lowLatency = on;
+
+    if (IsOpen()) {
+        if (on)
+            ApplyLowLatency();
+        else {
+            RestoreLatency();
+            latencyState = kLatencyOff;
+        }
+    }
+
+    return !on || !IsOpen() || latencyState == kLatencyOn;
+}
+
+const char* TMSerialPort::LowLatencyState() {
+    switch (latencyState) {
+        case kLatencyOn:            return "on";
+        case kLatencyUnavailable:   return "not available";
+    }
+    return "off";
+}
+
+//
+// ApplyLowLatency()
+//
+// On Linux this sets ASYNC_LOW_LATENCY, which makes the tty layer
+// push each read straight through, and which ftdi_sio turns into
+// a 1ms latency timer (the default is 16ms). The flag is read back
+// afterward, since some drivers accept the call and ignore it.
+//
+// On OS X the driver is told to report data after 1us.
+//
+// Anything else, including a pty, reports "not available."
+//
+void TMSerialPort::ApplyLowLatency() {
+    latencyState = kLatencyOff;
+
+    if (!lowLatency || !IsOpen())
+        return;
+
+    latencyState = kLatencyUnavailable;
+
+#if defined(__linux__) && defined(TIOCGSERIAL) && defined(ASYNC_LOW_LATENCY)
+
+    struct serial_struct serinfo;
+
+    if (ioctl(fd, TIOCGSERIAL, &serinfo) == kSerialError)
+        return;
+
+    if (savedSerialFlags == -1)
+        savedSerialFlags = serinfo.flags;
+
+    serinfo.flags |= ASYNC_LOW_LATENCY;
+
+    if (ioctl(fd, TIOCSSERIAL, &serinfo) == kSerialError) {
+        if (output != NULL)
+            fprintf(output, "Error setting low latency on %s - %s(%d).\n", deviceFilePath, strerror(errno), errno);
+        return;
+    }
+
+    if (ioctl(fd, TIOCGSERIAL, &serinfo) != kSerialError && (serinfo.flags & ASYNC_LOW_LATENCY))
+        latencyState = kLatencyOn;
+
+#elif defined(IOSSDATALAT)
+
+    unsigned long mics = 1;
+
+    if (ioctl(fd, IOSSDATALAT, &mics) != kSerialError)
+        latencyState = kLatencyOn;
+
+#endif
+}
+
+//
+// RestoreLatency()
+// Put the driver flags back the way they were found
+//
+void TMSerialPort::RestoreLatency() {
+#if defined(__linux__) && defined(TIOCGSERIAL) && defined(ASYNC_LOW_LATENCY)
+    struct serial_struct serinfo;
+
+    if (savedSerialFlags != -1 && !(savedSerialFlags & ASYNC_LOW_LATENCY) && ioctl(fd, TIOCGSERIAL, &serinfo) != kSerialError) {
+        serinfo.flags &= ~ASYNC_LOW_LATENCY;
+        (void)ioctl(fd, TIOCSSERIAL, &serinfo);
+    }
+#endif
+
+    savedSerialFlags = -1;
+}
+
 //
 // CloseSerialPort()
 //
@@ -322,9 +547,13 @@ void TMSerialPort::Close() {
         if (tcsetattr(fd, TCSANOW, &originalAttribs) == kSerialError && output != NULL)
             fprintf(output, "Error resetting tty attributes - %s(%d).\n", strerror(errno), errno);
 
+        RestoreLatency();
+
         close(fd);
         fd = kSerialError;
     }
+
+    aheadStart = aheadEnd = 0;
 }
 
 //
@@ -335,7 +564,7 @@ void TMSerialPort::Close() {
 //
 // Returns n > 0 on success
 //
-int TMSerialPort::Select(__darwin_suseconds_t usec) {
+int TMSerialPort::Select(suseconds_t usec) {
     if (!IsOpen()) return -1;
 
     fd_set          inputList;      // A file descriptor set
@@ -348,6 +577,7 @@ int TMSerialPort::Select(__darwin_suseconds_t usec) {
 
     // look for ready ports up to and including ours
     int n = select(fd + 1, &inputList, NULL, NULL, &timeout);
+    selectCalls++;
 
     if (n < 0) {
         // n < 0 when select fails
@@ -362,6 +592,10 @@ int TMSerialPort::Select(__darwin_suseconds_t usec) {
         n = 0;
     }
 
+    // With packet reads a short reply doesn't wake select
+    if (n == 0 && packetBytes > 1 && BytesOnPort() > 0)
+        n = 1;
+
     return n;
 }
 
@@ -369,96 +603,174 @@ int TMSerialPort::Select(__darwin_suseconds_t usec) {
 //
 // Read(buffer, maxlen)
 //
+// Anything left in the read-ahead buffer comes first.
+// Otherwise read straight into the caller's buffer.
+//
 int TMSerialPort::Read(char *buffer, int maxlen) {
+    int held = Buffered();
+
+    if (held > 0) {
+        if (held > maxlen) held = maxlen;
+        memcpy(buffer, ahead + aheadStart, held);
+        aheadStart += held;
+        return held;
+    }
+
+    readCalls++;
     return (int)read(fd, buffer, maxlen);
 }
 
+//
+// Fill(timeout)
+//
+// Make sure there are bytes in the read-ahead buffer,
+// waiting up to the timeout for some to arrive.
+// Returns the number of bytes buffered, or an error.
+//
+int TMSerialPort::Fill(suseconds_t usec) {
+    if (Buffered() > 0)
+        return Buffered();
+
+    aheadStart = aheadEnd = 0;
+
+    if (Select(usec) <= 0)
+        return 0;
+
+    // A blocking read with packet reads on waits for a whole packet
+    int want = kReadAheadSize;
+    if (packetBytes > 1) {
+        int waiting = BytesOnPort();
+        if (waiting > 0 && waiting < want) want = waiting;
+    }
+
+    readCalls++;
+    int numBytes = (int)read(fd, ahead, want);
+
+    if (numBytes > 0)
+        aheadEnd = numBytes;
+
+    return numBytes;
+}
+
 
 //
-// Flush()
+// Flush([deadline])
 //
-int TMSerialPort::Flush() {
+// Throw away whatever has arrived and hasn't been taken yet.
+// If the driver can't flush, read the bytes off instead, but
+// only until the deadline, since a tablet that's sending will
+// never let the port go quiet. Returns the bytes thrown away.
+//
+int TMSerialPort::Flush(suseconds_t usec) {
     if (!IsOpen()) return -1;
 
-    char            ch[16];
-    fd_set          fdsRead;
-    struct timeval  timeout;
+    int held = Buffered();
+    int discarded = BytesOnPort();      // Includes the read-ahead
+    aheadStart = aheadEnd = 0;
 
-    if (tcflush(fd, TCIFLUSH) == 0)
-        return 0;
+    if (tcflush(fd, TCIFLUSH) == 0) {
+        flushedBytes += discarded;
+        return discarded;
+    }
+
+    discarded = held;
 
-    timeout.tv_sec = 0;
-    timeout.tv_usec = 0;
+    struct timeval  now, end;
+    (void)gettimeofday(&end, NULL);
+    end.tv_usec += usec;
+    end.tv_sec += end.tv_usec / 1000000;
+    end.tv_usec %= 1000000;
 
     while (1) {
+        fd_set          fdsRead;
+        struct timeval  timeout = { 0, 0 };
+
         FD_ZERO(&fdsRead);
         FD_SET(fd, &fdsRead);
-        if (select(FD_SETSIZE, &fdsRead, NULL, NULL, &timeout) <= 0)
+        selectCalls++;
+        if (select(fd+1, &fdsRead, NULL, NULL, &timeout) <= 0)
+            break;
+
+        (void)gettimeofday(&now, NULL);
+        if (timercmp(&now, &end, >=)) {
+            flushTimeouts++;
+            break;
+        }
+
+        // Never more than is waiting, so a packet read can't block
+        int want = BytesOnPort();
+        if (want <= 0) want = 1;
+        if (want > kReadAheadSize) want = kReadAheadSize;
+
+        readCalls++;
+        int got = (int)read(fd, ahead, want);
+        if (got <= 0)
             break;
-        read(fd, &ch, sizeof(ch));
+
+        discarded += got;
     }
 
-    return 0;
+    flushedBytes += discarded;
+    return discarded;
+}
+
+//
+// Drain()
+// Wait until everything written has gone out, as before a speed change
+//
+int TMSerialPort::Drain() {
+    if (!IsOpen()) return -1;
+    return tcdrain(fd);
 }
 
 
 //
 // ReadLine(buffer, maxlen [,timeout])
 //
-int TMSerialPort::ReadLine(char *buffer, int maxlen, __darwin_suseconds_t usec) {
-    int     numBytes = 0;
-    char    *bufPtr = buffer;
+int TMSerialPort::ReadLine(char *buffer, int maxlen, suseconds_t usec) {
+    char    *bufPtr = buffer, *bufEnd = buffer + maxlen - 1;
     bool    gotLine = false, in_packet = false;
 
     // Loop while bytes await
-    while (!gotLine && Select(usec) > 0) {
-        // Loop through bytes received
-        while (!gotLine && BytesOnPort()) {
-            char temp[1];
-            numBytes = Read(temp, 1);
+    while (!gotLine) {
+        int numBytes = Fill(usec);
 
-            if (numBytes > 0) {
-                char c = temp[0];
+        if (numBytes <= 0) {
+            if (numBytes == kSerialError && output != NULL)
+                fprintf(output, "[ERR ] (%d) %s\n", errno, strerror(errno));
+            break;
+        }
 
-                if ((c & 0x80) != 0) {
-                    in_packet = true;
+        // Loop through the bytes received
+        while (!gotLine && aheadStart < aheadEnd) {
+            char c = ahead[aheadStart++];
+
+            if ((c & 0x80) != 0) {
+                in_packet = true;
 #if LOG_STREAM_TO_FILE
-                    fprintf(logfile, "\n");
+                fprintf(logfile, "\n");
 #endif
-                }
-                else if (c == '~') {
-                    in_packet = false;
-                    bufPtr = buffer;
+            }
+            else if (c == '~') {
+                in_packet = false;
+                bufPtr = buffer;
 #if LOG_STREAM_TO_FILE
-                    fprintf(logfile, "\n");
+                fprintf(logfile, "\n");
 #endif
-                }
+            }
 
 #if LOG_STREAM_TO_FILE
-                short b = ((short)c) & 0x00FF;
-                fprintf(logfile, "-%02X", b);
+            short b = ((short)c) & 0x00FF;
+            fprintf(logfile, "-%02X", b);
 #endif
 
-                if (!in_packet) {
-                    *bufPtr = c;
-                    if (c == '\n' || c == '\r')
-                        gotLine = true;
-                    else
-                        bufPtr++;
-                }
-            }
-            else {
-                gotLine = true;
-                if (output != NULL) {
-                    if (numBytes == 0)
-                        fprintf(output, "[ERR ] No line waiting on the serial port\n");
-                    else if (numBytes == kSerialError)
-                        fprintf(output, "[ERR ] (%d) %s\n", errno, strerror(errno));
-                }
+            if (!in_packet) {
+                if (c == '\n' || c == '\r')
+                    gotLine = true;
+                else if (bufPtr < bufEnd)
+                    *bufPtr++ = c;
             }
-
         }
-
     }
 
     *bufPtr = '\0';
@@ -470,6 +782,23 @@ int TMSerialPort::ReadLine(char *buffer, int maxlen, __darwin_suseconds_t usec)
     return (int)strlen(buffer);
 }
 
+//
+// ReadPacket(buffer, size [,timeout])
+//
+// Read a binary reply of a known size, such as the TabletPC
+// query reply, which ReadLine would skip over.
+//
+int TMSerialPort::ReadPacket(char *buffer, int size, suseconds_t usec) {
+    int count = 0;
+
+    while (count < size && Fill(usec) > 0) {
+        int numBytes = Read(buffer + count, size - count);
+        count += numBytes;
+    }
+
+    return count;
+}
+
 int TMSerialPort::Write(char *buffer, int length) {
     return (int)write(fd, buffer, length);
 }
@@ -483,122 +812,20 @@ int TMSerialPort::WriteString(char *string) {
 // How many bytes are waiting on the serial port?
 //
 int TMSerialPort::BytesOnPort() {
-    int bytes;
+    int bytes = 0;
     ioctl(fd, FIONREAD, &bytes);
-    return bytes;
+    ioctlCalls++;
+    return bytes + Buffered();
 }
 
 #pragma mark -
 
-//
-// BeginPortScan(RS232Only?)
-//
-// Prepare a list of ports (i.e., that could have a tablet attached)
-// The result is stored in the tablet object's serialPortIterator data member
-// for use by FindTabletOnPort.
-//
-// Once again, thanks be to Apple for the samples.
-//
-kern_return_t TMSerialPort::BeginPortScan(bool RS232Only) {
-    EndPortScan();
-
-    kern_return_t           kernResult;
-    mach_port_t             masterPort;
-    CFMutableDictionaryRef  classesToMatch;
-
-    //
-    // Get the masterPort, whatever that is
-    //
-    kernResult = IOMasterPort(MACH_PORT_NULL, &masterPort);
-    if (KERN_SUCCESS != kernResult) {
-        if (output != NULL)
-            fprintf(output, "IOMasterPort returned %d\n", kernResult);
-        goto exit;
-    }
-
-    //
-    // Serial devices are instances of class IOSerialBSDClient.
-    // Here I search for ports with RS232Type because with my
-    // Keyspan USB-Serial adapter the first port shows up
-    //
-    classesToMatch = IOServiceMatching(kIOSerialBSDServiceValue);
-    if (classesToMatch == NULL) {
-        if (output != NULL)
-            fprintf(output, "No BSD Serial Service?\n");
-    }
-    else
-        CFDictionarySetValue(classesToMatch, CFSTR(kIOSerialBSDTypeKey), RS232Only ? CFSTR(kIOSerialBSDRS232Type) : CFSTR(kIOSerialBSDAllTypes));
-
-    //
-    // Find the next matching service
-    //
-    kernResult = IOServiceGetMatchingServices(masterPort, classesToMatch, &serialPortIterator);
-    if (KERN_SUCCESS != kernResult) {
-        if (output != NULL)
-            fprintf(output, "IOServiceGetMatchingServices returned %d\n", kernResult);
-        goto exit;
-    }
-
-exit:
-    return kernResult;
-}
-
-void TMSerialPort::EndPortScan() {
-    if (serialPortIterator != 0) {
-        IOObjectRelease(serialPortIterator);
-        serialPortIterator = 0;
-    }
-}
-
-bool TMSerialPort::HasValidIterator() {
-    return (serialPortIterator != 0) && IOIteratorIsValid(serialPortIterator);
-}
-
 //
 // GetNextPortPath
 // Get the path in /dev that represents the next eligible port.
 //
-// Muchas gracias to Apple for this code.
-//
-kern_return_t TMSerialPort::GetNextPortPath() {
-    io_object_t     portService;
-    kern_return_t   kernResult = KERN_FAILURE;
-
-    clearstr(deviceFilePath);
-
-    // Keep iterating until successful
-    while ((portService = IOIteratorNext(serialPortIterator))) {
-        CFTypeRef   deviceFilePathAsCFString;
-
-        // Get the callout device's path (/dev/cu.xxxxx).
-        deviceFilePathAsCFString = IORegistryEntryCreateCFProperty(
-                                                                   portService,
-                                                                   CFSTR(kIOCalloutDeviceKey),
-                                                                   kCFAllocatorDefault,
-                                                                   0);
-
-        if (deviceFilePathAsCFString) {
-            Boolean result;
-
-            // Convert the path from CFString to C string
-            result = CFStringGetCString((CFStringRef)deviceFilePathAsCFString,
-                                        deviceFilePath,
-                                        sizeof(deviceFilePath),
-                                        kCFStringEncodingASCII);
-
-            CFRelease(deviceFilePathAsCFString);
-
-            if (result) {
-                kernResult = KERN_SUCCESS;
-                break;
-            }
-        }
-
-        // Release the io_service_t now that we are done with it.
-        (void) IOObjectRelease(portService);
-    }
-
-    return kernResult;
+bool TMSerialPort::GetNextPortPath() {
+    return scanner.Next(deviceFilePath, sizeof(deviceFilePath));
 }
 
 //
@@ -615,7 +842,7 @@ bool TMSerialPort::OpenNextMatchingPort(char *portname) {
     bool success = false;
 
     // Loop until success, the iterator dies, or we run out of paths
-    while (!success && HasValidIterator() && GetNextPortPath() != KERN_FAILURE) {
+    while (!success && HasValidIterator() && GetNextPortPath()) {
         // Try the port if it matches the argument
         if ( portname == NULL || portname[0] == '\0' || NULL != strstr(deviceFilePath, portname) ) {
             // Try to open the serial port
@@ -30,15 +30,39 @@
 
 class TabletSettings;
 
+#include "TMPortScanner.h"
+
 #include <sys/param.h>
+#include <sys/types.h>
 #include <termios.h>
 
+#define kReadAheadSize	1024			//!< Bytes read from the port at a time
+#define kFlushDeadline	50000			//!< Longest a Flush may spend reading (us)
+
+enum {
+	kLatencyOff,						//!< Not asked for
+	kLatencyOn,							//!< The driver took it
+	kLatencyUnavailable					//!< Asked for, but the driver can't or won't
+};
+
 //===================================================================
 //
 //  TMSerialPort
 //
 //  This class models a serial port
 //
+//  Only termios is used here, so it works with any POSIX tty.
+//  Finding the ports is left to TMPortScanner.
+//
+//  Reads go through a small read-ahead buffer, so ReadLine and
+//  ReadPacket take whole chunks from the port and pick the bytes
+//  out in memory. Whatever is left over is served first by the
+//  next Read, so nothing is lost to the framer.
+//
+//  Low latency mode asks the driver to pass bytes along as soon
+//  as they arrive instead of holding them for a timer. USB-serial
+//  adapters otherwise sit on a packet for up to 16ms.
+//
 //===================================================================
 
 class TMSerialPort {
@@ -48,7 +72,7 @@ private:
 	char			deviceFilePath[MAXPATHLEN];
 	char			shortName[MAXPATHLEN];
 	struct termios  originalAttribs;
-	io_iterator_t	serialPortIterator;
+	TMPortScanner	scanner;
 
 	speed_t			openSpeed;
 	tcflag_t		openDataBits;
@@ -57,9 +81,32 @@ private:
 	bool			openCTS;
 	bool			openDSR;
 
+	char			ahead[kReadAheadSize];	//!< Bytes read but not yet taken
+	int				aheadStart, aheadEnd;
+
+	int				packetBytes;		//!< VMIN while packet reads are on (0 = off)
+	bool			errorMarks;			//!< Mark bytes with line errors (PARMRK)
+
+	bool			lowLatency;			//!< Ask the driver to pass bytes on at once
+	int				latencyState;		//!< What the driver made of it
+	int				savedSerialFlags;	//!< Driver flags to put back on Close (-1 = untouched)
+
 	FILE			*output;
 
+	int				Fill(suseconds_t usec);
+	void			SetReadTimes(struct termios *attribs);
+	void			SetErrorFlags(struct termios *attribs);
+	void			ApplyLowLatency();
+	void			RestoreLatency();
+
 public:
+	// Counters, for measuring the cost of reading
+	unsigned long	selectCalls;
+	unsigned long	readCalls;
+	unsigned long	ioctlCalls;
+	unsigned long	flushedBytes;		//!< Bytes thrown away by Flush
+	unsigned long	flushTimeouts;		//!< Flushes that ran out of time with bytes still coming
+
 	TMSerialPort();
 	~TMSerialPort();
 
@@ -67,14 +114,19 @@ public:
 	inline char*	DeviceFilePath()	{ return deviceFilePath; } 
 	inline bool		IsOpen()			{ return fd != kSerialError; }
 	inline bool		IsActive()			{ return IsOpen(); } 
-	inline void		SetOutput(FILE *f)	{ output = f; }
+	inline void		SetOutput(FILE *f)	{ output = f; scanner.SetOutput(f); }
+	inline int		Buffered()			{ return aheadEnd - aheadStart; }
+	inline unsigned long Syscalls()		{ return selectCalls + readCalls + ioctlCalls; }
+	inline void		ResetCounters()		{ selectCalls = readCalls = ioctlCalls = flushedBytes = flushTimeouts = 0; }
 
 	int				Open(char *filepath=NULL);
 	void			Close();
-	int				Flush();
-	int				Select(__darwin_suseconds_t usec=4000);
+	int				Flush(suseconds_t usec=kFlushDeadline);
+	int				Drain();
+	int				Select(suseconds_t usec=4000);
 	int				Read(char *buffer, int maxlen);
-	int				ReadLine(char *buffer, int maxlen, __darwin_suseconds_t usec=4000);
+	int				ReadLine(char *buffer, int maxlen, suseconds_t usec=4000);
+	int				ReadPacket(char *buffer, int size, suseconds_t usec=4000);
 	int				Write(char *buffer, int length);
 	int				WriteString(char *string);
 	int				BytesOnPort();
@@ -92,6 +144,18 @@ public:
 	inline bool		SetDSR(bool b)				{ openDSR = b; return ApplySettings(); }
 	bool			ApplySettings();
 
+	bool			SetPacketReads(int size);
+	inline int		PacketReads()				{ return packetBytes; }
+	suseconds_t		PacketTimeout();
+	static long		BaudValue(speed_t speed);
+
+	bool			SetErrorMarks(bool on);
+	inline bool		ErrorMarks()				{ return errorMarks; }
+
+	bool			SetLowLatency(bool on);
+	inline bool		LowLatency()				{ return latencyState == kLatencyOn; }
+	const char*		LowLatencyState();
+
 	inline char*	Name()						{ return shortName; }
 	inline speed_t	Speed()						{ return openSpeed; }
 	inline tcflag_t	DataBits()					{ return openDataBits; }
@@ -100,10 +164,10 @@ public:
 	inline bool		CTS()						{ return openCTS; }
 	inline bool		DSR()						{ return openDSR; }
 
-	bool			HasValidIterator();
-	void			EndPortScan();
-	kern_return_t	BeginPortScan(bool RS232Only=false);
-	kern_return_t	GetNextPortPath();
+	inline bool		HasValidIterator()			{ return scanner.IsValid(); }
+	inline void		EndPortScan()				{ scanner.End(); }
+	inline bool		BeginPortScan(char *portname=NULL, bool RS232Only=false) { return scanner.Begin(portname, RS232Only); }
+	bool			GetNextPortPath();
 	bool			OpenNextMatchingPort(char *portname=NULL);
 };
 
@@ -0,0 +1,323 @@
+/**
+ * TMSerialReader.cpp
+ *
+ * TabletMagicDaemon
+ * Thinkyhead Software
+ *
+ * This program is a component of TabletMagic. See the
+ * accompanying documentation for more details about the
+ * TabletMagic project.
+ *
+ * LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "TMSerialReader.h"
+#include "TMSerialPort.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/select.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+TMSerialReader::TMSerialReader() {
+    port = NULL;
+    fd = -1;
+    packetBytes = 0;
+    packetTimeout = 0;
+    running = false;
+    hungUp = false;
+    notifyPending = 0;
+    output = NULL;
+    controlPipe[0] = controlPipe[1] = -1;
+    notifyPipe[0] = notifyPipe[1] = -1;
+    ResetCounters();
+}
+
+TMSerialReader::~TMSerialReader() {
+    Stop();
+
+    for (int i=0; i<2; i++) {
+        if (controlPipe[i] != -1) close(controlPipe[i]);
+        if (notifyPipe[i] != -1) close(notifyPipe[i]);
+    }
+}
+
+void TMSerialReader::ResetCounters() {
+    bytesRead = chunksRead = bytesDropped = 0;
+    overflows = highWater = maxLatency = 0;
+}
+
+uint64_t TMSerialReader::Microseconds() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+//
+// Start(port)
+//
+// Start reading the given (open) port on a new thread.
+// The pipes are created on the first call and reused.
+//
+bool TMSerialReader::Start(TMSerialPort *p) {
+    Stop();
+
+    if (p == NULL || !p->IsOpen())
+        return false;
+
+    if (notifyPipe[0] == -1) {
+        if (pipe(controlPipe) != 0 || pipe(notifyPipe) != 0) {
+            if (output != NULL)
+                fprintf(output, "[ERR ] Can't create reader pipes - %s(%d).\n", strerror(errno), errno);
+            return false;
+        }
+
+        for (int i=0; i<2; i++) {
+            fcntl(controlPipe[i], F_SETFL, O_NONBLOCK);
+            fcntl(notifyPipe[i], F_SETFL, O_NONBLOCK);
+        }
+    }
+
+    port = p;
+    fd = p->FileDevice();
+    packetBytes = p->PacketReads();
+    packetTimeout = p->PacketTimeout();
+    hungUp = false;
+    notifyPending = 0;
+    ring.Reset();
+
+    // The thread reads the port directly, so hand it anything
+    // already taken into the port's read-ahead
+    int held = p->Buffered();
+    if (held > 0) {
+        char ahead[kChunkSize];
+        while (held > 0) {
+            int len = p->Read(ahead, held < kChunkSize ? held : kChunkSize);
+            if (len <= 0 || !Queue(ahead, len)) break;
+            held -= len;
+        }
+        notifyPending = 1;
+        char c = 'r';
+        (void)write(notifyPipe[1], &c, 1);
+    }
+
+    if (pthread_create(&thread, NULL, TMSerialReader::ThreadEntry, this) != 0) {
+        if (output != NULL)
+            fprintf(output, "[ERR ] Can't start the reader thread - %s(%d).\n", strerror(errno), errno);
+        return false;
+    }
+
+    running = true;
+    return true;
+}
+
+//
+// Stop()
+//
+// Stop the thread and wait for it to exit. Chunks already
+// in the ring are left there for the consumer to drain.
+//
+void TMSerialReader::Stop() {
+    if (!running) return;
+
+    char c = 'x';
+    (void)write(controlPipe[1], &c, 1);
+    pthread_join(thread, NULL);
+
+    // Discard the stop request
+    while (read(controlPipe[0], &c, 1) > 0) { }
+
+    running = false;
+}
+
+void* TMSerialReader::ThreadEntry(void *arg) {
+    ((TMSerialReader*)arg)->Run();
+    return NULL;
+}
+
+//
+// BytesWaiting()
+// The bytes the driver holds, asked of it directly
+//
+int TMSerialReader::BytesWaiting() {
+    int bytes = 0;
+    return (ioctl(fd, FIONREAD, &bytes) == 0) ? bytes : 0;
+}
+
+//
+// Queue(data, len)
+// Copy bytes into the next free chunk, before the thread runs
+//
+bool TMSerialReader::Queue(const char *data, int len) {
+    TMSerialChunk *slot = ring.WriteSlot();
+    if (slot == NULL)
+        return false;
+
+    memcpy(slot->data, data, len);
+    slot->length = len;
+    slot->stamp = Microseconds();
+    ring.Commit();
+
+    Bump(&bytesRead, (uint64_t)len);
+    Bump(&chunksRead, (uint64_t)1);
+    return true;
+}
+
+//
+// Run()
+//
+// The thread body. Blocks in select() until the port or the
+// control pipe is readable, so it only runs when data arrives.
+//
+void TMSerialReader::Run() {
+    struct sched_param  sp;
+    int                 policy;
+
+    // Ask for a real-time priority. This needs root, which the daemon has.
+    if (pthread_getschedparam(pthread_self(), &policy, &sp) == 0) {
+        sp.sched_priority = sched_get_priority_max(SCHED_RR);
+        if (pthread_setschedparam(pthread_self(), SCHED_RR, &sp) != 0 && output != NULL)
+            fprintf(output, "[READ] Reader thread is running at normal priority\n");
+    }
+
+    int pfd = fd, cfd = controlPipe[0];
+    int maxfd = (pfd > cfd ? pfd : cfd) + 1;
+
+    bool tail = false;
+
+    while (true) {
+        fd_set inputList;
+        FD_ZERO(&inputList);
+        FD_SET(pfd, &inputList);
+        FD_SET(cfd, &inputList);
+
+        // With packet reads a partial packet doesn't make the port
+        // readable, so look again soon after data, and now and then
+        // otherwise for short replies.
+        struct timeval timeout, *wait = NULL;
+        if (packetBytes > 1) {
+            timeout.tv_sec = 0;
+            timeout.tv_usec = tail ? packetTimeout : kIdlePoll;
+            wait = &timeout;
+        }
+
+        int n = select(maxfd, &inputList, NULL, NULL, wait);
+
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            __atomic_store_n(&hungUp, true, __ATOMIC_RELEASE);
+            break;
+        }
+
+        if (n > 0 && FD_ISSET(cfd, &inputList))
+            break;
+
+        tail = (n > 0);
+
+        // After a timeout read only what's there, since a blocking
+        // read with packet reads waits for a whole packet
+        int want = kChunkSize;
+        if (n == 0) {
+            int waiting = BytesWaiting();
+            if (waiting == 0) continue;
+            if (waiting < want) want = waiting;
+        }
+        else if (!FD_ISSET(pfd, &inputList))
+            continue;
+
+        TMSerialChunk *slot = ring.WriteSlot();
+
+        if (slot == NULL) {
+            // The consumer is behind. The bytes must still be read
+            // to keep select() from spinning, so count what's lost.
+            char scratch[kChunkSize];
+            int lost = (int)read(pfd, scratch, want);
+            if (lost > 0) {
+                Bump(&bytesDropped, (uint64_t)lost);
+                Bump(&overflows, (uint32_t)1);
+            }
+            continue;
+        }
+
+        int len = (int)read(pfd, slot->data, want);
+
+        if (len > 0) {
+            slot->length = len;
+            slot->stamp = Microseconds();
+            ring.Commit();
+
+            Bump(&bytesRead, (uint64_t)len);
+            Bump(&chunksRead, (uint64_t)1);
+
+            uint32_t waiting = ring.Count();
+            if (waiting > highWater)
+                __atomic_store_n(&highWater, waiting, __ATOMIC_RELAXED);
+        }
+        else if (len == 0 || (errno != EAGAIN && errno != EINTR)) {
+            __atomic_store_n(&hungUp, true, __ATOMIC_RELEASE);
+            break;
+        }
+        else
+            continue;
+
+        // Wake the consumer unless a wakeup is already on its way
+        if (__atomic_exchange_n(&notifyPending, 1, __ATOMIC_SEQ_CST) == 0) {
+            char c = 'r';
+            (void)write(notifyPipe[1], &c, 1);
+        }
+    }
+
+    // Always wake the consumer on exit so a hangup gets noticed
+    char c = 'x';
+    (void)write(notifyPipe[1], &c, 1);
+}
+
+//
+// AcknowledgeNotify()
+//
+// The consumer calls this on wakeup, before draining the ring,
+// so chunks committed during the drain trigger a new wakeup.
+//
+void TMSerialReader::AcknowledgeNotify() {
+    char c[16];
+    __atomic_store_n(&notifyPending, 0, __ATOMIC_SEQ_CST);
+    while (read(notifyPipe[0], c, sizeof(c)) > 0) { }
+}
+
+//
+// NextChunk() / ReleaseChunk()
+//
+// Consumer access to the ring. Also tracks the queue latency.
+//
+TMSerialChunk* TMSerialReader::NextChunk() {
+    TMSerialChunk *chunk = ring.ReadSlot();
+
+    if (chunk != NULL) {
+        uint32_t wait = (uint32_t)(Microseconds() - chunk->stamp);
+        if (wait > maxLatency) maxLatency = wait;
+    }
+
+    return chunk;
+}
+
+void TMSerialReader::ReleaseChunk() {
+    ring.Release();
+}
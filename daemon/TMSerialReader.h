@@ -0,0 +1,126 @@
+/**
+ * TMSerialReader.h
+ *
+ * TabletMagicDaemon
+ * Thinkyhead Software
+ *
+ * This program is a component of TabletMagic. See the
+ * accompanying documentation for more details about the
+ * TabletMagic project.
+ *
+ * LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __TMSERIALREADER_H__
+#define __TMSERIALREADER_H__
+
+#include "TMByteRing.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+#define kIdlePoll       50000       //!< With packet reads, how often to look for short replies (us)
+
+class TMSerialPort;
+
+//===================================================================
+//
+//  TMSerialReader
+//
+//  Reads the serial port on its own high-priority thread so that
+//  slow work on the main run loop can't hold up packet intake.
+//  Chunks are timestamped and queued in a TMByteRing, and a byte
+//  is written to NotifyDevice() to wake the main thread.
+//
+//  The thread reads the file descriptor directly and never calls
+//  into the TMSerialPort, whose read-ahead and counters belong to
+//  the main thread. The read mode is taken when the thread starts.
+//  Counters the thread keeps are published with atomic stores, so
+//  the main thread reads them through the accessors.
+//
+//  The reader must be stopped before anything else reads the port
+//  (modal requests, flushes) and before the port is closed.
+//
+//===================================================================
+
+class TMSerialReader {
+
+private:
+    TMSerialPort    *port;
+    int             fd;                 //!< The port's file descriptor
+    int             packetBytes;        //!< The port's packet reads, at Start
+    suseconds_t     packetTimeout;      //!< And the matching tail timeout
+    TMByteRing      ring;
+    pthread_t       thread;
+    bool            running;
+    int             controlPipe[2];     //!< Tells the thread to exit
+    int             notifyPipe[2];      //!< Wakes the consumer
+    uint32_t        notifyPending;      //!< Set while a wakeup is unhandled
+    bool            hungUp;             //!< The port returned EOF or an error
+
+    FILE            *output;
+
+    // Counters, for proving that nothing was lost. All but
+    // maxLatency are written by the thread.
+    uint64_t        bytesRead;          //!< Bytes read from the port
+    uint64_t        chunksRead;         //!< Reads that returned data
+    uint64_t        bytesDropped;       //!< Bytes discarded because the ring was full
+    uint32_t        overflows;          //!< Number of reads that found the ring full
+    uint32_t        highWater;          //!< Most chunks ever waiting in the ring
+    uint32_t        maxLatency;         //!< Longest time a chunk waited (microseconds)
+
+    void            Run();
+    int             BytesWaiting();
+    bool            Queue(const char *data, int len);
+    static void*    ThreadEntry(void *arg);
+
+    //! Only the thread writes, so a plain add published by a store will do
+    template <typename T>
+    static inline void Bump(T *counter, T n) {
+        __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + n, __ATOMIC_RELAXED);
+    }
+
+public:
+
+    TMSerialReader();
+    ~TMSerialReader();
+
+    bool            Start(TMSerialPort *p);
+    void            Stop();
+    void            ResetCounters();
+
+    inline bool     IsRunning()         { return running; }
+    inline bool     HungUp()            { return __atomic_load_n(&hungUp, __ATOMIC_ACQUIRE); }
+    inline int      NotifyDevice()      { return notifyPipe[0]; }
+    inline void     SetOutput(FILE *f)  { output = f; }
+
+    inline uint64_t BytesRead()         { return __atomic_load_n(&bytesRead, __ATOMIC_RELAXED); }
+    inline uint64_t ChunksRead()        { return __atomic_load_n(&chunksRead, __ATOMIC_RELAXED); }
+    inline uint64_t BytesDropped()      { return __atomic_load_n(&bytesDropped, __ATOMIC_RELAXED); }
+    inline uint32_t Overflows()         { return __atomic_load_n(&overflows, __ATOMIC_RELAXED); }
+    inline uint32_t HighWater()         { return __atomic_load_n(&highWater, __ATOMIC_RELAXED); }
+    inline uint32_t MaxLatency()        { return maxLatency; }
+
+    void            AcknowledgeNotify();
+    TMSerialChunk*  NextChunk();
+    void            ReleaseChunk();
+
+    static uint64_t Microseconds();
+};
+
+#endif
@@ -0,0 +1,173 @@
+/**
+ * TMStreamWatchdog.cpp
+ *
+ * TabletMagicDaemon
+ * Thinkyhead Software
+ *
+ * This program is a component of TabletMagic. See the
+ * accompanying documentation for more details about the
+ * TabletMagic project.
+ *
+ * LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "TMStreamWatchdog.h"
+
+TMStreamWatchdog::TMStreamWatchdog() {
+    Reset(0);
+    stalls = garbles = 0;
+    lastRecovery = maxRecovery = 0;
+    lineErrors = errorsPerSecond = 0;
+}
+
+//
+// Reset(now)
+// Start watching a newly initialized stream
+//
+void TMStreamWatchdog::Reset(double now) {
+    lastBytes = lastCommand = windowStart = now;
+    lastResync = now - kResyncHoldoff;
+    detectedAt = now;
+    windowBad = 0;
+    backoff = 0;
+    recovering = false;
+    errorSecond = now;
+    errorsThisSecond = 0;
+}
+
+//
+// Allowed(now)
+//
+// Resyncing over and over won't help a tablet at the wrong
+// speed, so the wait after each one that didn't work doubles.
+//
+bool TMStreamWatchdog::Allowed(double now) {
+    return now - lastResync >= kResyncHoldoff * (1 << backoff);
+}
+
+//
+// Bytes(bad, now)
+//
+// Called after each run of bytes is framed, with the number
+// of phrases the framer had to throw away. Right after a
+// command the stream is expected to be a bit ragged.
+//
+StreamVerdict TMStreamWatchdog::Bytes(int bad, double now) {
+    lastBytes = now;
+
+    if (bad <= 0 || now - lastCommand < kReplyGrace)
+        return kStreamOK;
+
+    if (now - windowStart > kGarbageWindow) {
+        windowStart = now;
+        windowBad = 0;
+    }
+
+    windowBad += bad;
+
+    if (windowBad < kGarbageLimit || !Allowed(now))
+        return kStreamOK;
+
+    return kStreamGarbled;
+}
+
+//
+// LineErrors(errors, now)
+//
+// Count framing and parity errors (termios can't tell them
+// apart) by the second. Returns true when a second that had
+// errors is over, so the caller can report errorsPerSecond.
+// A steady rate means the speed or parity is wrong.
+//
+bool TMStreamWatchdog::LineErrors(int errors, double now) {
+    bool done = false;
+
+    if (now - errorSecond >= 1.0) {
+        if (errorsThisSecond) {
+            errorsPerSecond = errorsThisSecond;
+            done = true;
+        }
+        errorSecond = now;
+        errorsThisSecond = 0;
+    }
+
+    errorsThisSecond += errors;
+    lineErrors += errors;
+
+    return done;
+}
+
+//
+// Reply(now)
+// A reply long after the last command is garbage too
+//
+StreamVerdict TMStreamWatchdog::Reply(double now) {
+    return (now - lastCommand > kReplyGrace) ? Bytes(1, now) : kStreamOK;
+}
+
+//
+// Check(pending, now)
+// Called when a partial phrase may have been left behind
+//
+StreamVerdict TMStreamWatchdog::Check(bool pending, double now) {
+    if (pending && now >= StallDeadline() && Allowed(now))
+        return kStreamStalled;
+
+    return kStreamOK;
+}
+
+//
+// Resynced(why, now)
+// The caller has restarted the stream
+//
+void TMStreamWatchdog::Resynced(StreamVerdict why, double now) {
+    if (why == kStreamStalled)
+        stalls++;
+    else
+        garbles++;
+
+    if (recovering) {
+        if (backoff < kResyncMaxBackoff)
+            backoff++;
+    }
+    else
+        detectedAt = now;
+
+    lastResync = lastBytes = lastCommand = windowStart = now;
+    windowBad = 0;
+    recovering = true;
+}
+
+//
+// Packet(now)
+//
+// Called for each good packet. Returns true when it ends a
+// recovery, so the caller can report how long it took.
+//
+bool TMStreamWatchdog::Packet(double now) {
+    if (!recovering)
+        return false;
+
+    recovering = false;
+    backoff = 0;
+
+    lastRecovery = (now - detectedAt) * 1000.0;
+    if (lastRecovery > maxRecovery)
+        maxRecovery = lastRecovery;
+
+    return true;
+}
@@ -0,0 +1,105 @@
+/**
+ * TMStreamWatchdog.h
+ *
+ * TabletMagicDaemon
+ * Thinkyhead Software
+ *
+ * This program is a component of TabletMagic. See the
+ * accompanying documentation for more details about the
+ * TabletMagic project.
+ *
+ * LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __TMSTREAMWATCHDOG_H__
+#define __TMSTREAMWATCHDOG_H__
+
+#define kStallTimeout       0.25        //!< Seconds a phrase may sit unfinished
+#define kHoldTimeout        0.05        //!< Seconds of quiet before a held TabletPC packet is let go
+#define kResyncSettle       0.05        //!< Seconds for bytes already on the way after a stop
+#define kGarbageWindow      1.0         //!< Seconds over which bad phrases are counted
+#define kGarbageLimit       8           //!< Bad phrases in one window that mean the stream is lost
+#define kReplyGrace         1.0         //!< Seconds after a command that a reply is expected
+#define kResyncHoldoff      2.0         //!< Seconds after a resync before another
+#define kResyncMaxBackoff   4           //!< Doublings of the holdoff while resyncs don't help
+
+//! What the watchdog thinks of the stream
+typedef enum {
+    kStreamOK,
+    kStreamStalled,                     //!< A phrase was started and never finished
+    kStreamGarbled                      //!< Too many phrases of the wrong size, or replies nobody asked for
+} StreamVerdict;
+
+//===================================================================
+//
+//  TMStreamWatchdog
+//
+//  Notices when the stream from the tablet has gone wrong, as it
+//  does when a USB-serial adapter drops a few bytes. Either the
+//  framer is left holding half a packet that never completes, or
+//  the bytes are out of step and every phrase is the wrong size.
+//  A whole TabletPC packet the framer is holding is not a stall.
+//
+//  Like the rate governor it only decides. Stopping, flushing and
+//  restarting the tablet is up to the caller, which reports back
+//  with Resynced. The next good packet ends the recovery, and the
+//  time it took is kept.
+//
+//===================================================================
+
+class TMStreamWatchdog {
+
+private:
+    double          lastBytes;          //!< When bytes last arrived
+    double          lastCommand;        //!< When a command was last sent
+    double          windowStart;        //!< Start of the bad phrase window
+    int             windowBad;          //!< Bad phrases so far in the window
+    double          lastResync;
+    double          detectedAt;         //!< When the current trouble was noticed
+    int             backoff;            //!< Resyncs in a row that didn't help
+    bool            recovering;         //!< A resync is waiting for a good packet
+    double          errorSecond;        //!< Start of the second being counted
+    unsigned long   errorsThisSecond;
+
+    bool            Allowed(double now);
+
+public:
+    unsigned long   stalls;             //!< Resyncs for a stalled phrase
+    unsigned long   garbles;            //!< Resyncs for garbage
+    double          lastRecovery;       //!< Milliseconds from detection to the next good packet
+    double          maxRecovery;
+    unsigned long   lineErrors;         //!< Framing and parity errors, all told
+    unsigned long   errorsPerSecond;    //!< Errors in the last second that had any
+
+    TMStreamWatchdog();
+
+    void            Reset(double now);
+
+    inline void     Sent(double now)    { lastCommand = now; }
+    StreamVerdict   Bytes(int bad, double now);
+    bool            LineErrors(int errors, double now);
+    StreamVerdict   Reply(double now);
+    StreamVerdict   Check(bool pending, double now);
+    void            Resynced(StreamVerdict why, double now);
+    bool            Packet(double now);
+
+    inline double   StallDeadline()     { return lastBytes + kStallTimeout; }
+    inline double   HoldDeadline()      { return lastBytes + kHoldTimeout; }
+    inline bool     Recovering()        { return recovering; }
+};
+
+#endif
@@ -0,0 +1,203 @@
+/**
+ * TMTabletProbe.cpp
+ *
+ * TabletMagicDaemon
+ * Thinkyhead Software
+ *
+ * This program is a component of TabletMagic. See the
+ * accompanying documentation for more details about the
+ * TabletMagic project.
+ *
+ * LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "TMTabletProbe.h"
+#include "TMPortScanner.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+TMTabletProbe::TMTabletProbe() {
+    workerCount = 0;
+    steps = NULL;
+    winner = -1;
+    foundModel = kModelUnknown;
+    foundSpeed = 0;
+    elapsed = 0;
+    output = NULL;
+}
+
+double TMTabletProbe::Milliseconds() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
+
+//
+// Run(portname, model_speeds)
+//
+// Probe every port matching portname (or all ports) at once,
+// trying each model / speed pair in turn. Returns when a port
+// has answered and the other workers have stopped, or when
+// every worker has run out of things to try.
+//
+bool TMTabletProbe::Run(char *portname, const int *model_speeds) {
+    double start = Milliseconds();
+
+    steps = model_speeds;
+    winner = -1;
+    workerCount = 0;
+
+    // Collect the candidate ports
+    TMPortScanner scanner;
+    scanner.SetOutput(output);
+
+    if (scanner.Begin(portname)) {
+        char path[MAXPATHLEN];
+        while (workerCount < kMaxProbePorts && scanner.Next(path, sizeof(path))) {
+            if (portname == NULL || portname[0] == '\0' || NULL != strstr(path, portname)) {
+                TMProbeWorker *w = &worker[workerCount++];
+                w->probe = this;
+                w->started = false;
+                w->msec = 0;
+                strcpy(w->path, path);
+            }
+        }
+        scanner.End();
+    }
+
+    // One thread per port
+    for (int i=0; i<workerCount; i++) {
+        TMProbeWorker *w = &worker[i];
+        w->started = (pthread_create(&w->thread, NULL, TMTabletProbe::WorkerThread, w) == 0);
+        if (!w->started) {
+            if (output != NULL)
+                fprintf(output, "[ERR ] Can't start a probe for %s - %s(%d).\n", w->path, strerror(errno), errno);
+            Probe(w);
+        }
+    }
+
+    for (int i=0; i<workerCount; i++)
+        if (worker[i].started)
+            pthread_join(worker[i].thread, NULL);
+
+    elapsed = Milliseconds() - start;
+
+    if (output != NULL) {
+        if (winner != -1)
+            fprintf(output, "[PROBE] Tablet answered on %s at %ld after %.0f ms (%d ports probed)\n", worker[winner].path, TMSerialPort::BaudValue(foundSpeed), worker[winner].msec, workerCount);
+        else
+            fprintf(output, "[PROBE] No answer on %d ports after %.0f ms\n", workerCount, elapsed);
+    }
+
+    return winner != -1;
+}
+
+void* TMTabletProbe::WorkerThread(void *arg) {
+    TMProbeWorker *w = (TMProbeWorker*)arg;
+    w->probe->Probe(w);
+    return NULL;
+}
+
+//
+// Probe(worker)
+//
+// Try each model / speed pair on one port until something
+// answers or another port has already won.
+//
+void TMTabletProbe::Probe(TMProbeWorker *w) {
+    double          start = Milliseconds();
+    TMSerialPort    port;
+
+    if (port.Open(w->path) == kSerialError) {
+        if (output != NULL)
+            fprintf(output, "[PROBE] %s: OPEN ERROR\n", w->path);
+        return;
+    }
+
+    for (int i=0; steps[i] != -1 && !Cancelled(); i+=2) {
+        int model = steps[i];
+
+        // SD tablets don't answer queries, so there's nothing to ask
+        if (model == kModelSDSeries)
+            continue;
+
+        port.SetSpeed(steps[i+1]);
+
+        if (Ask(&port, model)) {
+            w->msec = Milliseconds() - start;
+            (void)Claim(w, model, steps[i+1]);
+            break;
+        }
+    }
+
+    port.Close();
+
+    if (w->msec == 0)
+        w->msec = Milliseconds() - start;
+}
+
+//
+// Ask(port, model)
+//
+// Send the identification query and see if a tablet answers.
+// Only a well-formed reply counts, since a tablet at the wrong
+// speed may reply with garbage.
+//
+bool TMTabletProbe::Ask(TMSerialPort *port, int model) {
+    char reply[1024];
+
+    if (model == kModelTabletPC) {
+        port->WriteString((char*)TPC_StopTablet);
+        (void)usleep(100000);   // 0.1 seconds
+        (void)port->Flush();
+
+        if (Cancelled()) return false;
+
+        port->WriteString((char*)TPC_TabletID);
+        int len = port->ReadPacket(reply, TPC_QUERY_REPLY_SIZE, 100000);
+        return len == TPC_QUERY_REPLY_SIZE && (reply[0] & 0x80) && (reply[0] & TPC_Mask0_QueryData);
+    }
+
+    port->WriteString((char*)WAC_StopTablet);
+    (void)port->Flush();
+
+    // Request the Tablet ID - try up to 3 times
+    for (int x=3; x-- && !Cancelled();) {
+        port->WriteString((char*)WAC_TabletID);
+        if (port->ReadLine(reply, sizeof(reply), 100000) > 1 && reply[0] == '~' && reply[1] == '#')
+            return true;
+    }
+
+    return false;
+}
+
+//
+// Claim(worker, model, speed)
+// The first worker to answer wins and the rest stop
+//
+bool TMTabletProbe::Claim(TMProbeWorker *w, int model, speed_t speed) {
+    int none = -1;
+    if (!__atomic_compare_exchange_n(&winner, &none, (int)(w - worker), false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        return false;
+
+    foundModel = model;
+    foundSpeed = speed;
+    return true;
+}
@@ -0,0 +1,101 @@
+/**
+ * TMTabletProbe.h
+ *
+ * TabletMagicDaemon
+ * Thinkyhead Software
+ *
+ * This program is a component of TabletMagic. See the
+ * accompanying documentation for more details about the
+ * TabletMagic project.
+ *
+ * LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __TMTABLETPROBE_H__
+#define __TMTABLETPROBE_H__
+
+#include "TMSerialPort.h"
+
+#include <pthread.h>
+#include <stdio.h>
+
+#define kMaxProbePorts  32
+
+class TMTabletProbe;
+
+//! One port being probed, with its own thread
+typedef struct TMProbeWorker {
+    TMTabletProbe   *probe;
+    pthread_t       thread;
+    bool            started;
+    char            path[MAXPATHLEN];
+    double          msec;               //!< How long the probe ran
+} TMProbeWorker;
+
+//===================================================================
+//
+//  TMTabletProbe
+//
+//  Looks for a tablet on all candidate ports at once.
+//
+//  Each port gets a worker thread that steps through the same
+//  model / speed pairs FindTabletOnPort would, asking "~#" or "*"
+//  at each. The first port to answer wins, and the other workers
+//  give up at their next step.
+//
+//  Only the question is asked here. The winning port is closed
+//  again so the daemon can open and initialize it as usual.
+//
+//===================================================================
+
+class TMTabletProbe {
+
+private:
+    TMProbeWorker   worker[kMaxProbePorts];
+    int             workerCount;
+    const int       *steps;             //!< Model / speed pairs, ending with -1
+
+    int             winner;             //!< Index of the first worker to get an answer
+    int             foundModel;
+    speed_t         foundSpeed;
+
+    FILE            *output;
+
+    static void*    WorkerThread(void *arg);
+    void            Probe(TMProbeWorker *w);
+    bool            Ask(TMSerialPort *port, int model);
+    bool            Claim(TMProbeWorker *w, int model, speed_t speed);
+
+public:
+    double          elapsed;            //!< Milliseconds taken by the last Run
+
+    TMTabletProbe();
+
+    inline void     SetOutput(FILE *f)  { output = f; }
+
+    bool            Run(char *portname, const int *model_speeds);
+
+    inline bool     Cancelled()         { return __atomic_load_n(&winner, __ATOMIC_ACQUIRE) != -1; }
+    inline char*    FoundPath()         { return winner == -1 ? NULL : worker[winner].path; }
+    inline int      FoundModel()        { return foundModel; }
+    inline speed_t  FoundSpeed()        { return foundSpeed; }
+    inline int      PortCount()         { return workerCount; }
+
+    static double   Milliseconds();
+};
+
+#endif
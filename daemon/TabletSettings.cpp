@@ -26,6 +26,7 @@
  */
 
 #include "TabletSettings.h"
+#include "TMScan.h"
 
 //===================================================================
 //  TabletSettings
@@ -107,7 +108,15 @@ TabletSettings::~TabletSettings() {
 bool TabletSettings::Import(const char *state) {
     unsigned int mask;
 
-    sscanf(&state[(state[0] == '~') ? ((state[1] == 'W') ? 3 : 2) : 0], "%X,%d,%d,%d,%d", &mask, &increment, &interval, &xrez, &yrez);
+    // "~Rmask,increment,interval,xrez,yrez" - the fields after the mask are optional
+    TMScan scan(&state[(state[0] == '~') ? ((state[1] == 'W') ? 3 : 2) : 0]);
+    if (!scan.Hex(&mask))
+        return false;
+
+    (void)(scan.Literal(',') && scan.Decimal(&increment)
+        && scan.Literal(',') && scan.Decimal(&interval)
+        && scan.Literal(',') && scan.Decimal(&xrez)
+        && scan.Literal(',') && scan.Decimal(&yrez));
 
     command_set     = twobitval(30);    // E = 11 10
     baud_rate       = twobitval(28);
@@ -176,7 +185,7 @@ void TabletSettings::InitForPenPartner() {
 // InitForIntuos
 // Apply pseudo-settings for the Intuos
 //
-// TODO: Set 38400 speed for ROM 2.0 and above and apply it in the daemon
+// The daemon raises the speed once the tablet is identified
 //
 void TabletSettings::InitForIntuos() {
     command_set     = kCommandSetWacomV;        // Synthetic Override
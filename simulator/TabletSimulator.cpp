@@ -0,0 +1,717 @@
+/**
+ * TabletSimulator.cpp
+ *
+ * TabletSimulator
+ * Thinkyhead Software
+ *
+ * A virtual serial tablet for exercising TabletMagicDaemon
+ * without hardware. It opens a pseudo-terminal, answers the
+ * identification and setup queries the way a real tablet
+ * would, and streams packets at a chosen rate once started.
+ *
+ *  TabletSimulator -m intuos -r 0 -l /tmp/tablet
+ *  TabletMagicDaemon -p /tmp/tablet
+ *
+ * This program is a component of TabletMagic. See the
+ * accompanying documentation for more details about the
+ * TabletMagic project.
+ *
+ * LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "Constants.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <math.h>
+#include <time.h>
+#include <termios.h>
+#include <sysexits.h>
+#include <sys/time.h>
+
+#if defined(__APPLE__)
+#include <util.h>
+#elif defined(__FreeBSD__)
+#include <libutil.h>
+#else
+#include <pty.h>
+#endif
+
+//
+// Packet layouts the simulator can produce
+//
+typedef enum {
+    kSimWacomIIS,               // SD Series: 7-byte binary or ASCII lines
+    kSimWacomIV,                // ArtZ, PL: 7 bytes, or 9 with tilt
+    kSimGraphire,               // Graphire: 7 bytes with 9-bit pressure
+    kSimWacomV,                 // Intuos: 9 bytes with tool ID packets
+    kSimTabletPC,               // ISD-V4: 9 bytes, single character commands
+    kSimFujitsu                 // Fujitsu P-Series: 5 bytes, no queries
+} SimProtocol;
+
+//
+// The tablets that can be simulated
+//
+typedef struct {
+    const char  *name;          // Name for the -m argument
+    const char  *title;         // Description for humans
+    SimProtocol protocol;
+    int         baud;           // Factory line speed
+    int         rate;           // Native packets per second
+    long        maxX, maxY;     // Coordinate range
+    int         maxPressure;
+    const char  *idReply;       // Answer to ~#
+    const char  *sizeReply;     // Answer to ~C, if any
+    const char  *setupReply;    // Answer to ~R, if any (%X is the setup mask)
+    unsigned    setupMask;
+} SimModel;
+
+static const SimModel models[] = {
+    { "artz",       "ArtZ UD-1212",         kSimWacomIV,    9600,   100, 15240, 15240,  255,
+        "~#UD-1212-R00 V1.4-4\r",   "~C15240,15240\r",  "~R%08X,002,02,1270,1270\r",    0xE202C900 },
+
+    { "sd",         "SD-420L",              kSimWacomIIS,   9600,   100, 15240, 15240,  127,
+        "~#420,V3.0-01,9C9D,",      NULL,               NULL,                           0xA203C800 },
+
+    { "pl",         "PL-400",               kSimWacomIV,    9600,   100, 10240,  7680,  255,
+        "~#PL-400-R00 V1.3-3,\r",   "~C10240,07680\r",  NULL,                           0xE202C000 },
+
+    { "intuos",     "Intuos GD-0608",       kSimWacomV,     9600,   200, 20320, 15240, 1023,
+        "~#GD-0608-R00,V1.2-7\r",   "~C20320,15240\r",  NULL,                           0 },
+
+    { "graphire",   "Graphire ET-0405",     kSimGraphire,   9600,   100, 10160,  8128,  511,
+        "~#ET-0405-R00,V1.3-4\r",   "~C10160,08128\r",  "~R%08X,002,02,2032,2032\r",    0xE202C900 },
+
+    { "isdv4",      "TabletPC ISD-V4",      kSimTabletPC,   19200,  133, 24570, 18430,  255,
+        NULL,                       NULL,               NULL,                           0 },
+
+    { "fujitsu",    "Fujitsu P-Series",     kSimFujitsu,    9600,   100,  4033,  4000,    1,
+        NULL,                       NULL,               NULL,                           0 }
+};
+
+#define kModelCount     (int)(sizeof(models) / sizeof(models[0]))
+#define kToolIDPen      0x0822      // Intuos Pen GP-300E-01H
+#define kToolSerial     0x0A5A5A5AL
+
+//===================================================================
+//
+//  TabletSimulator
+//
+//===================================================================
+
+class TabletSimulator {
+
+private:
+    const SimModel  *model;
+    int             master, slave;
+    char            slaveName[256];
+
+    int             baud;           // The tablet's own line speed (0 = any)
+    int             rate;           // Requested packets per second (0 = line maximum)
+    bool            rateLocked;     // The rate was given, so the tablet can't change it
+    int             interval;       // Sample times skipped between reports (IT)
+    bool            quiet;
+
+    bool            streaming;
+    bool            ascii;          // II-S ASCII output (AS0)
+    bool            tilt;           // Wacom IV tilt reporting (FM1)
+    bool            inProximity;    // The tool ID has been sent (Wacom V)
+    unsigned        setupMask;      // The setup reported by ~R
+
+    char            command[256];
+    int             commandLength;
+
+    unsigned long   phase;          // Position along the pen's path
+    double          nextPacket;     // When the next packet is due
+
+    int             PacketSize();
+    int             Rate();
+    int             LineSpeed();
+    bool            SpeedMatches();
+    int             MakePacket(unsigned char *p);
+
+    void            Reply(const char *reply, int length=-1);
+    void            ProcessCommand(char *com);
+    void            ProcessTabletPCCommand(char c);
+    void            ProcessInput();
+    void            SendPackets();
+
+public:
+    unsigned long   packetsSent;
+    unsigned long   bytesSent;
+    unsigned long   packetsDropped;
+    unsigned long   commandsIgnored;
+    double          startTime;      // When the first packet was sent
+
+    TabletSimulator(const SimModel *m, int inBaud, int inRate, bool inQuiet);
+    ~TabletSimulator();
+
+    bool            Open(const char *link);
+    void            Run();
+    void            PrintStats();
+
+    static double   Now();
+};
+
+static volatile sig_atomic_t quitSimulator = 0;
+static char *linkPath = NULL;
+
+static void signal_handler(int sig) {
+    quitSimulator = 1;
+}
+
+static int BaudConstant(int baud) {
+    switch (baud) {
+        case 2400:  return B2400;
+        case 4800:  return B4800;
+        case 9600:  return B9600;
+        case 19200: return B19200;
+        case 38400: return B38400;
+    }
+    return -1;
+}
+
+static int BaudValue(int speed) {
+    const int bauds[] = { 2400, 4800, 9600, 19200, 38400 };
+    for (int i=0; i<5; i++)
+        if (BaudConstant(bauds[i]) == speed)
+            return bauds[i];
+    return 0;
+}
+
+TabletSimulator::TabletSimulator(const SimModel *m, int inBaud, int inRate, bool inQuiet) {
+    model = m;
+    baud = inBaud;
+    rateLocked = (inRate != -1);
+    rate = rateLocked ? inRate : model->rate;
+    interval = 0;
+    quiet = inQuiet;
+    master = slave = -1;
+    slaveName[0] = '\0';
+
+    streaming = (model->protocol == kSimFujitsu);    // Fujitsu sends without being asked
+    ascii = tilt = inProximity = false;
+    setupMask = model->setupMask;
+    commandLength = 0;
+    phase = 0;
+    nextPacket = 0;
+
+    packetsSent = bytesSent = packetsDropped = commandsIgnored = 0;
+    startTime = Now();
+}
+
+TabletSimulator::~TabletSimulator() {
+    if (master != -1) close(master);
+    if (slave != -1) close(slave);
+}
+
+double TabletSimulator::Now() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+//
+// Open(link)
+//
+// Create the pseudo-terminal. The slave side is kept open so
+// the daemon can close and reopen it during its port scan.
+//
+bool TabletSimulator::Open(const char *link) {
+    struct termios  options;
+
+    if (openpty(&master, &slave, slaveName, NULL, NULL) == -1) {
+        fprintf(stderr, "openpty failed: %s\n", strerror(errno));
+        return false;
+    }
+
+    // A raw line, as a serial port would be
+    tcgetattr(slave, &options);
+    cfmakeraw(&options);
+    cfsetspeed(&options, BaudConstant(model->baud));
+    tcsetattr(slave, TCSANOW, &options);
+
+    fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+    nextPacket = Now();
+
+    if (link != NULL) {
+        unlink(link);
+        if (symlink(slaveName, link) == -1) {
+            fprintf(stderr, "Can't link %s to %s: %s\n", link, slaveName, strerror(errno));
+            return false;
+        }
+    }
+
+    if (baud)
+        printf("%s on %s at %d baud, %d packets per second\n", model->title, link ? link : slaveName, baud, Rate());
+    else
+        printf("%s on %s at any speed\n", model->title, link ? link : slaveName);
+    fflush(stdout);
+
+    return true;
+}
+
+//
+// PacketSize()
+//
+int TabletSimulator::PacketSize() {
+    switch (model->protocol) {
+        case kSimWacomIIS:  return ascii ? 17 : 7;
+        case kSimWacomIV:   return tilt ? 9 : 7;
+        case kSimGraphire:  return 7;
+        case kSimWacomV:    return 9;
+        case kSimTabletPC:  return 9;
+        case kSimFujitsu:   return 5;
+    }
+    return 7;
+}
+
+//
+// Rate()
+// Packets per second, never more than the line can carry
+//
+int TabletSimulator::Rate() {
+    int speed = baud ? baud : BaudValue(LineSpeed());
+    int maxRate = (speed ? speed : model->baud) / 10 / PacketSize();
+    int r = (rate <= 0 || rate > maxRate) ? maxRate : rate;
+    return (r / (interval + 1) > 0) ? r / (interval + 1) : 1;
+}
+
+//
+// LineSpeed()
+// The speed the daemon has set on its end of the line
+//
+int TabletSimulator::LineSpeed() {
+    struct termios options;
+    if (tcgetattr(slave, &options) == -1)
+        return -1;
+    return (int)cfgetospeed(&options);
+}
+
+//
+// SpeedMatches()
+//
+// A tablet at a different speed than the port only sees garbage,
+// and only sends garbage, so in that case it says nothing at all.
+//
+bool TabletSimulator::SpeedMatches() {
+    return baud == 0 || LineSpeed() == BaudConstant(baud);
+}
+
+void TabletSimulator::Reply(const char *reply, int length) {
+    if (length < 0) length = (int)strlen(reply);
+    if (write(master, reply, length) == length)
+        bytesSent += length;
+}
+
+//
+// ProcessCommand(com)
+// Handle a CR-terminated Wacom command
+//
+void TabletSimulator::ProcessCommand(char *com) {
+    // Commands may arrive with a reset prefix
+    while (*com == '#' || *com == '$' || *com == '%' || *com == '&') {
+        if (*com == '$' && com[1] == '\0' && model->protocol == kSimWacomV)
+            baud = 9600;
+        com++;
+    }
+
+    if (*com == '\0')
+        return;
+
+    if (!quiet)
+        printf("[RCVD] %s\n", com);
+
+    if (strcmp(com, "~#") == 0) {
+        if (model->idReply) Reply(model->idReply);
+    }
+    else if (strcmp(com, "~C") == 0) {
+        if (model->sizeReply) Reply(model->sizeReply);
+    }
+    else if (strncmp(com, "~R", 2) == 0) {
+        if (model->setupReply) {
+            char reply[64];
+            unsigned mask = setupMask;
+            if (tilt) mask |= 1 << 4;
+            if (ascii) mask |= 1 << 19;
+            snprintf(reply, sizeof(reply), model->setupReply, mask);
+            Reply(reply);
+        }
+    }
+    else if (strncmp(com, "~*", 2) == 0 && model->setupReply) {
+        // A new setup. Only the line speed is acted on.
+        setupMask = (unsigned)strtoul(com + 2, NULL, 16);
+        if (baud) baud = 2400 << ((setupMask >> 28) & 3);
+    }
+    else if (strcmp(com, "ST") == 0) {
+        streaming = true;
+        nextPacket = Now();
+    }
+    else if (strcmp(com, "SP") == 0)
+        streaming = false;
+    else if (strcmp(com, "AS0") == 0 && model->protocol == kSimWacomIIS)
+        ascii = true;
+    else if (strcmp(com, "AS1") == 0 && model->protocol == kSimWacomIIS)
+        ascii = false;
+    else if (strcmp(com, "FM1") == 0 && model->protocol == kSimWacomIV)
+        tilt = true;
+    else if (strcmp(com, "FM0") == 0 && model->protocol == kSimWacomIV)
+        tilt = false;
+    else if (strncmp(com, "IT", 2) == 0 && model->protocol == kSimWacomIV)
+        interval = atoi(com + 2);
+    else if (strcmp(com, "RE") == 0) {
+        ascii = tilt = false;
+        interval = 0;
+    }
+    else if (strcmp(com, "BA19") == 0 && model->protocol == kSimWacomV)
+        baud = 19200;
+    else if (strcmp(com, "BA38") == 0 && model->protocol == kSimWacomV)
+        baud = 38400;
+    else
+        commandsIgnored++;
+}
+
+//
+// ProcessTabletPCCommand(c)
+// ISD-V4 commands are single characters
+//
+void TabletSimulator::ProcessTabletPCCommand(char c) {
+    if (!quiet && c != '\r' && c != '\n')
+        printf("[RCVD] %c\n", c);
+
+    switch (c) {
+        case '0':
+            streaming = false;
+            break;
+
+        case '1': case '2': case '3': {
+            static const int tpc_rates[] = { 133, 80, 40 };
+            if (!rateLocked) rate = tpc_rates[c - '1'];
+            streaming = true;
+            nextPacket = Now();
+            break;
+        }
+
+        case '*': {
+            // The query reply: 0x80 | Query flag, then coordinate
+            // and pressure ranges, then the firmware version
+            unsigned char q[TPC_QUERY_REPLY_SIZE] = { 0xC0 };
+            q[1] = (model->maxX >> 9) & 0x7F;
+            q[2] = (model->maxX >> 2) & 0x7F;
+            q[3] = (model->maxY >> 9) & 0x7F;
+            q[4] = (model->maxY >> 2) & 0x7F;
+            q[5] = model->maxPressure & 0x7F;
+            q[6] = ((model->maxX & 3) << 5) | ((model->maxY & 3) << 3) | ((model->maxPressure >> 7) & 0x07);
+            q[9] = 2;
+            q[10] = 6;
+            Reply((char*)q, TPC_QUERY_REPLY_SIZE);
+            break;
+        }
+
+        case '\r': case '\n':
+            break;
+
+        default:
+            commandsIgnored++;
+    }
+}
+
+//
+// ProcessInput()
+//
+void TabletSimulator::ProcessInput() {
+    char buff[256];
+    int n;
+
+    while ((n = (int)read(master, buff, sizeof(buff))) > 0) {
+        if (!SpeedMatches()) {
+            commandsIgnored++;
+            continue;
+        }
+
+        for (int i=0; i<n; i++) {
+            if (model->protocol == kSimFujitsu)
+                continue;
+
+            if (model->protocol == kSimTabletPC) {
+                ProcessTabletPCCommand(buff[i]);
+                continue;
+            }
+
+            if (buff[i] == '\r' || buff[i] == '\n') {
+                command[commandLength] = '\0';
+                ProcessCommand(command);
+                commandLength = 0;
+            }
+            else if (commandLength < (int)sizeof(command) - 1)
+                command[commandLength++] = buff[i];
+        }
+    }
+}
+
+//
+// MakePacket(p)
+//
+// Build the next packet along a looping path over the tablet.
+// The pen touches down for most of each loop and briefly leaves
+// proximity at the end of it, so every state gets exercised.
+//
+int TabletSimulator::MakePacket(unsigned char *p) {
+    const int   loop = 400;
+    int         step = (int)(phase++ % loop);
+    double      t = 2 * M_PI * step / loop;
+
+    long    x = (long)(model->maxX * (0.5 + 0.4 * sin(t)));
+    long    y = (long)(model->maxY * (0.5 + 0.4 * sin(2 * t)));
+    bool    near = step < loop - 20;
+    bool    touch = step >= 20 && step < loop - 40;
+    int     press = touch ? (int)(model->maxPressure * (0.55 + 0.45 * sin(3 * t))) : 0;
+    int     tx = (int)(40 * sin(t)), ty = (int)(40 * cos(t));
+
+    memset(p, 0, 9);
+
+    switch (model->protocol) {
+        case kSimWacomIIS:
+            if (ascii) {
+                // SD pressure levels: 01 = off, 00 = low, 03 = medium, 02 = high
+                int b = !near ? 99 : !touch ? 1 : (press < 50) ? 0 : (press < 90) ? 3 : 2;
+                return snprintf((char*)p, 32, "#,%05ld,%05ld,%02d\r", x, y, b);
+            }
+            // SD pressure is 7 bits with the high bit inverted
+            p[0] = 0x80 | (near ? 0x70 : 0x20) | ((x >> 14) & 0x03);
+            p[1] = (x >> 7) & 0x7F;
+            p[2] = x & 0x7F;
+            p[3] = (y >> 14) & 0x03;
+            p[4] = (y >> 7) & 0x7F;
+            p[5] = y & 0x7F;
+            press = touch ? 42 + press * 67 / model->maxPressure : 0;
+            p[6] = (press & 0x3F) | ((press & 0x40) ? 0 : 0x40);
+            return 7;
+
+        case kSimWacomIV:
+        case kSimGraphire:
+            p[0] = 0x80 | (near ? 0x60 : 0x20) | (touch ? 0x08 : 0) | ((x >> 14) & 0x03);
+            p[1] = (x >> 7) & 0x7F;
+            p[2] = x & 0x7F;
+            p[3] = ((y >> 14) & 0x03) | (touch ? 0x08 : 0);
+            p[4] = (y >> 7) & 0x7F;
+            p[5] = y & 0x7F;
+            if (model->protocol == kSimGraphire) {
+                p[3] |= ((press & 0x02) << 1) | ((press & 0x01) << 6);
+                p[6] = ((press >> 2) & 0x3F) | ((press >> 2) & 0x40);
+                return 7;
+            }
+            p[3] |= (press & 0x01) << 2;
+            p[6] = ((press >> 1) & 0x3F) | ((press & 0x80) ? 0 : 0x40);
+            if (!tilt) return 7;
+            p[7] = tx & 0x7F;
+            p[8] = ty & 0x7F;
+            return 9;
+
+        case kSimWacomV:
+            if (!near) {
+                inProximity = false;
+                p[0] = 0x80;
+                return 9;
+            }
+            if (!inProximity) {
+                // Announce the tool first
+                inProximity = true;
+                phase--;
+                p[0] = 0xC2;
+                p[1] = (kToolIDPen >> 5) & 0x7F;
+                p[2] = ((kToolIDPen << 2) & 0x7C) | ((kToolSerial >> 30) & 0x03);
+                p[3] = (kToolSerial >> 23) & 0x7F;
+                p[4] = (kToolSerial >> 16) & 0x7F;
+                p[5] = (kToolSerial >> 9) & 0x7F;
+                p[6] = (kToolSerial >> 2) & 0x7F;
+                p[7] = (kToolSerial << 5) & 0x60;
+                return 9;
+            }
+            p[0] = 0xA0;
+            p[1] = (x >> 9) & 0x7F;
+            p[2] = (x >> 2) & 0x7F;
+            p[3] = ((x & 0x03) << 5) | ((y >> 11) & 0x1F);
+            p[4] = (y >> 4) & 0x7F;
+            p[5] = ((y & 0x0F) << 3) | ((press >> 7) & 0x07);
+            p[6] = press & 0x7F;
+            p[7] = tx & 0x7F;
+            p[8] = ty & 0x7F;
+            return 9;
+
+        case kSimTabletPC:
+            p[0] = 0x80 | (near ? 0x20 : 0) | (touch ? 0x01 : 0);
+            p[1] = (x >> 9) & 0x7F;
+            p[2] = (x >> 2) & 0x7F;
+            p[3] = (y >> 9) & 0x7F;
+            p[4] = (y >> 2) & 0x7F;
+            p[5] = press & 0x7F;
+            p[6] = ((x & 0x03) << 5) | ((y & 0x03) << 3) | ((press >> 7) & 0x01);
+            return 9;
+
+        case kSimFujitsu:
+            // Status 136 = pen down, 138 = pen up
+            x = 93 + x * 3940 / model->maxX;
+            y = 152 + y * 3848 / model->maxY;
+            p[0] = touch ? 136 : 138;
+            p[1] = (x >> 7) & 0x7F;
+            p[2] = y & 0x7F;
+            p[3] = (y >> 7) & 0x7F;
+            p[4] = x & 0x7F;
+            return 5;
+    }
+
+    return 0;
+}
+
+//
+// SendPackets()
+//
+// Send every packet that's due. If the daemon isn't keeping up
+// the pty fills, and the packet is counted as dropped, much as
+// a real tablet would overrun the serial buffer.
+//
+void TabletSimulator::SendPackets() {
+    double now = Now();
+
+    if (now - nextPacket > 1.0)             // Don't try to catch up more than a second
+        nextPacket = now - 1.0;
+
+    bool match = SpeedMatches();
+
+    while (streaming && nextPacket <= now) {
+        unsigned char p[32];
+        int len = MakePacket(p);
+
+        if (!match)
+            ;                                   // Heard as noise, if at all
+        else if (write(master, p, len) == len) {
+            if (packetsSent++ == 0) startTime = now;
+            bytesSent += len;
+        }
+        else
+            packetsDropped++;
+
+        nextPacket += 1.0 / Rate();
+    }
+}
+
+//
+// Run()
+//
+void TabletSimulator::Run() {
+    struct pollfd pfd = { master, POLLIN, 0 };
+
+    while (!quitSimulator) {
+        int timeout = -1;
+        if (streaming) {
+            timeout = (int)((nextPacket - Now()) * 1000.0);
+            if (timeout < 0) timeout = 0;
+        }
+
+        int n = poll(&pfd, 1, timeout);
+        if (n == -1 && errno != EINTR)
+            break;
+
+        if (n > 0 && (pfd.revents & POLLIN))
+            ProcessInput();
+
+        if (streaming)
+            SendPackets();
+    }
+}
+
+void TabletSimulator::PrintStats() {
+    double elapsed = Now() - startTime;
+    printf("\n%lu packets (%lu bytes) in %.1f seconds, %.1f per second. %lu dropped, %lu commands ignored.\n",
+           packetsSent, bytesSent, elapsed, elapsed > 0 ? packetsSent / elapsed : 0.0, packetsDropped, commandsIgnored);
+}
+
+static void usage() {
+    printf("\nusage: TabletSimulator [-m model] [-b baud] [-r rate] [-l link] [-q]\n\n");
+    printf("  -m model  The tablet to simulate:\n");
+    for (int i=0; i<kModelCount; i++)
+        printf("              %-10s %s, %d baud\n", models[i].name, models[i].title, models[i].baud);
+    printf("  -b baud   The tablet's line speed. 0 answers at any speed\n");
+    printf("  -r rate   Packets per second when started. 0 for the line maximum\n");
+    printf("  -l link   Create a symbolic link to the pty for the daemon's -p\n");
+    printf("  -q        Don't log commands\n\n");
+}
+
+int main(int argc, char *argv[]) {
+    const SimModel  *model = &models[0];
+    int             baud = -1, rate = -1;
+    bool            quiet = false;
+    char            ch;
+
+    while ((ch = getopt(argc, argv, "m:b:r:l:qh")) != -1) {
+        switch (ch) {
+            case 'm':
+                model = NULL;
+                for (int i=0; i<kModelCount; i++)
+                    if (strcmp(optarg, models[i].name) == 0)
+                        model = &models[i];
+                if (model == NULL) {
+                    usage();
+                    return EX_USAGE;
+                }
+                break;
+
+            case 'b':
+                baud = atoi(optarg);
+                if (baud && BaudConstant(baud) == -1) {
+                    fprintf(stderr, "Unsupported speed: %s\n", optarg);
+                    return EX_USAGE;
+                }
+                break;
+
+            case 'r': rate = atoi(optarg); break;
+            case 'l': linkPath = optarg; break;
+            case 'q': quiet = true; break;
+
+            case 'h':
+            default:
+                usage();
+                return EX_USAGE;
+        }
+    }
+
+    if (baud == -1) baud = model->baud;
+
+    TabletSimulator sim(model, baud, rate, quiet);
+
+    if (!sim.Open(linkPath))
+        return EX_OSERR;
+
+    signal(SIGINT, signal_handler);
+    signal(SIGTERM, signal_handler);
+    signal(SIGHUP, signal_handler);
+
+    sim.Run();
+    sim.PrintStats();
+
+    if (linkPath != NULL)
+        unlink(linkPath);
+
+    return EX_OK;
+}
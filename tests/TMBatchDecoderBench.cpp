@@ -0,0 +1,257 @@
+/**
+ * TMBatchDecoderBench.cpp
+ *
+ * TabletMagic Tests
+ * Thinkyhead Software
+ *
+ * This program is a component of TabletMagic. See the
+ * accompanying documentation for more details about the
+ * TabletMagic project.
+ *
+ * LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+//
+// TabletPC decoding cost over a full buffer of 64 random packets.
+//
+// "per packet" is the path the daemon took before batching: a call
+// through the decoder pointer for each packet, ProcessTabletPC's
+// work on the stylus, the pressure check from ProcessPacket, and
+// RecordSample writing the stylus into the samples. The daemon's
+// own copy can't be linked here, so it's reproduced as it stands.
+//
+// "staged" is DecodeStagedPackets: a batch decode, then one pass
+// for motion, tool, time and pressure. The "kernel" lines time the
+// batch decode alone, scalar and vector.
+//
+//   TMBatchDecoderBench [rounds]
+//
+
+#include "TMTest.h"
+#include "TMBatchDecoder.h"
+#include "TMPacketLayout.h"
+
+#define kPasses         5
+#define PRESSURE_SCALE  65535.0         // As in the daemon
+
+static UInt8 packets[kMaxSamples * 9];
+
+//! The stylus fields ProcessTabletPC and RecordSample use, as in StylusState
+typedef struct {
+    SInt32      x, y, oldx, oldy, dx, dy;
+    UInt16      pressure;
+    SInt16      tiltX, tiltY;
+    UInt16      tool;
+    UInt16      button_mask;
+    bool        button_click;
+    bool        button[kButtonMax];
+    bool        off_tablet, pen_near, eraser_flag;
+} Stylus;
+
+static Stylus stylus;
+
+#define SetButtons(x)   {stylus.button_click=((x)!=0);stylus.button_mask=x;int qq;for(qq=kButtonMax;qq--;stylus.button[qq]=((x)&(1<<qq))!=0);}
+
+//
+// ProcessTabletPC(packet, size)
+// The daemon's decoder, on the stand-in stylus
+//
+static void __attribute__((noinline)) ProcessTabletPC(char *packet, int pack_size) {
+    if (pack_size != 9) return;
+
+    UInt16  bm = 0;
+    bool    ot = false;
+
+    stylus.tool = 1;
+    SetButtons(0);
+
+    stylus.oldx = stylus.x;
+    stylus.oldy = stylus.y;
+
+    stylus.x = TMField<TPC_FieldX>(packet);
+    stylus.y = TMField<TPC_FieldY>(packet);
+
+    ot = (packet[0] & TPC_Mask0_Proximity) == 0;
+    stylus.pen_near = !ot;
+
+    if (ot) {
+        stylus.pressure = 0;
+        stylus.eraser_flag = false;
+    }
+    else {
+        stylus.eraser_flag = (packet[0] & TPC_Mask0_Eraser) != 0;
+
+        UInt16 press = TMField<TPC_FieldPressure>(packet);
+        press = (press < 25) ? 0 : (UInt16)((press - 24) * PRESSURE_SCALE / 231.0);
+        stylus.pressure = press;
+
+        if (press)
+            bm = (packet[0] & TPC_Mask0_Touch) ? kBitStylusTip : 0;
+
+        if (!stylus.eraser_flag)
+            bm |= ((packet[0] & TPC_Mask0_Switch1) ? kBitStylusButton1 : 0)
+                | ((packet[0] & TPC_Mask0_Switch2) ? kBitStylusButton2 : 0);
+    }
+
+    if (stylus.off_tablet != ot) {
+        stylus.off_tablet = ot;
+        stylus.dx = stylus.dy = 0;
+    }
+    else {
+        stylus.dx = stylus.x - stylus.oldx;
+        stylus.dy = stylus.y - stylus.oldy;
+    }
+
+    SetButtons(bm);
+}
+
+//
+// RecordSample(out)
+// The stylus into the next sample, as the daemon does after each packet
+//
+static inline void RecordSample(TMSampleBuffer *out) {
+    int i = out->Reserve(1);
+
+    out->x[i]           = stylus.x;
+    out->y[i]           = stylus.y;
+    out->dx[i]          = stylus.dx;
+    out->dy[i]          = stylus.dy;
+    out->pressure[i]    = stylus.pressure;
+    out->tiltX[i]       = stylus.tiltX;
+    out->tiltY[i]       = stylus.tiltY;
+    out->buttons[i]     = stylus.button_mask;
+    out->tool[i]        = stylus.tool;
+    out->flags[i]       = (stylus.off_tablet ? kSampleOffTablet : 0)
+                        | (stylus.pen_near ? kSamplePenNear : 0)
+                        | (stylus.eraser_flag ? kSampleEraser : 0);
+    out->time[i]        = CFAbsoluteTimeGetCurrent();
+}
+
+//
+// Time(fn, rounds)
+// Best of a few passes, in ns per packet
+//
+template <typename F>
+static double Time(F decode, TMSampleBuffer *out, int rounds) {
+    double best = 1e9;
+
+    for (int pass=0; pass<kPasses; pass++) {
+        double start = Seconds();
+        for (int r=0; r<rounds; r++) {
+            decode(out);
+            out->Taken();
+            // Keep the compiler from hoisting the work out of the loop
+            __asm__ __volatile__("" : : "r"(out) : "memory");
+        }
+        double elapsed = Seconds() - start;
+        if (elapsed < best) best = elapsed;
+    }
+
+    return best * 1e9 / ((double)rounds * kMaxSamples);
+}
+
+static void (* volatile decoder)(char*, int) = ProcessTabletPC;
+
+static void PerPacket(TMSampleBuffer *out) {
+    for (int n=0; n<kMaxSamples; n++) {
+        decoder((char*)packets + 9 * n, 9);
+
+        if (!(stylus.button_mask & (kBitStylusTip|kBitStylusEraser)))
+            stylus.pressure = 0;
+
+        RecordSample(out);
+    }
+}
+
+//
+// FinishStaged(out, at, n)
+// The pass DecodeStagedPackets makes over a decoded batch
+//
+static inline void FinishStaged(TMSampleBuffer *out, int at, int n) {
+    CFAbsoluteTime  now = CFAbsoluteTimeGetCurrent();
+    SInt32          lastx = stylus.x, lasty = stylus.y;
+    bool            last_ot = stylus.off_tablet;
+
+    for (int i=at; i<at+n; i++) {
+        bool ot = (out->flags[i] & kSampleOffTablet) != 0;
+
+        if (!(out->buttons[i] & (kBitStylusTip|kBitStylusEraser)))
+            out->pressure[i] = 0;
+
+        if (ot != last_ot)
+            out->dx[i] = out->dy[i] = 0;
+        else {
+            out->dx[i] = out->x[i] - lastx;
+            out->dy[i] = out->y[i] - lasty;
+        }
+
+        out->tool[i] = 1;
+        out->time[i] = now;
+
+        lastx = out->x[i];  lasty = out->y[i];
+        last_ot = ot;
+    }
+
+    stylus.x = lastx;   stylus.y = lasty;
+    stylus.off_tablet = last_ot;
+}
+
+static void StagedScalar(TMSampleBuffer *out) {
+    int at = out->Reserve(kMaxSamples);
+    TMBatchDecoder::TabletPCScalar((const char*)packets, kMaxSamples, out, at);
+    FinishStaged(out, at, kMaxSamples);
+}
+
+static void Staged(TMSampleBuffer *out) {
+    int at = out->Reserve(kMaxSamples);
+    TMBatchDecoder::TabletPC((const char*)packets, kMaxSamples, out, at);
+    FinishStaged(out, at, kMaxSamples);
+}
+
+static void KernelScalar(TMSampleBuffer *out) {
+    TMBatchDecoder::TabletPCScalar((const char*)packets, kMaxSamples, out, out->Reserve(kMaxSamples));
+}
+
+static void Kernel(TMSampleBuffer *out) {
+    TMBatchDecoder::TabletPC((const char*)packets, kMaxSamples, out, out->Reserve(kMaxSamples));
+}
+
+int main(int argc, char *argv[]) {
+    int rounds = (argc > 1) ? atoi(argv[1]) : 200000;
+    if (rounds < 1) rounds = 1;
+
+    srand(1);
+    for (int n=0; n<kMaxSamples; n++) {
+        packets[9 * n] = 0x80 | (rand() & 0x3F);
+        for (int b=1; b<9; b++)
+            packets[9 * n + b] = rand() & 0x7F;
+    }
+
+    TMSampleBuffer *out = new TMSampleBuffer;
+    char engine[16];
+    snprintf(engine, sizeof(engine), "%s:", TMBatchDecoder::Engine());
+
+    printf("%d packets x %d rounds\n", kMaxSamples, rounds);
+    printf("  per packet:             %6.2f ns per packet\n", Time(PerPacket, out, rounds));
+    printf("  staged, scalar:         %6.2f ns per packet\n", Time(StagedScalar, out, rounds));
+    printf("  staged, %-7s         %6.2f ns per packet\n", engine, Time(Staged, out, rounds));
+    printf("  kernel, scalar:         %6.2f ns per packet\n", Time(KernelScalar, out, rounds));
+    printf("  kernel, %-7s         %6.2f ns per packet\n", engine, Time(Kernel, out, rounds));
+
+    delete out;
+    return 0;
+}
@@ -0,0 +1,149 @@
+/**
+ * TMBatchDecoderTest.cpp
+ *
+ * TabletMagic Tests
+ * Thinkyhead Software
+ *
+ * This program is a component of TabletMagic. See the
+ * accompanying documentation for more details about the
+ * TabletMagic project.
+ *
+ * LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+//
+// The batch TabletPC decoder (SSE2 where this build has it)
+// must match the scalar loop field for field, over random
+// packets, every run length and every starting sample. The scalar
+// loop is checked in turn against the ISD-V4 bit layout.
+//
+
+#include "TMTest.h"
+#include "TMBatchDecoder.h"
+
+#define kTrials     2000
+
+//
+// Random()
+// A fixed xorshift sequence, so a failure can be replayed
+//
+static UInt32 Random() {
+    static UInt32 state = 0x2545F491;
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+//! A TabletPC packet: a status byte, then eight bytes of 7-bit data
+static void RandomPacket(UInt8 *p) {
+    p[0] = 0x80 | (Random() & 0x3F);
+    for (int b=1; b<9; b++)
+        p[b] = Random() & 0x7F;
+}
+
+//! Fill the samples with a pattern, so untouched ones can be told apart
+static void Scribble(TMSampleBuffer *out, UInt8 pattern) {
+    memset(out->x, pattern, sizeof(out->x));
+    memset(out->y, pattern, sizeof(out->y));
+    memset(out->pressure, pattern, sizeof(out->pressure));
+    memset(out->tiltX, pattern, sizeof(out->tiltX));
+    memset(out->tiltY, pattern, sizeof(out->tiltY));
+    memset(out->buttons, pattern, sizeof(out->buttons));
+    memset(out->flags, pattern, sizeof(out->flags));
+}
+
+static bool SameSamples(TMSampleBuffer *a, TMSampleBuffer *b) {
+    return memcmp(a->x, b->x, sizeof(a->x)) == 0
+        && memcmp(a->y, b->y, sizeof(a->y)) == 0
+        && memcmp(a->pressure, b->pressure, sizeof(a->pressure)) == 0
+        && memcmp(a->tiltX, b->tiltX, sizeof(a->tiltX)) == 0
+        && memcmp(a->tiltY, b->tiltY, sizeof(a->tiltY)) == 0
+        && memcmp(a->buttons, b->buttons, sizeof(a->buttons)) == 0
+        && memcmp(a->flags, b->flags, sizeof(a->flags)) == 0;
+}
+
+//
+// TestLayout
+// The scalar loop against the ISD-V4 fields, worked out by hand
+//
+static void TestLayout(const UInt8 *packets, int count, TMSampleBuffer *out) {
+    for (int n=0; n<count; n++) {
+        const UInt8 *p = packets + 9 * n;
+        long x = (p[1] << 9) | (p[2] << 2) | ((p[6] >> 5) & 3);
+        long y = (p[3] << 9) | (p[4] << 2) | ((p[6] >> 3) & 3);
+        int  raw = ((p[6] & 1) << 7) | p[5];
+        bool near = (p[0] & TPC_Mask0_Proximity) != 0;
+
+        CHECK_EQ(out->x[n], x);
+        CHECK_EQ(out->y[n], y);
+        CHECK_EQ(out->flags[n] & kSampleOffTablet, near ? 0 : kSampleOffTablet);
+        CHECK(!near || raw >= 25 || out->pressure[n] == 0);
+        CHECK(!near || raw < 25 || out->pressure[n] > 0);
+    }
+}
+
+int main() {
+    static UInt8    packets[kMaxSamples * 9];
+    TMSampleBuffer  *batch = new TMSampleBuffer, *scalar = new TMSampleBuffer;
+    int             mismatches = 0;
+
+    printf("Batch engine: %s\n", TMBatchDecoder::Engine());
+
+    for (int trial=0; trial<kTrials; trial++) {
+        int at = Random() % 8;
+        int count = Random() % (kMaxSamples - at + 1);
+
+        for (int n=0; n<count; n++)
+            RandomPacket(packets + 9 * n);
+
+        Scribble(batch, 0xA5);
+        Scribble(scalar, 0xA5);
+        TMBatchDecoder::TabletPC((const char*)packets, count, batch, at);
+        TMBatchDecoder::TabletPCScalar((const char*)packets, count, scalar, at);
+
+        if (!SameSamples(batch, scalar)) {
+            if (mismatches++ < 10)
+                fprintf(stderr, "Trial %d: %d packets at %d don't match\n", trial, count, at);
+            test_failures++;
+        }
+
+        if (trial < 100) {
+            Scribble(scalar, 0xA5);
+            TMBatchDecoder::TabletPCScalar((const char*)packets, count, scalar, 0);
+            TestLayout(packets, count, scalar);
+        }
+    }
+
+    // Every status byte, eight at a time so the vectors see them all
+    for (int status=0x80; status<0x100; status+=8) {
+        for (int n=0; n<8; n++) {
+            RandomPacket(packets + 9 * n);
+            packets[9 * n] = status + n;
+            packets[9 * n + 5] = (n & 1) ? 0x7F : 0x10;
+        }
+        Scribble(batch, 0);
+        Scribble(scalar, 0);
+        TMBatchDecoder::TabletPC((const char*)packets, 8, batch, 0);
+        TMBatchDecoder::TabletPCScalar((const char*)packets, 8, scalar, 0);
+        CHECK(SameSamples(batch, scalar));
+    }
+
+    delete batch;
+    delete scalar;
+    return TEST_RESULT;
+}
@@ -0,0 +1,176 @@
+/**
+ * TMBaudDetectorTest.cpp
+ *
+ * TabletMagic Tests
+ * Thinkyhead Software
+ *
+ * This program is a component of TabletMagic. See the
+ * accompanying documentation for more details about the
+ * TabletMagic project.
+ *
+ * LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+//
+// TMBaudDetector listening to a TabletPC played on a pty. A pty
+// has no line speed of its own, so the tablet (a child process)
+// looks at the speed the port is set to: at its own speed it
+// sends clean packets, and at any other it sends what a UART
+// would make of them, too few or too many bytes. The detector
+// must settle on the tablet's speed and score the others lower.
+// A pty escapes any 0xFF it's given when marking, so the framing
+// errors a real line would add can't be played here.
+//
+
+#include "TMTest.h"
+#include "TMTestPty.h"
+#include "TMBaudDetector.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+#define kWindow     80              // ms at each speed, less than the daemon's
+#define kPacketGap  5000            // us between packets, about what a TabletPC sends
+
+//
+// Garble(p, listen, speed, out)
+//
+// A packet read at the wrong speed: the byte count scaled by
+// the ratio of speeds, and every byte misread
+//
+static int Garble(const UInt8 *p, long listen, long speed, UInt8 *out) {
+    int count = (int)(9 * listen / speed);
+    if (count < 1) count = 1;
+
+    for (int i=0; i<count; i++)
+        out[i] = (UInt8)((p[i % 9] * 37 + i * 101) & 0xFE);
+
+    return count;
+}
+
+//
+// PlayTablet(pty, speed)
+//
+// The child side: a pen hovering across the tablet, sent for a
+// few seconds at most, or until the daemon's side goes away
+//
+static void PlayTablet(TestPty *pty, speed_t speed) {
+    UInt8   p[9], out[64];
+    long    baud = TMSerialPort::BaudValue(speed);
+
+    for (int n=0; n<1000; n++) {
+        struct termios options;
+        if (tcgetattr(pty->slave, &options) == -1)
+            break;
+        long listen = TMSerialPort::BaudValue(cfgetispeed(&options));
+
+        int x = 1000 + n * 13, y = 2000 + n * 7;
+        p[0] = 0x80 | TPC_Mask0_Proximity;
+        p[1] = (x >> 9) & 0x7F; p[2] = (x >> 2) & 0x7F;
+        p[3] = (y >> 9) & 0x7F; p[4] = (y >> 2) & 0x7F;
+        p[5] = 0; p[6] = ((x & 3) << 5) | ((y & 3) << 3);
+        p[7] = p[8] = 0x40;
+
+        bool sent = (listen == baud) ? PtySend(pty, p, 9) : PtySend(pty, out, Garble(p, listen, baud, out));
+        if (!sent)
+            break;
+
+        usleep(kPacketGap);
+    }
+}
+
+static pid_t StartTablet(TestPty *pty, speed_t speed) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        PlayTablet(pty, speed);
+        _exit(0);
+    }
+    return pid;
+}
+
+static void StopTablet(pid_t pid) {
+    if (pid > 0) {
+        kill(pid, SIGTERM);
+        waitpid(pid, NULL, 0);
+    }
+}
+
+//
+// TestHeard(port, pty, speed, speeds, count, tries)
+// The tablet's speed wins on try number "tries", beating the ones before it
+//
+static void TestHeard(TMSerialPort *port, TestPty *pty, speed_t speed, const speed_t *speeds, int count, int tries) {
+    TMBaudDetector detector;
+    pid_t pid = StartTablet(pty, speed);
+
+    CHECK(detector.Detect(port, speeds, count, kFramerTabletPC, 9, true, kWindow));
+    StopTablet(pid);
+
+    CHECK_EQ(TMSerialPort::BaudValue(detector.BestSpeed()), TMSerialPort::BaudValue(speed));
+    CHECK_EQ(port->Speed(), speed);
+    CHECK_EQ(detector.resultCount, tries);
+    CHECK(detector.BestScore() >= kListenMinScore);
+    CHECK(detector.results[detector.best].packets >= kListenMinPackets);
+
+    for (int i=0; i<detector.resultCount - 1; i++) {
+        CHECK(detector.results[i].bytes > 0);
+        CHECK(detector.results[i].score < detector.BestScore());
+        CHECK(detector.results[i].score < kListenMinScore);
+    }
+}
+
+//
+// TestSilence(port)
+// Nothing is sent, so nothing is heard, and the speed is put back
+//
+static void TestSilence(TMSerialPort *port) {
+    TMBaudDetector detector;
+    speed_t speeds[] = { B19200, B38400, B9600 };
+
+    (void)port->SetSpeed(B9600);
+    CHECK(!detector.Detect(port, speeds, 3, kFramerTabletPC, 9, true, kWindow));
+    CHECK(!detector.HeardAnything());
+    CHECK_EQ(detector.resultCount, 1);
+    CHECK_EQ(detector.best, -1);
+    CHECK_EQ(detector.BestSpeed(), 0);
+    CHECK_EQ(port->Speed(), B9600);
+}
+
+int main() {
+    TestPty         pty;
+    TMSerialPort    port;
+
+    if (!PtyOpen(&pty)) {
+        fprintf(stderr, "Can't open a pseudo-terminal - %s\n", strerror(errno));
+        return 1;
+    }
+
+    CHECK(port.Open(pty.name) != kSerialError);
+
+    speed_t daemonOrder[] = { B19200, B38400, B9600 };
+    TestHeard(&port, &pty, B19200, daemonOrder, 3, 1);
+    TestHeard(&port, &pty, B38400, daemonOrder, 3, 2);
+    TestHeard(&port, &pty, B9600, daemonOrder, 3, 3);
+
+    TestSilence(&port);
+
+    port.Close();
+    PtyClose(&pty);
+
+    return TEST_RESULT;
+}
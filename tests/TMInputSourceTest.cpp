@@ -0,0 +1,217 @@
+/**
+ * TMInputSourceTest.cpp
+ *
+ * TabletMagic Tests
+ * Thinkyhead Software
+ *
+ * This program is a component of TabletMagic. See the
+ * accompanying documentation for more details about the
+ * TabletMagic project.
+ *
+ * LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+//
+// TMInputSource driven by pseudo-terminals: callbacks come only
+// when a line has bytes, go to the right source, and stop once a
+// source is detached, even from another source's callback. On
+// OS X this runs the CFFileDescriptor backend, elsewhere poll().
+//
+
+#include "TMTest.h"
+#include "TMTestPty.h"
+#include "TMInputSource.h"
+
+typedef struct {
+    TMInputSource   source;
+    TestPty         pty;
+    int             calls;
+    int             bytes;
+    bool            hangup;
+    TMInputSource   *detach;        //!< Another source to detach from the callback
+} Line;
+
+static void ReadCallback(int fd, void *info) {
+    Line *line = (Line*)info;
+    char buf[256];
+
+    line->calls++;
+    CHECK_EQ(fd, line->pty.slave);
+
+    int n = (int)read(fd, buf, sizeof(buf));
+    if (n > 0)
+        line->bytes += n;
+    else {
+        line->hangup = true;
+        line->source.Detach();
+    }
+
+    if (line->detach != NULL)
+        line->detach->Detach();
+}
+
+//
+// Run(msec)
+// One pass through the run loop, or poll() where there is none
+//
+static void Run(int msec) {
+#ifdef __APPLE__
+    CFRunLoopRunInMode(kCFRunLoopDefaultMode, msec / 1000.0, true);
+#else
+    CHECK(TMInputSource::RunOnce(msec) >= 0);
+#endif
+}
+
+static void LineOpen(Line *line) {
+    line->calls = line->bytes = 0;
+    line->hangup = false;
+    line->detach = NULL;
+    CHECK(PtyOpen(&line->pty));
+    CHECK(line->source.Attach(line->pty.slave, ReadCallback, line));
+}
+
+static void LineClose(Line *line) {
+    line->source.Detach();
+    PtyClose(&line->pty);
+}
+
+//
+// TestWake
+// A quiet line never calls back, a busy one calls back for its bytes
+//
+static void TestWake() {
+    Line a;
+    LineOpen(&a);
+
+    Run(20);
+    CHECK_EQ(a.calls, 0);
+
+    CHECK(PtySend(&a.pty, "\xA0\x01\x02\x03\x04\x05\x06", 7));
+    for (int i=0; i<50 && a.bytes < 7; i++)
+        Run(100);
+    CHECK_EQ(a.bytes, 7);
+
+    // Once read, it's quiet again
+    int calls = a.calls;
+    Run(20);
+    CHECK_EQ(a.calls, calls);
+
+    LineClose(&a);
+
+    // A detached line is never heard
+    Run(20);
+    CHECK_EQ(a.calls, calls);
+}
+
+//
+// TestTwoLines
+// Each source hears only its own line
+//
+static void TestTwoLines() {
+    Line a, b;
+    LineOpen(&a);
+    LineOpen(&b);
+
+    CHECK(PtySend(&b.pty, "~#\r", 3));
+    for (int i=0; i<50 && b.bytes < 3; i++)
+        Run(100);
+    CHECK_EQ(b.bytes, 3);
+    CHECK_EQ(a.calls, 0);
+
+    LineClose(&a);
+    LineClose(&b);
+}
+
+//
+// TestDetachFromCallback
+//
+// Both lines are ready, and the first to be called detaches the
+// other, as the daemon does when it closes the port. The other
+// must not be called with a descriptor that's gone.
+//
+static void TestDetachFromCallback() {
+    Line a, b;
+    LineOpen(&a);
+    LineOpen(&b);
+    a.detach = &b.source;
+    b.detach = &a.source;
+
+    CHECK(PtySend(&a.pty, "1", 1));
+    CHECK(PtySend(&b.pty, "2", 1));
+    usleep(20000);
+
+    for (int i=0; i<10 && a.calls + b.calls == 0; i++)
+        Run(100);
+    CHECK_EQ(a.calls + b.calls, 1);
+
+    Run(20);
+    CHECK_EQ(a.calls + b.calls, 1);
+
+    LineClose(&a);
+    LineClose(&b);
+}
+
+//
+// TestHangup
+// A line that goes away calls back, so the reader sees the EOF
+//
+static void TestHangup() {
+    Line a;
+    LineOpen(&a);
+
+    close(a.pty.master);
+    a.pty.master = -1;
+
+    for (int i=0; i<10 && !a.hangup; i++)
+        Run(100);
+    CHECK(a.hangup);
+    CHECK(!a.source.IsAttached());
+
+    LineClose(&a);
+}
+
+static void TestAttach() {
+    TMInputSource source;
+    CHECK(!source.Attach(-1, ReadCallback, NULL));
+    CHECK(!source.IsAttached());
+
+#ifndef __APPLE__
+    // poll() serves a fixed number of sources
+    TMInputSource   many[kMaxInputSources + 1];
+    int             fds[2];
+    CHECK(pipe(fds) == 0);
+    for (int i=0; i<kMaxInputSources; i++)
+        CHECK(many[i].Attach(fds[0], ReadCallback, NULL));
+    CHECK(!many[kMaxInputSources].Attach(fds[0], ReadCallback, NULL));
+    for (int i=0; i<kMaxInputSources; i++)
+        many[i].Detach();
+    CHECK(many[kMaxInputSources].Attach(fds[0], ReadCallback, NULL));
+    many[kMaxInputSources].Detach();
+    close(fds[0]);
+    close(fds[1]);
+#endif
+}
+
+int main() {
+    TestWake();
+    TestTwoLines();
+    TestDetachFromCallback();
+    TestHangup();
+    TestAttach();
+
+    return TEST_RESULT;
+}
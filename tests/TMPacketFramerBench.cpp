@@ -0,0 +1,113 @@
+/**
+ * TMPacketFramerBench.cpp
+ *
+ * TabletMagic Tests
+ * Thinkyhead Software
+ *
+ * This program is a component of TabletMagic. See the
+ * accompanying documentation for more details about the
+ * TabletMagic project.
+ *
+ * LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+//
+// Framing throughput over the captured streams, repeated out
+// to a few megabytes and fed in reads of typical sizes: a few
+// packets, as a USB adapter hands them over, up to a full
+// reader thread chunk.
+//
+//   TMPacketFramerBench [megabytes]
+//
+
+#include "TMTest.h"
+#include "TMPacketFramer.h"
+
+typedef struct {
+    const char      *file;
+    FramerProtocol  protocol;
+    int             size;
+    bool            sd;
+} StreamInfo;
+
+static const StreamInfo streams[] = {
+    { "wacom4.bin",     kFramerWacom,       7, false },
+    { "wacom5.bin",     kFramerWacom,       9, false },
+    { "tabletpc.bin",   kFramerTabletPC,    9, true  },
+    { "fujitsu.bin",    kFramerFujitsu,     5, false }
+};
+
+#define kStreamCount    (int)(sizeof(streams) / sizeof(streams[0]))
+#define kPasses         5
+
+static unsigned long packets;
+
+static void CountCallback(FrameKind kind, char *, int, void *) {
+    if (kind == kFramePacket) packets++;
+}
+
+int main(int argc, char *argv[]) {
+    int megabytes = (argc > 1) ? atoi(argv[1]) : 4;
+    if (megabytes < 1) megabytes = 1;
+
+    static const int reads[] = { 32, 256, 4096 };
+
+    printf("%-14s %6s %10s %10s\n", "stream", "read", "MB/s", "ns/packet");
+
+    for (int i=0; i<kStreamCount; i++) {
+        const StreamInfo    *s = &streams[i];
+        int                 length;
+        char                *capture = LoadStream(s->file, &length);
+
+        // Whole captures back to back, so every packet is intact
+        int total = (megabytes << 20) / length * length;
+        char *stream = (char*)malloc(total);
+        for (int at=0; at<total; at+=length)
+            memcpy(stream + at, capture, length);
+
+        for (int r=0; r<(int)(sizeof(reads)/sizeof(reads[0])); r++) {
+            int     chunk = reads[r];
+            char    *buf = (char*)malloc(chunk + 1);
+            double  best = 1e9;
+
+            for (int pass=0; pass<kPasses; pass++) {
+                TMPacketFramer framer;
+                framer.Configure(s->protocol, s->size, false, s->sd);
+                framer.SetCallback(CountCallback, NULL);
+                packets = 0;
+
+                double start = Seconds();
+                for (int at=0; at<total; at+=chunk) {
+                    int n = (total - at < chunk) ? total - at : chunk;
+                    memcpy(buf, stream + at, n);
+                    framer.Feed(buf, n);
+                }
+                double elapsed = Seconds() - start;
+                if (elapsed < best) best = elapsed;
+            }
+
+            printf("%-14s %6d %10.1f %10.2f\n", s->file, chunk,
+                   total / best / 1048576.0, best * 1e9 / (packets ? packets : 1));
+            free(buf);
+        }
+
+        free(stream);
+        free(capture);
+    }
+
+    return 0;
+}
@@ -0,0 +1,375 @@
+/**
+ * TMPacketFramerTest.cpp
+ *
+ * TabletMagic Tests
+ * Thinkyhead Software
+ *
+ * This program is a component of TabletMagic. See the
+ * accompanying documentation for more details about the
+ * TabletMagic project.
+ *
+ * LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "TMTest.h"
+#include "TMPacketFramer.h"
+#include "TMStreamWatchdog.h"
+
+//
+// The captured streams and how the daemon frames them
+//
+typedef struct {
+    const char      *file;
+    FramerProtocol  protocol;
+    int             size;
+    bool            sd;
+    int             replies;        // Replies of either kind in the capture
+} StreamInfo;
+
+static const StreamInfo streams[] = {
+    { "wacom4.bin",     kFramerWacom,       7, false, 2 },
+    { "wacom5.bin",     kFramerWacom,       9, false, 2 },
+    { "tabletpc.bin",   kFramerTabletPC,    9, true,  2 },
+    { "fujitsu.bin",    kFramerFujitsu,     5, false, 0 }
+};
+
+#define kStreamCount    (int)(sizeof(streams) / sizeof(streams[0]))
+
+//
+// FrameLog
+//
+// Everything the framer handed out, as kind, length and bytes,
+// so two runs can be compared with memcmp. Packets also go into
+// a log of their own for the tests that expect stray replies.
+//
+typedef struct {
+    char    *data, *packetData;
+    int     length, packetLength;
+    int     packets, replies, wrong;
+    int     size;
+} FrameLog;
+
+static void LogAppend(char **data, int *length, FrameKind kind, const char *bytes, int n) {
+    *data = (char*)realloc(*data, *length + n + 2);
+    (*data)[(*length)++] = (char)kind;
+    (*data)[(*length)++] = (char)n;
+    memcpy(*data + *length, bytes, n);
+    *length += n;
+}
+
+static void LogCallback(FrameKind kind, char *data, int length, void *info) {
+    FrameLog *log = (FrameLog*)info;
+
+    CHECK_EQ(data[length], '\0');
+
+    if (kind == kFramePacket) {
+        log->packets++;
+        if (length != log->size || !(data[0] & 0x80))
+            log->wrong++;
+        LogAppend(&log->packetData, &log->packetLength, kind, data, length);
+    }
+    else
+        log->replies++;
+
+    LogAppend(&log->data, &log->length, kind, data, length);
+}
+
+static void LogInit(FrameLog *log, const StreamInfo *s) {
+    memset(log, 0, sizeof(*log));
+    log->size = s->size;
+}
+
+static void LogFree(FrameLog *log) {
+    free(log->data);
+    free(log->packetData);
+}
+
+static bool LogSame(FrameLog *a, FrameLog *b) {
+    return a->length == b->length && memcmp(a->data, b->data, a->length) == 0;
+}
+
+static void Setup(TMPacketFramer *framer, const StreamInfo *s, FrameLog *log) {
+    framer->Configure(s->protocol, s->size, false, s->sd);
+    framer->SetCallback(LogCallback, log);
+    LogInit(log, s);
+}
+
+//
+// FeedChunks(framer, stream, length, chunk)
+//
+// Feed the stream in reads of the given size, each in a buffer
+// of its own with a spare byte, as the port would hand them over.
+//
+static void FeedChunks(TMPacketFramer *framer, const char *stream, int length, int chunk) {
+    char *buf = (char*)malloc(chunk + 1);
+    for (int at=0; at<length; at+=chunk) {
+        int n = (length - at < chunk) ? length - at : chunk;
+        memcpy(buf, stream + at, n);
+        framer->Feed(buf, n);
+    }
+    free(buf);
+}
+
+//
+// TestWhole
+// One read with the whole capture finds every phrase in place
+//
+static void TestWhole(const StreamInfo *s, const char *stream, int length, FrameLog *whole) {
+    TMPacketFramer framer;
+    Setup(&framer, s, whole);
+    FeedChunks(&framer, stream, length, length);
+
+    CHECK(whole->packets > 100);
+    CHECK_EQ(whole->wrong, 0);
+    CHECK_EQ(whole->replies, s->replies);
+    CHECK_EQ(framer.Dropped(), 0);
+
+    // Only the phrase open at the end of the capture is copied
+    CHECK(framer.bytesCarried <= (unsigned long)TPC_QUERY_REPLY_SIZE);
+}
+
+//
+// TestSplits
+//
+// Split the capture into two reads at every offset, and into
+// reads of every size up to 32. Every packet that straddles two
+// reads has to come out of the carry the same as from one read.
+//
+static void TestSplits(const StreamInfo *s, const char *stream, int length, FrameLog *whole) {
+    char *buf = (char*)malloc(length + 1);
+
+    for (int split=1; split<length; split++) {
+        TMPacketFramer  framer;
+        FrameLog        log;
+        Setup(&framer, s, &log);
+
+        memcpy(buf, stream, split);
+        framer.Feed(buf, split);
+        bool open = framer.Pending() || framer.Holding();
+        unsigned long carried = framer.bytesCarried;
+
+        memcpy(buf, stream + split, length - split);
+        framer.Feed(buf, length - split);
+
+        if (!LogSame(&log, whole)) {
+            fprintf(stderr, "%s: split at %d differs\n", s->file, split);
+            test_failures++;
+        }
+
+        // A phrase open at the split is carried into the next read
+        CHECK(!open || carried > 0);
+        LogFree(&log);
+    }
+
+    for (int chunk=1; chunk<=32; chunk++) {
+        TMPacketFramer  framer;
+        FrameLog        log;
+        Setup(&framer, s, &log);
+        FeedChunks(&framer, stream, length, chunk);
+
+        if (!LogSame(&log, whole)) {
+            fprintf(stderr, "%s: reads of %d bytes differ\n", s->file, chunk);
+            test_failures++;
+        }
+        CHECK(chunk % s->size == 0 || framer.bytesCarried > 0);
+        LogFree(&log);
+    }
+
+    free(buf);
+}
+
+//
+// PacketStart(s, stream, length, n)
+// Offset of the nth packet in the capture
+//
+static int PacketStart(const StreamInfo *s, const char *stream, int length, int n) {
+    unsigned char mark = (s->protocol == kFramerFujitsu) ? 130 : 0x7F;
+    for (int i=0; i<length; i++) {
+        unsigned char c = (unsigned char)stream[i];
+        if (c > mark && (s->protocol != kFramerTabletPC || c != 0xC0) && n-- == 0)
+            return i;
+    }
+    return -1;
+}
+
+//
+// TestResync
+//
+// Garbage that looks like the start of a packet is dropped as
+// soon as the next packet begins, and nothing after it is lost.
+// A stream picked up in the middle of a packet loses only that
+// packet.
+//
+static void TestResync(const StreamInfo *s, const char *stream, int length, FrameLog *whole) {
+    static const char   garbage[] = { (char)0x93, 0x11, 0x22 };
+    int                 at = PacketStart(s, stream, length, 50);
+    CHECK(at > 0);
+
+    char *buf = (char*)malloc(length + sizeof(garbage) + 1);
+    memcpy(buf, stream, at);
+    memcpy(buf + at, garbage, sizeof(garbage));
+    memcpy(buf + at + sizeof(garbage), stream + at, length - at);
+
+    int reads[] = { 7, length + (int)sizeof(garbage) };
+    for (int r=0; r<2; r++) {
+        TMPacketFramer  framer;
+        FrameLog        log;
+        Setup(&framer, s, &log);
+        FeedChunks(&framer, buf, length + (int)sizeof(garbage), reads[r]);
+
+        CHECK(LogSame(&log, whole));
+        CHECK_EQ(framer.wrongSize, 1);
+        LogFree(&log);
+    }
+
+    // Joining the stream mid-packet
+    int first = PacketStart(s, stream, length, 0);
+    TMPacketFramer  framer;
+    FrameLog        log;
+    Setup(&framer, s, &log);
+    memcpy(buf, stream + first + 2, length - first - 2);
+    framer.Feed(buf, length - first - 2);
+
+    int skip = 2 + s->size;         // The first packet's log entry
+    CHECK_EQ(log.packets, whole->packets - 1);
+    CHECK_EQ(log.packetLength, whole->packetLength - skip);
+    CHECK(memcmp(log.packetData, whole->packetData + skip, log.packetLength) == 0);
+
+    LogFree(&log);
+    free(buf);
+}
+
+//
+// TestErrorMarks
+//
+// With PARMRK marks in the stream only the packet holding the
+// bad byte is dropped, even when the mark is split across reads.
+//
+static void TestErrorMarks(const StreamInfo *s, const char *stream, int length, FrameLog *whole) {
+    int at = PacketStart(s, stream, length, 20);
+    CHECK(at > 0);
+
+    // Mark the 3rd byte of the packet, and escape any real FF
+    char *buf = (char*)malloc(length * 2 + 3);
+    int n = 0;
+    for (int i=0; i<length; i++) {
+        if (i == at + 2) { buf[n++] = (char)0xFF; buf[n++] = 0; }
+        if ((unsigned char)stream[i] == 0xFF) buf[n++] = (char)0xFF;
+        buf[n++] = stream[i];
+    }
+
+    // Reads of 1 to 16 bytes, then all at once
+    for (int chunk=1; chunk<=17; chunk++) {
+        TMPacketFramer  framer;
+        FrameLog        log;
+        Setup(&framer, s, &log);
+        framer.SetErrorMarks(true);
+        FeedChunks(&framer, buf, n, chunk > 16 ? n : chunk);
+
+        CHECK_EQ(framer.lineErrors, 1);
+        CHECK_EQ(framer.corrupted, 1);
+        CHECK_EQ(log.packets, whole->packets - 1);
+        LogFree(&log);
+    }
+
+    free(buf);
+}
+
+//
+// TestHeldPacket
+//
+// A TabletPC burst ends with a whole packet that the framer has
+// to hold, since it could be the start of a query reply. That
+// isn't a stall, and once let go it comes out just where it
+// would have. A packet cut short is a stall.
+//
+static void TestHeldPacket(const StreamInfo *s, const char *stream, int length, FrameLog *whole) {
+    if (s->protocol != kFramerTabletPC)
+        return;
+
+    int end = PacketStart(s, stream, length, 5);
+    CHECK(end > 0);
+
+    char *buf = (char*)malloc(length + 1);
+    TMPacketFramer      framer;
+    TMStreamWatchdog    watchdog;
+    FrameLog            log;
+    Setup(&framer, s, &log);
+    watchdog.Reset(0);
+
+    // The burst, then nothing
+    memcpy(buf, stream, end);
+    framer.Feed(buf, end);
+    CHECK_EQ(watchdog.Bytes(0, 0), kStreamOK);
+
+    int packets = log.packets;
+    CHECK(framer.Holding());
+    CHECK(!framer.Pending());
+    CHECK_EQ(watchdog.Check(framer.Pending(), watchdog.StallDeadline() + 1), kStreamOK);
+
+    framer.ReleaseHeld();
+    CHECK_EQ(log.packets, packets + 1);
+    CHECK(!framer.Holding());
+    framer.ReleaseHeld();
+    CHECK_EQ(log.packets, packets + 1);
+
+    // The stream goes on as if it had never stopped
+    memcpy(buf, stream + end, length - end);
+    framer.Feed(buf, length - end);
+    CHECK(LogSame(&log, whole));
+    LogFree(&log);
+
+    // Cut short, it's a stall once the deadline passes
+    TMPacketFramer cut;
+    Setup(&cut, s, &log);
+    watchdog.Reset(0);
+    memcpy(buf, stream, end + 6);
+    cut.Feed(buf, end + 6);
+    CHECK_EQ(watchdog.Bytes(0, 0), kStreamOK);
+    CHECK(cut.Pending());
+    CHECK(!cut.Holding());
+    CHECK_EQ(watchdog.Check(cut.Pending(), watchdog.StallDeadline() - 0.01), kStreamOK);
+    CHECK_EQ(watchdog.Check(cut.Pending(), watchdog.StallDeadline()), kStreamStalled);
+    LogFree(&log);
+
+    free(buf);
+}
+
+int main() {
+    for (int i=0; i<kStreamCount; i++) {
+        const StreamInfo    *s = &streams[i];
+        int                 length;
+        char                *stream = LoadStream(s->file, &length);
+        FrameLog            whole;
+
+        int before = test_failures;
+
+        TestWhole(s, stream, length, &whole);
+        TestSplits(s, stream, length, &whole);
+        TestResync(s, stream, length, &whole);
+        TestErrorMarks(s, stream, length, &whole);
+        TestHeldPacket(s, stream, length, &whole);
+
+        printf("%-14s %5d bytes, %4d packets, %d replies: %s\n", s->file, length,
+               whole.packets, whole.replies, test_failures == before ? "ok" : "FAILED");
+
+        LogFree(&whole);
+        free(stream);
+    }
+
+    return TEST_RESULT;
+}
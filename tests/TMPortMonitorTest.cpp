@@ -0,0 +1,139 @@
+/**
+ * TMPortMonitorTest.cpp
+ *
+ * TabletMagic Tests
+ * Thinkyhead Software
+ *
+ * This program is a component of TabletMagic. See the
+ * accompanying documentation for more details about the
+ * TabletMagic project.
+ *
+ * LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+//
+// TMPortMonitor watching a scratch directory instead of /dev: a
+// node is created, changed, moved out and back, and deleted, and
+// each step must be reported for the right path. Nothing is
+// reported once the monitor is stopped. The inotify backend only,
+// since IOKit won't report a plain file.
+//
+
+#include "TMTest.h"
+#include "TMPortMonitor.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define kMaxEvents  32
+
+typedef struct {
+    int         count;
+    PortEvent   event[kMaxEvents];
+    char        path[kMaxEvents][MAXPATHLEN];
+} Events;
+
+static void EventCallback(PortEvent event, const char *path, void *info) {
+    Events *e = (Events*)info;
+    if (e->count < kMaxEvents) {
+        e->event[e->count] = event;
+        snprintf(e->path[e->count], MAXPATHLEN, "%s", path);
+    }
+    e->count++;
+}
+
+//
+// Pump(e)
+// Run until the events stop coming, and return how many came
+//
+static int Pump(Events *e) {
+    int before = e->count;
+    while (TMInputSource::RunOnce(100) > 0) {}
+    return e->count - before;
+}
+
+//
+// Last(e, event, path)
+// The newest event is the one expected, for the expected path
+//
+static bool Last(Events *e, PortEvent event, const char *path) {
+    if (e->count < 1 || e->count > kMaxEvents)
+        return false;
+    int n = e->count - 1;
+    return e->event[n] == event && strcmp(e->path[n], path) == 0;
+}
+
+int main() {
+    char dir[] = "/tmp/TMPortMonitorTest.XXXXXX", away[] = "/tmp/TMPortMonitorAway.XXXXXX";
+    CHECK(mkdtemp(dir) != NULL);
+    CHECK(mkdtemp(away) != NULL);
+
+    char node[MAXPATHLEN], moved[MAXPATHLEN];
+    snprintf(node, sizeof(node), "%s/ttyUSB9", dir);
+    snprintf(moved, sizeof(moved), "%s/ttyUSB9", away);
+
+    TMPortMonitor monitor;
+    Events e = Events();
+    monitor.SetCallback(EventCallback, &e);
+
+    CHECK(monitor.Start(dir));
+    CHECK(monitor.IsRunning());
+    CHECK_EQ(Pump(&e), 0);
+
+    // Plugged in
+    int fd = open(node, O_CREAT | O_WRONLY, 0600);
+    CHECK(fd != -1);
+    close(fd);
+    CHECK(Pump(&e) >= 1);
+    CHECK(Last(&e, kPortArrived, node));
+
+    // Its owner or mode set up after it appears
+    CHECK_EQ(chmod(node, 0660), 0);
+    CHECK(Pump(&e) >= 1);
+    CHECK(Last(&e, kPortArrived, node));
+
+    // Moved out is the same as gone, and back in the same as new
+    CHECK_EQ(rename(node, moved), 0);
+    CHECK_EQ(Pump(&e), 1);
+    CHECK(Last(&e, kPortRemoved, node));
+
+    CHECK_EQ(rename(moved, node), 0);
+    CHECK_EQ(Pump(&e), 1);
+    CHECK(Last(&e, kPortArrived, node));
+
+    // Unplugged
+    CHECK_EQ(unlink(node), 0);
+    CHECK(Pump(&e) >= 1);
+    CHECK(Last(&e, kPortRemoved, node));
+
+    // Nothing after a stop
+    monitor.Stop();
+    CHECK(!monitor.IsRunning());
+    int count = e.count;
+    fd = open(node, O_CREAT | O_WRONLY, 0600);
+    CHECK(fd != -1);
+    close(fd);
+    (void)TMInputSource::RunOnce(100);
+    CHECK_EQ(e.count, count);
+
+    unlink(node);
+    rmdir(dir);
+    rmdir(away);
+
+    return TEST_RESULT;
+}
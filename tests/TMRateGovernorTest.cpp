@@ -0,0 +1,198 @@
+/**
+ * TMRateGovernorTest.cpp
+ *
+ * TabletMagic Tests
+ * Thinkyhead Software
+ *
+ * This program is a component of TabletMagic. See the
+ * accompanying documentation for more details about the
+ * TabletMagic project.
+ *
+ * LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+//
+// TMRateGovernor level changes, on a made-up clock: drawing,
+// lifting, hovering, resting and leaving, with packets and with
+// the ticks that stand in for them when the tablet goes quiet.
+//
+
+#include "TMTest.h"
+#include "TMRateGovernor.h"
+
+#define kPacket     0.01            // 100 packets a second
+#define kTickSlop   0.001           // A timer fires a little after its time
+
+//
+// Hover(gov, &now, seconds, &x, step)
+// Packets from a near pen moving steadily, none of them drawing
+//
+static int Hover(TMRateGovernor *gov, double *now, double seconds, long *x, long step) {
+    int changes = 0;
+    for (double end = *now + seconds; *now < end; *now += kPacket) {
+        *x += step;
+        changes += gov->Update(false, true, *x, 1000, *now);
+    }
+    return changes;
+}
+
+//
+// TestDrawing
+// Drawing is full rate at once, and stays there just after a lift
+//
+static void TestDrawing() {
+    TMRateGovernor gov;
+    double now = 100;
+    long x = 1000;
+
+    gov.Reset(now);
+    CHECK_EQ(gov.Level(), kRateFull);
+
+    // Hovering drops to the hover rate once the lift delay is over
+    CHECK_EQ(Hover(&gov, &now, kRateHoverDelay + 0.05, &x, 10), 1);
+    CHECK_EQ(gov.Level(), kRateHover);
+
+    // The pen goes down
+    CHECK(gov.Update(true, true, x, 1000, now));
+    CHECK_EQ(gov.Level(), kRateFull);
+    CHECK(!gov.Update(true, true, x + 20, 1000, now += kPacket));
+
+    // And comes up, staying at full for a moment
+    now += kPacket;
+    CHECK(!gov.Update(false, true, x + 40, 1000, now));
+    CHECK(!gov.Update(false, true, x + 60, 1000, now + kRateHoverDelay / 2));
+    CHECK(gov.Update(false, true, x + 80, 1000, now + kRateHoverDelay + kPacket));
+    CHECK_EQ(gov.Level(), kRateHover);
+}
+
+//
+// TestResting
+// A near pen that stops moving goes idle, and jitter doesn't count
+//
+static void TestResting() {
+    TMRateGovernor gov;
+    double now = 0;
+    long x = 5000;
+
+    gov.Reset(now);
+    (void)Hover(&gov, &now, 1.0, &x, 10);
+    CHECK_EQ(gov.Level(), kRateHover);
+
+    // Held still, with a little jitter
+    double still = now;
+    int changes = 0;
+    for (int i=0; now < still + kRateIdleDelay - 3 * kPacket; i++, now += kPacket)
+        changes += gov.Update(false, true, x + ((i & 1) ? kRateMotionSlop : -kRateMotionSlop), 1000, now);
+    CHECK_EQ(changes, 0);
+    CHECK_EQ(gov.Level(), kRateHover);
+
+    now += 5 * kPacket;
+    CHECK(gov.Update(false, true, x, 1000, now));
+    CHECK_EQ(gov.Level(), kRateIdle);
+
+    // Moving again wakes it
+    CHECK(gov.Update(false, true, x + 50, 1000, now += kPacket));
+    CHECK_EQ(gov.Level(), kRateHover);
+}
+
+//
+// TestLeaving
+// Out of proximity is idle, and drawing jumps straight back to full
+//
+static void TestLeaving() {
+    TMRateGovernor gov;
+    double now = 0;
+    long x = 5000;
+
+    gov.Reset(now);
+    (void)Hover(&gov, &now, 1.0, &x, 10);
+    CHECK(gov.Update(false, false, x + 100, 1000, now));
+    CHECK_EQ(gov.Level(), kRateIdle);
+    CHECK(gov.Deadline() == 0);
+
+    CHECK(gov.Update(true, true, x, 1000, now += kPacket));
+    CHECK_EQ(gov.Level(), kRateFull);
+}
+
+//
+// TestTicks
+//
+// A TabletPC goes quiet when the pen leaves, so the last packet
+// may still say near. The ticks at each deadline take the level
+// down to idle with no more packets.
+//
+static void TestTicks() {
+    TMRateGovernor gov;
+    double now = 0;
+
+    gov.Reset(now);
+    CHECK(gov.Deadline() == now + kRateHoverDelay);
+
+    // The last packet is the pen lifting, still near
+    CHECK(!gov.Update(true, true, 1000, 1000, now += kPacket));
+    CHECK(!gov.Update(false, true, 1100, 1000, now += kPacket));
+
+    // Too early, nothing happens
+    double when = gov.Deadline();
+    CHECK(when > now);
+    CHECK(!gov.Tick(when - kPacket));
+    CHECK_EQ(gov.Level(), kRateFull);
+
+    CHECK(gov.Tick(when + kTickSlop));
+    CHECK_EQ(gov.Level(), kRateHover);
+
+    when = gov.Deadline();
+    CHECK(when > now);
+    CHECK(!gov.Tick(when - kPacket));
+    CHECK(gov.Tick(when + kTickSlop));
+    CHECK_EQ(gov.Level(), kRateIdle);
+    CHECK(gov.Deadline() == 0);
+    CHECK(!gov.Tick(when + 60));
+
+    // A tablet that never sent a thing still goes idle
+    gov.Reset(0);
+    CHECK(gov.Tick(gov.Deadline() + kTickSlop));
+    CHECK_EQ(gov.Level(), kRateIdle);
+}
+
+//
+// TestTimeAtLevels
+// The time at each level adds up, counted at each change
+//
+static void TestTimeAtLevels() {
+    TMRateGovernor gov;
+
+    gov.Reset(10);
+    CHECK(gov.Update(false, true, 100, 100, 11));       // Hover after 1s at full
+    CHECK(gov.Update(false, false, 200, 100, 14));      // Idle after 3s at hover
+    CHECK(gov.Update(true, true, 200, 100, 20));        // Full after 6s at idle
+
+    CHECK_EQ(gov.changes, 3);
+    CHECK(gov.secondsAt[kRateFull] > 0.99 && gov.secondsAt[kRateFull] < 1.01);
+    CHECK(gov.secondsAt[kRateHover] > 2.99 && gov.secondsAt[kRateHover] < 3.01);
+    CHECK(gov.secondsAt[kRateIdle] > 5.99 && gov.secondsAt[kRateIdle] < 6.01);
+}
+
+int main() {
+    TestDrawing();
+    TestResting();
+    TestLeaving();
+    TestTicks();
+    TestTimeAtLevels();
+
+    return TEST_RESULT;
+}
@@ -0,0 +1,175 @@
+/**
+ * TMReadLineBench.cpp
+ *
+ * TabletMagic Tests
+ * Thinkyhead Software
+ *
+ * This program is a component of TabletMagic. See the
+ * accompanying documentation for more details about the
+ * TabletMagic project.
+ *
+ * LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+//
+// System calls it takes to read the ArtZ replies to ~#, ~C and
+// ~R over a pty, with ReadLine and its read-ahead buffer, and
+// with the byte-at-a-time loop it replaced (select per line,
+// then FIONREAD and a one-byte read per byte).
+//
+//   TMReadLineBench [rounds]
+//
+
+#include "TMTest.h"
+#include "TMTestPty.h"
+#include "TMSerialPort.h"
+
+#include <sys/ioctl.h>
+#include <sys/select.h>
+
+static const char *replies[] = {
+    "~#UD-1212-R00 V1.4-4\r",
+    "~C15240,15240\r",
+    "~RE202C900,002,02,1270,1270\r"
+};
+
+#define kReplyCount     (int)(sizeof(replies) / sizeof(replies[0]))
+
+static unsigned long oldSelects, oldReads, oldIoctls;
+
+//
+// OldBytesOnPort / OldReadLine
+// The reply loop as it was before the read-ahead buffer
+//
+static int OldBytesOnPort(int fd) {
+    int bytes = 0;
+    ioctl(fd, FIONREAD, &bytes);
+    oldIoctls++;
+    return bytes;
+}
+
+static int OldReadLine(int fd, char *buffer, suseconds_t usec=4000) {
+    char    *bufPtr = buffer;
+    bool    gotLine = false, in_packet = false;
+
+    while (!gotLine) {
+        fd_set          inputList;
+        struct timeval  timeout = { 0, usec };
+
+        FD_ZERO(&inputList);
+        FD_SET(fd, &inputList);
+        oldSelects++;
+        if (select(fd + 1, &inputList, NULL, NULL, &timeout) <= 0)
+            break;
+
+        while (!gotLine && OldBytesOnPort(fd)) {
+            char c;
+            oldReads++;
+            if (read(fd, &c, 1) != 1) {
+                gotLine = true;
+                break;
+            }
+
+            if ((c & 0x80) != 0)
+                in_packet = true;
+            else if (c == '~') {
+                in_packet = false;
+                bufPtr = buffer;
+            }
+
+            if (!in_packet) {
+                *bufPtr = c;
+                if (c == '\n' || c == '\r')
+                    gotLine = true;
+                else
+                    bufPtr++;
+            }
+        }
+    }
+
+    *bufPtr = '\0';
+    return (int)strlen(buffer);
+}
+
+//
+// Reply(pty, port, i)
+// The tablet answers in one piece, as it would at the end of a query
+//
+static int Reply(TestPty *pty, TMSerialPort *port, int i) {
+    int length = (int)strlen(replies[i]);
+    if (!PtySend(pty, replies[i], length))
+        return 0;
+
+    // Wait for it outside the counted calls
+    struct pollfd pfd = { port->FileDevice(), POLLIN, 0 };
+    (void)poll(&pfd, 1, 500);
+    usleep(1000);
+    return length;
+}
+
+int main(int argc, char *argv[]) {
+    int rounds = (argc > 1) ? atoi(argv[1]) : 10;
+    if (rounds < 1) rounds = 1;
+
+    TestPty         pty;
+    TMSerialPort    port;
+    char            line[256];
+    int             bytes = 0, bad = 0;
+
+    if (!PtyOpen(&pty) || port.Open(pty.name) == kSerialError) {
+        fprintf(stderr, "Can't open a pty\n");
+        return 1;
+    }
+
+    // Byte at a time
+    double oldTime = 0;
+    for (int r=0; r<rounds; r++) {
+        for (int i=0; i<kReplyCount; i++) {
+            bytes += Reply(&pty, &port, i);
+            double start = Seconds();
+            if (OldReadLine(port.FileDevice(), line) != (int)strlen(replies[i]) - 1) bad++;
+            oldTime += Seconds() - start;
+        }
+    }
+
+    // With the read-ahead
+    double newTime = 0;
+    port.ResetCounters();
+    for (int r=0; r<rounds; r++) {
+        for (int i=0; i<kReplyCount; i++) {
+            (void)Reply(&pty, &port, i);
+            double start = Seconds();
+            if (port.ReadLine(line, sizeof(line)) != (int)strlen(replies[i]) - 1) bad++;
+            newTime += Seconds() - start;
+        }
+    }
+
+    int lines = rounds * kReplyCount;
+    unsigned long oldTotal = oldSelects + oldReads + oldIoctls;
+
+    printf("%d replies, %d bytes\n", lines, bytes);
+    printf("  byte at a time: %4lu select + %4lu read + %4lu ioctl = %5lu (%.2f per byte), %.1f us per reply\n",
+           oldSelects, oldReads, oldIoctls, oldTotal, (double)oldTotal / bytes, oldTime * 1e6 / lines);
+    printf("  read-ahead:     %4lu select + %4lu read + %4lu ioctl = %5lu (%.2f per byte), %.1f us per reply\n",
+           port.selectCalls, port.readCalls, port.ioctlCalls, port.Syscalls(), (double)port.Syscalls() / bytes, newTime * 1e6 / lines);
+
+    if (bad) printf("%d replies came back wrong\n", bad);
+
+    port.Close();
+    PtyClose(&pty);
+    return bad ? 1 : 0;
+}
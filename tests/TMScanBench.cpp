@@ -0,0 +1,196 @@
+/**
+ * TMScanBench.cpp
+ *
+ * TabletMagic Tests
+ * Thinkyhead Software
+ *
+ * This program is a component of TabletMagic. See the
+ * accompanying documentation for more details about the
+ * TabletMagic project.
+ *
+ * LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+//
+// Parse rate of the II-S ASCII reports and the settings replies,
+// with the sscanf calls the daemon used to make and with TMScan.
+// Every line is parsed both ways first, and the two must agree
+// on what they got, or the line must be refused by both.
+//
+//   TMScanBench [rounds]
+//
+
+#include "TMTest.h"
+#include "TMScan.h"
+
+#define kLines      4096
+#define kLineSize   40
+#define kPasses     5
+
+static char iisLines[kLines][kLineSize];
+static char settingsLines[kLines][kLineSize];
+
+//! Fields of one report or reply, and whether they were all there
+typedef struct {
+    long    xx, yy;
+    int     b;
+    bool    ok;
+} Report;
+
+typedef struct {
+    unsigned int    mask;
+    int             increment, interval, xrez, yrez;
+    bool            ok;
+} Reply;
+
+//
+// MakeReports
+//
+// "#,xxxxx,yyyyy,bb" as absolute, signed relative and space-padded
+// reports, plus some cut short as a dropped byte would leave them
+//
+static void MakeReports() {
+    srand(1);
+    for (int i=0; i<kLines; i++) {
+        int x = rand() % 15240, y = rand() % 15240, b = rand() % 32;
+        char *line = iisLines[i];
+
+        switch (i % 4) {
+            case 0:
+                snprintf(line, kLineSize, "#,%05d,%05d,%02d", x, y, b);
+                break;
+            case 1:
+                snprintf(line, kLineSize, "#,%+d,%+d,%02d", x % 200 - 100, y % 200 - 100, b);
+                break;
+            case 2:
+                snprintf(line, kLineSize, "#, %5d, %5d, %2d", x, y, b);
+                break;
+            case 3:
+                snprintf(line, kLineSize, "#,%05d,%05d,%02d", x, y, b);
+                line[3 + rand() % 12] = '\0';
+                break;
+        }
+    }
+}
+
+//
+// MakeReplies
+// "~Rmask,increment,interval,xrez,yrez" and the short "~Rmask"
+//
+static void MakeReplies() {
+    srand(2);
+    for (int i=0; i<kLines; i++) {
+        unsigned int mask = ((unsigned int)rand() << 16) ^ (unsigned int)rand();
+        if (i % 8 == 7)
+            snprintf(settingsLines[i], kLineSize, "~R%08X", mask);
+        else
+            snprintf(settingsLines[i], kLineSize, "~R%08X,%03d,%02d,%04d,%04d",
+                     mask, rand() % 256, rand() % 100, 1000 + rand() % 1540, 1000 + rand() % 1540);
+    }
+}
+
+//
+// The old and new ways, as ProcessWacomIIS_ASCII and
+// TabletSettings::Import had and have them
+//
+static inline void ReportSscanf(const char *line, Report *r) {
+    r->ok = sscanf(line + 2, "%ld,%ld,%d", &r->xx, &r->yy, &r->b) == 3;
+}
+
+static inline void ReportScan(const char *line, Report *r) {
+    TMScan scan(line + 2, (int)strlen(line) - 2);
+    r->ok = scan.Decimal(&r->xx) && scan.Literal(',') && scan.Decimal(&r->yy) && scan.Literal(',') && scan.Decimal(&r->b);
+}
+
+static inline void ReplySscanf(const char *line, Reply *r) {
+    r->ok = sscanf(line + 2, "%X,%d,%d,%d,%d", &r->mask, &r->increment, &r->interval, &r->xrez, &r->yrez) >= 1;
+}
+
+static inline void ReplyScan(const char *line, Reply *r) {
+    TMScan scan(line + 2);
+    r->ok = scan.Hex(&r->mask);
+    if (r->ok)
+        (void)(scan.Literal(',') && scan.Decimal(&r->increment)
+            && scan.Literal(',') && scan.Decimal(&r->interval)
+            && scan.Literal(',') && scan.Decimal(&r->xrez)
+            && scan.Literal(',') && scan.Decimal(&r->yrez));
+}
+
+static bool SameReport(const Report &a, const Report &b) {
+    return a.ok == b.ok && (!a.ok || (a.xx == b.xx && a.yy == b.yy && a.b == b.b));
+}
+
+static bool SameReply(const Reply &a, const Reply &b) {
+    return a.ok == b.ok && (!a.ok || (a.mask == b.mask && a.increment == b.increment
+        && a.interval == b.interval && a.xrez == b.xrez && a.yrez == b.yrez));
+}
+
+//
+// Time(parse, lines, rounds)
+// Best of a few passes, in ns per line
+//
+template <typename T>
+static double Time(void (*parse)(const char*, T*), char lines[][kLineSize], int rounds, long *sum) {
+    double best = 1e9;
+    T out;
+
+    for (int pass=0; pass<kPasses; pass++) {
+        double start = Seconds();
+        for (int r=0; r<rounds; r++)
+            for (int i=0; i<kLines; i++) {
+                parse(lines[i], &out);
+                *sum += out.ok;
+            }
+        double elapsed = Seconds() - start;
+        if (elapsed < best) best = elapsed;
+    }
+
+    return best * 1e9 / ((double)rounds * kLines);
+}
+
+int main(int argc, char *argv[]) {
+    int rounds = (argc > 1) ? atoi(argv[1]) : 50;
+    if (rounds < 1) rounds = 1;
+
+    MakeReports();
+    MakeReplies();
+
+    int bad = 0;
+    for (int i=0; i<kLines; i++) {
+        Report r1 = Report(), r2 = Report();
+        ReportSscanf(iisLines[i], &r1);
+        ReportScan(iisLines[i], &r2);
+        if (!SameReport(r1, r2) && bad++ < 10)
+            fprintf(stderr, "Report \"%s\" parsed differently\n", iisLines[i]);
+
+        Reply p1 = Reply(), p2 = Reply();
+        ReplySscanf(settingsLines[i], &p1);
+        ReplyScan(settingsLines[i], &p2);
+        if (!SameReply(p1, p2) && bad++ < 10)
+            fprintf(stderr, "Reply \"%s\" parsed differently\n", settingsLines[i]);
+    }
+
+    long sum = 0;
+    printf("%d lines x %d rounds\n", kLines, rounds);
+    printf("  II-S report, sscanf:     %6.1f ns per line\n", Time(ReportSscanf, iisLines, rounds, &sum));
+    printf("  II-S report, TMScan:     %6.1f ns per line\n", Time(ReportScan, iisLines, rounds, &sum));
+    printf("  settings reply, sscanf:  %6.1f ns per line\n", Time(ReplySscanf, settingsLines, rounds, &sum));
+    printf("  settings reply, TMScan:  %6.1f ns per line\n", Time(ReplyScan, settingsLines, rounds, &sum));
+
+    if (bad) printf("%d lines parsed differently\n", bad);
+    return (bad || sum == 0) ? 1 : 0;
+}
@@ -0,0 +1,277 @@
+/**
+ * TMSerialPortTest.cpp
+ *
+ * TabletMagic Tests
+ * Thinkyhead Software
+ *
+ * This program is a component of TabletMagic. See the
+ * accompanying documentation for more details about the
+ * TabletMagic project.
+ *
+ * LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+//
+// TMSerialPort against a pseudo-terminal: opening and setting
+// up the line, reads and writes, the read-ahead behind ReadLine
+// and ReadPacket, packet reads, and Flush.
+//
+
+#include "TMTest.h"
+#include "TMTestPty.h"
+#include "TMSerialPort.h"
+#include "TabletSettings.h"
+
+//
+// WaitBytes(port, n)
+// A pty hands bytes over a moment after they're written
+//
+static bool WaitBytes(TMSerialPort *port, int n, int msec=500) {
+    for (int i=0; i<msec; i++) {
+        if (port->BytesOnPort() >= n)
+            return true;
+        usleep(1000);
+    }
+    return false;
+}
+
+static void TestOpen(TestPty *pty, TMSerialPort *port) {
+    CHECK(port->Open(pty->name) != kSerialError);
+    CHECK(port->IsOpen());
+    CHECK(strstr(pty->name, port->Name()) != NULL);
+
+    // Raw, at the default 9600 8N1
+    struct termios attribs;
+    CHECK(tcgetattr(port->FileDevice(), &attribs) == 0);
+    CHECK_EQ(cfgetospeed(&attribs), B9600);
+    CHECK_EQ(attribs.c_cflag & CSIZE, CS8);
+    CHECK_EQ(attribs.c_cflag & (PARENB|CSTOPB), 0);
+    CHECK_EQ(attribs.c_lflag & (ICANON|ECHO), 0);
+    CHECK_EQ(attribs.c_cc[VMIN], 1);
+}
+
+//
+// TestParameters
+//
+// Linux ptys keep the speed and stop bits they're given but
+// not the data size or parity, so those are only checked on
+// the hosts that keep them.
+//
+static void TestParameters(TMSerialPort *port) {
+    struct termios attribs;
+
+    CHECK(port->SetParameters(B19200, CS7, 1, 2));
+    CHECK(tcgetattr(port->FileDevice(), &attribs) == 0);
+    CHECK_EQ(cfgetospeed(&attribs), B19200);
+    CHECK(attribs.c_cflag & CSTOPB);
+#ifndef __linux__
+    CHECK_EQ(attribs.c_cflag & CSIZE, CS7);
+    CHECK_EQ(attribs.c_cflag & (PARENB|PARODD), PARENB|PARODD);
+#endif
+    CHECK_EQ(port->DataBits(), CS7);
+    CHECK_EQ(port->Parity(), 1);
+    CHECK_EQ(port->StopBits(), 2);
+
+    // As a tablet's settings: 38400, 8 bits, even, 1 stop bit
+    TabletSettings sett;
+    sett.baud_rate = 4;
+    sett.data_bits = 1;
+    sett.parity = 3;
+    sett.stop_bits = 0;
+    sett.cts = sett.dsr = 0;
+    CHECK(port->SetParameters(&sett));
+    CHECK(tcgetattr(port->FileDevice(), &attribs) == 0);
+    CHECK_EQ(cfgetospeed(&attribs), B38400);
+    CHECK_EQ(attribs.c_cflag & CSTOPB, 0);
+#ifndef __linux__
+    CHECK_EQ(attribs.c_cflag & CSIZE, CS8);
+    CHECK_EQ(attribs.c_cflag & (PARENB|PARODD), PARENB);
+#endif
+    CHECK_EQ(port->Speed(), B38400);
+    CHECK_EQ(port->DataBits(), CS8);
+    CHECK_EQ(port->Parity(), 2);
+    CHECK_EQ(port->StopBits(), 1);
+
+    CHECK(port->SetDefaultParameters());
+}
+
+static void TestReadWrite(TestPty *pty, TMSerialPort *port) {
+    char buf[64];
+
+    // Commands go out as written
+    CHECK_EQ(port->WriteString((char*)"~#\r"), 3);
+    CHECK_EQ(PtyReceive(pty, buf, sizeof(buf)), 3);
+    CHECK(memcmp(buf, "~#\r", 3) == 0);
+
+    // Nothing to read yet
+    CHECK_EQ(port->Select(2000), 0);
+
+    CHECK(PtySend(pty, "\xA0\x01\x02", 3));
+    CHECK(port->Select(500000) > 0);
+    CHECK(WaitBytes(port, 3));
+    CHECK_EQ(port->Read(buf, sizeof(buf)), 3);
+    CHECK((unsigned char)buf[0] == 0xA0 && buf[2] == 0x02);
+}
+
+//
+// TestReadLine
+//
+// A reply with packets around it comes back as one line from
+// one read, and the packets after it stay in the read-ahead for
+// the next Read, so the framer doesn't lose them.
+//
+static void TestReadLine(TestPty *pty, TMSerialPort *port) {
+    static const char stream[] = "\xE0\x01\x02\x03\x04\x05\x06~#UD-1212-R00 V1.4-4\r\xE0\x11\x12\x13\x14\x15\x16";
+    const int length = (int)sizeof(stream) - 1;
+    char buf[64];
+
+    CHECK(PtySend(pty, stream, length));
+    CHECK(WaitBytes(port, length));
+
+    port->ResetCounters();
+    CHECK_EQ(port->ReadLine(buf, sizeof(buf)), 20);
+    CHECK(strcmp(buf, "~#UD-1212-R00 V1.4-4") == 0);
+    CHECK_EQ(port->readCalls, 1);
+    CHECK_EQ(port->Buffered(), 7);
+
+    CHECK_EQ(port->Read(buf, 4), 4);
+    CHECK((unsigned char)buf[0] == 0xE0 && buf[3] == 0x13);
+    CHECK_EQ(port->Read(buf, sizeof(buf)), 3);
+    CHECK(buf[0] == 0x14 && buf[2] == 0x16);
+    CHECK_EQ(port->readCalls, 1);
+    CHECK_EQ(port->Buffered(), 0);
+
+    // A line too long for the buffer is cut, not overrun
+    CHECK(PtySend(pty, "~RE202C900,002,02,1270,1270\r", 28));
+    CHECK(WaitBytes(port, 28));
+    CHECK_EQ(port->ReadLine(buf, 8), 7);
+    CHECK(strcmp(buf, "~RE202C") == 0);
+
+    // And nothing comes back when nothing is sent
+    CHECK_EQ(port->ReadLine(buf, sizeof(buf), 2000), 0);
+}
+
+//
+// TestReadPacket
+// A TabletPC query reply, arriving in two pieces
+//
+static void TestReadPacket(TestPty *pty, TMSerialPort *port) {
+    static const unsigned char reply[TPC_QUERY_REPLY_SIZE] = { 0xC0, 0x2F, 0x7E, 0x23, 0x7F, 0x7F, 0x51, 0, 0, 2, 6 };
+    char buf[TPC_QUERY_REPLY_SIZE];
+
+    CHECK(PtySend(pty, reply, 4));
+    CHECK(WaitBytes(port, 4));
+    CHECK(PtySend(pty, reply + 4, TPC_QUERY_REPLY_SIZE - 4));
+    CHECK_EQ(port->ReadPacket(buf, TPC_QUERY_REPLY_SIZE, 500000), TPC_QUERY_REPLY_SIZE);
+    CHECK(memcmp(buf, reply, TPC_QUERY_REPLY_SIZE) == 0);
+
+    CHECK_EQ(port->ReadPacket(buf, TPC_QUERY_REPLY_SIZE, 2000), 0);
+}
+
+//
+// TestPacketReads
+//
+// With packet reads VMIN is the packet size. A partial packet
+// still shows up in Select and can be taken without blocking.
+//
+static void TestPacketReads(TestPty *pty, TMSerialPort *port) {
+    struct termios attribs;
+    char buf[64];
+
+    CHECK(port->SetPacketReads(9));
+    CHECK_EQ(port->PacketReads(), 9);
+    CHECK(tcgetattr(port->FileDevice(), &attribs) == 0);
+    CHECK_EQ(attribs.c_cc[VMIN], 9);
+    CHECK_EQ(attribs.c_cc[VTIME], 0);
+
+    // Two packets at 9600 take under 20ms
+    CHECK(port->PacketTimeout() >= 18000 && port->PacketTimeout() < 20000);
+
+    CHECK(PtySend(pty, "\xA0\x01\x02\x03", 4));
+    CHECK(WaitBytes(port, 4));
+    CHECK_EQ(port->Select(2000), 1);
+    CHECK_EQ(port->ReadPacket(buf, 4, 2000), 4);
+
+    CHECK(PtySend(pty, "\xA0\x01\x02\x03\x04\x05\x06\x07\x08\xA0\x11\x12\x13\x14\x15\x16\x17\x18", 18));
+    CHECK(WaitBytes(port, 18));
+    CHECK(port->Select(500000) > 0);
+    CHECK_EQ(port->Read(buf, sizeof(buf)), 18);
+
+    CHECK(port->SetPacketReads(0));
+    CHECK(tcgetattr(port->FileDevice(), &attribs) == 0);
+    CHECK_EQ(attribs.c_cc[VMIN], 1);
+}
+
+//
+// TestFlush
+// Everything waiting is thrown away and counted, read-ahead too
+//
+static void TestFlush(TestPty *pty, TMSerialPort *port) {
+    char buf[256];
+    memset(buf, 0x41, sizeof(buf));
+    buf[sizeof(buf) - 1] = '\r';
+
+    CHECK(PtySend(pty, buf, 100));
+    CHECK(WaitBytes(port, 100));
+
+    port->ResetCounters();
+    CHECK_EQ(port->Flush(), 100);
+    CHECK_EQ(port->flushedBytes, 100);
+    CHECK_EQ(port->flushTimeouts, 0);
+    CHECK_EQ(port->Select(2000), 0);
+
+    // A line read, leaving the rest in the read-ahead
+    CHECK(PtySend(pty, "~#ID\r0123456789", 15));
+    CHECK(WaitBytes(port, 15));
+    CHECK_EQ(port->ReadLine(buf, sizeof(buf)), 4);
+    CHECK_EQ(port->Buffered(), 10);
+    CHECK_EQ(port->Flush(), 10);
+    CHECK_EQ(port->Buffered(), 0);
+    CHECK_EQ(port->BytesOnPort(), 0);
+}
+
+static void TestClose(TestPty *pty, TMSerialPort *port) {
+    port->Close();
+    CHECK(!port->IsOpen());
+    CHECK_EQ(port->Buffered(), 0);
+
+    // It can be opened again, as after a reconnect
+    CHECK(port->Open(pty->name) != kSerialError);
+    port->Close();
+}
+
+int main() {
+    TestPty         pty;
+    TMSerialPort    port;
+
+    if (!PtyOpen(&pty)) {
+        fprintf(stderr, "openpty failed\n");
+        return 1;
+    }
+
+    TestOpen(&pty, &port);
+    TestParameters(&port);
+    TestReadWrite(&pty, &port);
+    TestReadLine(&pty, &port);
+    TestReadPacket(&pty, &port);
+    TestPacketReads(&pty, &port);
+    TestFlush(&pty, &port);
+    TestClose(&pty, &port);
+
+    PtyClose(&pty);
+    return TEST_RESULT;
+}
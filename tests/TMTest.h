@@ -0,0 +1,104 @@
+/**
+ * TMTest.h
+ *
+ * TabletMagic Tests
+ * Thinkyhead Software
+ *
+ * This program is a component of TabletMagic. See the
+ * accompanying documentation for more details about the
+ * TabletMagic project.
+ *
+ * LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef __TMTEST_H__
+#define __TMTEST_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+//
+// Checks log the failure and keep going, so one run
+// reports everything that's wrong. main() returns
+// TEST_RESULT, which ctest reads as pass or fail.
+//
+static int test_failures __attribute__((unused)) = 0;
+
+#define CHECK(cond) do {                                                \
+        if (!(cond)) {                                                  \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n",                \
+                    __FILE__, __LINE__, #cond);                         \
+            test_failures++;                                            \
+        }                                                               \
+    } while(0)
+
+#define CHECK_EQ(a, b) do {                                             \
+        long _a = (long)(a), _b = (long)(b);                            \
+        if (_a != _b) {                                                 \
+            fprintf(stderr, "%s:%d: CHECK_EQ(%s, %s) failed: %ld != %ld\n", \
+                    __FILE__, __LINE__, #a, #b, _a, _b);                \
+            test_failures++;                                            \
+        }                                                               \
+    } while(0)
+
+#define TEST_RESULT     (test_failures ? (fprintf(stderr, "%d failed\n", test_failures), 1) : 0)
+
+//
+// LoadStream(name, &length)
+//
+// Read a captured stream from the streams folder. The buffer
+// has a spare byte at the end, as the framer expects.
+//
+static inline char* LoadStream(const char *name, int *length) {
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s", TM_STREAMS, name);
+
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        fprintf(stderr, "Can't open %s\n", path);
+        exit(1);
+    }
+
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    char *buf = (char*)malloc(size + 1);
+    if (fread(buf, 1, size, f) != (size_t)size) {
+        fprintf(stderr, "Can't read %s\n", path);
+        exit(1);
+    }
+    fclose(f);
+
+    *length = (int)size;
+    return buf;
+}
+
+//
+// Seconds()
+// Wall clock time for the benchmarks
+//
+static inline double Seconds() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+#endif
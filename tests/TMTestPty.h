@@ -0,0 +1,94 @@
+/**
+ * TMTestPty.h
+ *
+ * TabletMagic Tests
+ * Thinkyhead Software
+ *
+ * This program is a component of TabletMagic. See the
+ * accompanying documentation for more details about the
+ * TabletMagic project.
+ *
+ * LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef __TMTESTPTY_H__
+#define __TMTESTPTY_H__
+
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+#if defined(__APPLE__)
+#include <util.h>
+#elif defined(__FreeBSD__)
+#include <libutil.h>
+#else
+#include <pty.h>
+#endif
+
+//
+// TestPty
+//
+// A pseudo-terminal standing in for the tablet, as in the
+// simulator. The daemon's side opens "name" like any serial
+// port; the test plays the tablet on "master".
+//
+typedef struct {
+    int     master, slave;
+    char    name[128];
+} TestPty;
+
+static inline bool PtyOpen(TestPty *pty) {
+    if (openpty(&pty->master, &pty->slave, pty->name, NULL, NULL) == -1)
+        return false;
+
+    struct termios options;
+    tcgetattr(pty->slave, &options);
+    cfmakeraw(&options);
+    tcsetattr(pty->slave, TCSANOW, &options);
+    return true;
+}
+
+static inline void PtyClose(TestPty *pty) {
+    if (pty->master != -1) close(pty->master);
+    if (pty->slave != -1) close(pty->slave);
+    pty->master = pty->slave = -1;
+}
+
+//! Send bytes as the tablet
+static inline bool PtySend(TestPty *pty, const void *bytes, int length) {
+    return write(pty->master, bytes, length) == length;
+}
+
+//! Take up to maxlen bytes the daemon wrote, waiting up to msec for them
+static inline int PtyReceive(TestPty *pty, char *buffer, int maxlen, int msec=500) {
+    struct pollfd pfd = { pty->master, POLLIN, 0 };
+    int count = 0;
+
+    while (count < maxlen && poll(&pfd, 1, msec) > 0) {
+        int n = (int)read(pty->master, buffer + count, maxlen - count);
+        if (n <= 0) break;
+        count += n;
+        msec = 50;              // Then just what follows straight after
+    }
+
+    return count;
+}
+
+#endif
@@ -0,0 +1,14 @@
+//
+// Prefix header for the TabletMagic tests
+// The same definitions the daemon gets from Daemon_Prefix.pch
+//
+
+#include <CoreFoundation/CoreFoundation.h>
+
+#include "Constants.h"
+
+
+#define FALLBACK_TO_SD		0
+#define	LOG_STREAM_TO_FILE	0
+
+#define	kSerialError		-1
@@ -0,0 +1,40 @@
+/**
+ * CoreFoundation.h
+ *
+ * TabletMagic Tests
+ * Thinkyhead Software
+ *
+ * Just enough of the Mac OS X types for the daemon's portable
+ * classes to build on other hosts, so the tests can run there.
+ * Only on the include path when the real framework is missing.
+ */
+
+#ifndef __TMTEST_COREFOUNDATION_H__
+#define __TMTEST_COREFOUNDATION_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+typedef uint8_t         UInt8;
+typedef int8_t          SInt8;
+typedef uint16_t        UInt16;
+typedef int16_t         SInt16;
+typedef uint32_t        UInt32;
+typedef int32_t         SInt32;
+typedef unsigned char   Boolean;
+
+typedef double          CFTimeInterval;
+typedef double          CFAbsoluteTime;
+
+//! Seconds since 1 Jan 2001, as on Mac OS X
+static inline CFAbsoluteTime CFAbsoluteTimeGetCurrent() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (tv.tv_sec - 978307200.0) + tv.tv_usec / 1000000.0;
+}
+
+#endif
@@ -0,0 +1,43 @@
+#!/bin/sh
+#
+# capture.sh
+#
+# Records the streams used by the framer tests from the
+# tablet simulator: a query reply, a stretch of packets with
+# a second query answered in the middle of them, then more
+# packets. Run it from this folder with the simulator built:
+#
+#   ./capture.sh path/to/TabletSimulator
+#
+
+SIM=${1:-TabletSimulator}
+LINK=/tmp/tm_capture.$$
+
+capture() {
+    # capture model file start query
+    "$SIM" -m "$1" -l $LINK -q >/dev/null &
+    pid=$!
+    sleep 0.5
+
+    exec 3<>$LINK
+    stty raw -echo <&3
+    cat <&3 >"$2" &
+    cat_pid=$!
+
+    [ -n "$4" ] && printf "$4" >&3 && sleep 0.2
+    printf "$3" >&3
+    sleep 0.8
+    [ -n "$4" ] && printf "$4" >&3
+    sleep 0.8
+
+    kill $cat_pid $pid 2>/dev/null
+    wait $cat_pid $pid 2>/dev/null
+    exec 3>&-
+    rm -f $LINK
+    echo "$2: $(wc -c <"$2") bytes"
+}
+
+capture artz     wacom4.bin   'ST\r' '~#\r'
+capture intuos   wacom5.bin   'ST\r' '~#\r'
+capture isdv4    tabletpc.bin '1'    '*'
+capture fujitsu  fujitsu.bin  ''     ''